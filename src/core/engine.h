@@ -1,5 +1,7 @@
 #pragma once
 
+#include <scene/scene.h>
+
 namespace sublimation {
 
 class Engine {
@@ -0,0 +1,118 @@
+#include <core/job_system.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace sublimation {
+
+JobSystem* JobSystem::getSingleton() {
+    static JobSystem singleton;
+    return &singleton;
+}
+
+void JobSystem::initialize(uint32_t threadCount) {
+    if (running) {
+        return;
+    }
+
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    running = true;
+    for (uint32_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this);
+    }
+}
+
+void JobSystem::execute(JobContext& context, std::function<void()>&& job) {
+    context.counter.fetch_add(1);
+
+    if (workers.empty()) {
+        job();
+        context.counter.fetch_sub(1);
+        return;
+    }
+
+    push({ &context, std::move(job) });
+}
+
+void JobSystem::dispatch(JobContext& context, uint32_t jobCount, uint32_t groupSize, const std::function<void(JobArgs)>& job) {
+    if (jobCount == 0 || groupSize == 0) {
+        return;
+    }
+
+    // shared by the group jobs so the callable is only copied once
+    auto shared = std::make_shared<std::function<void(JobArgs)>>(job);
+    const uint32_t groupCount = (jobCount + groupSize - 1) / groupSize;
+    for (uint32_t group = 0; group < groupCount; group++) {
+        execute(context, [shared, group, groupSize, jobCount]() {
+            const uint32_t end = std::min((group + 1) * groupSize, jobCount);
+            for (uint32_t i = group * groupSize; i < end; i++) {
+                (*shared)({ i, group });
+            }
+        });
+    }
+}
+
+void JobSystem::wait(JobContext& context) {
+    while (isBusy(context)) {
+        if (!runNext(&context)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::push(Job&& job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wakeCondition.notify_one();
+}
+
+bool JobSystem::runNext(const JobContext* context) {
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = context ? std::find_if(jobs.begin(), jobs.end(), [context](const Job& queued) { return queued.context == context; }) : jobs.begin();
+        if (it == jobs.end()) {
+            return false;
+        }
+        job = std::move(*it);
+        jobs.erase(it);
+    }
+
+    job.task();
+    job.context->counter.fetch_sub(1);
+
+    return true;
+}
+
+void JobSystem::workerLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this]() { return !jobs.empty() || !running; });
+            if (!running && jobs.empty()) {
+                return;
+            }
+        }
+
+        runNext();
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeCondition.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+} //namespace sublimation
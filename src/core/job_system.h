@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sublimation {
+
+struct JobArgs {
+    uint32_t jobIndex; ///< item index within the dispatch
+    uint32_t groupIndex;
+};
+
+// counts the outstanding jobs of one batch, wait() on it returns once they are all done
+struct JobContext {
+    std::atomic<uint32_t> counter{ 0 };
+};
+
+// Worker thread pool for fire-and-forget CPU jobs
+// waiting threads help with queued jobs of the batch they wait on instead of blocking, so jobs may dispatch and wait
+// on nested work, and a wait never picks up a long job of another batch such as a texture read
+class JobSystem {
+protected:
+    JobSystem() = default;
+
+public:
+    ~JobSystem();
+    static JobSystem* getSingleton();
+
+    // 0 uses one worker per hardware thread except the calling one, jobs run inline until this is called
+    void initialize(uint32_t threadCount = 0);
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    void execute(JobContext& context, std::function<void()>&& job);
+    // runs job for jobCount items, every worker job processes groupSize consecutive items
+    void dispatch(JobContext& context, uint32_t jobCount, uint32_t groupSize, const std::function<void(JobArgs)>& job);
+
+    bool isBusy(const JobContext& context) const { return context.counter.load() > 0; }
+    void wait(JobContext& context);
+
+private:
+    struct Job {
+        JobContext* context;
+        std::function<void()> task;
+    };
+
+    void push(Job&& job);
+    // the first queued job, or the first one of context, false if there is none
+    bool runNext(const JobContext* context = nullptr);
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    bool running = false;
+};
+
+} //namespace sublimation
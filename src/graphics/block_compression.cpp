@@ -0,0 +1,313 @@
+#include <graphics/block_compression.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace sublimation {
+
+namespace block_compression {
+
+namespace {
+
+uint16_t packColor565(const float* color) {
+    const uint32_t r = static_cast<uint32_t>(std::clamp(color[0], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+    const uint32_t g = static_cast<uint32_t>(std::clamp(color[1], 0.f, 255.f) * 63.f / 255.f + 0.5f);
+    const uint32_t b = static_cast<uint32_t>(std::clamp(color[2], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackColor565(uint16_t packed, int32_t* color) {
+    const int32_t r = (packed >> 11) & 31;
+    const int32_t g = (packed >> 5) & 63;
+    const int32_t b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// the four colours of a block, three and a transparent black when the endpoints are in punch-through order
+void getColorPalette(uint16_t color0, uint16_t color1, bool forceFourColors, int32_t palette[4][4]) {
+    unpackColor565(color0, palette[0]);
+    unpackColor565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+
+    if (color0 > color1 || forceFourColors) {
+        for (int32_t c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        palette[2][3] = palette[3][3] = 255;
+    } else {
+        for (int32_t c = 0; c < 3; c++) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+        palette[2][3] = 255;
+        palette[3][3] = 0;
+    }
+}
+
+// endpoints are the extremes of the block along its principal axis, always in four colour order
+void encodeColorBlock(const uint8_t texels[16][4], uint8_t* block) {
+    float mean[3] = { 0.f, 0.f, 0.f };
+    for (uint32_t i = 0; i < 16; i++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            mean[c] += texels[i][c] / 16.f;
+        }
+    }
+
+    float covariance[6] = {};
+    for (uint32_t i = 0; i < 16; i++) {
+        const float r = texels[i][0] - mean[0];
+        const float g = texels[i][1] - mean[1];
+        const float b = texels[i][2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    // a few power iterations are plenty for a 3x3 matrix
+    float axis[3] = { 0.9f, 1.f, 0.7f };
+    for (uint32_t iteration = 0; iteration < 8; iteration++) {
+        const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        const float length = std::max({ std::abs(x), std::abs(y), std::abs(z) });
+        if (length == 0.f) {
+            break;
+        }
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    float minProjection = 0.f;
+    float maxProjection = 0.f;
+    uint32_t minTexel = 0;
+    uint32_t maxTexel = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        const float projection = texels[i][0] * axis[0] + texels[i][1] * axis[1] + texels[i][2] * axis[2];
+        if (i == 0 || projection < minProjection) {
+            minProjection = projection;
+            minTexel = i;
+        }
+        if (i == 0 || projection > maxProjection) {
+            maxProjection = projection;
+            maxTexel = i;
+        }
+    }
+
+    // pull the endpoints in a little, the interpolated colours then sit closer to the texels in between
+    float endpoints[2][3];
+    for (uint32_t c = 0; c < 3; c++) {
+        const float inset = (texels[maxTexel][c] - texels[minTexel][c]) / 16.f;
+        endpoints[0][c] = texels[maxTexel][c] - inset;
+        endpoints[1][c] = texels[minTexel][c] + inset;
+    }
+
+    uint16_t color0 = packColor565(endpoints[0]);
+    uint16_t color1 = packColor565(endpoints[1]);
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int32_t palette[4][4];
+        getColorPalette(color0, color1, true, palette);
+        for (uint32_t i = 0; i < 16; i++) {
+            uint32_t best = 0;
+            int32_t bestDistance = INT32_MAX;
+            for (uint32_t p = 0; p < 4; p++) {
+                const int32_t r = palette[p][0] - texels[i][0];
+                const int32_t g = palette[p][1] - texels[i][1];
+                const int32_t b = palette[p][2] - texels[i][2];
+                const int32_t distance = r * r + g * g + b * b;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    std::memcpy(block, &color0, 2);
+    std::memcpy(block + 2, &color1, 2);
+    std::memcpy(block + 4, &indices, 4);
+}
+
+void decodeColorBlock(const uint8_t* block, bool forceFourColors, uint8_t texels[16][4]) {
+    uint16_t color0, color1;
+    uint32_t indices;
+    std::memcpy(&color0, block, 2);
+    std::memcpy(&color1, block + 2, 2);
+    std::memcpy(&indices, block + 4, 4);
+
+    int32_t palette[4][4];
+    getColorPalette(color0, color1, forceFourColors, palette);
+    for (uint32_t i = 0; i < 16; i++) {
+        const int32_t* color = palette[(indices >> (2 * i)) & 3];
+        for (uint32_t c = 0; c < 4; c++) {
+            texels[i][c] = static_cast<uint8_t>(color[c]);
+        }
+    }
+}
+
+void getChannelPalette(uint8_t value0, uint8_t value1, int32_t palette[8]) {
+    palette[0] = value0;
+    palette[1] = value1;
+    if (value0 > value1) {
+        for (int32_t i = 1; i < 7; i++) {
+            palette[i + 1] = ((7 - i) * value0 + i * value1) / 7;
+        }
+    } else {
+        for (int32_t i = 1; i < 5; i++) {
+            palette[i + 1] = ((5 - i) * value0 + i * value1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// eight value mode between the block's extremes, a flat block keeps a single value
+void encodeChannelBlock(const uint8_t texels[16][4], uint32_t channel, uint8_t* block) {
+    uint8_t minValue = 255;
+    uint8_t maxValue = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        minValue = std::min(minValue, texels[i][channel]);
+        maxValue = std::max(maxValue, texels[i][channel]);
+    }
+
+    block[0] = maxValue;
+    block[1] = minValue;
+
+    uint64_t indices = 0;
+    if (maxValue != minValue) {
+        int32_t palette[8];
+        getChannelPalette(maxValue, minValue, palette);
+        for (uint32_t i = 0; i < 16; i++) {
+            uint64_t best = 0;
+            int32_t bestDistance = INT32_MAX;
+            for (uint32_t p = 0; p < 8; p++) {
+                const int32_t distance = std::abs(palette[p] - texels[i][channel]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (3 * i);
+        }
+    }
+
+    std::memcpy(block + 2, &indices, 6);
+}
+
+void decodeChannelBlock(const uint8_t* block, uint32_t channel, uint8_t texels[16][4]) {
+    uint64_t indices = 0;
+    std::memcpy(&indices, block + 2, 6);
+
+    int32_t palette[8];
+    getChannelPalette(block[0], block[1], palette);
+    for (uint32_t i = 0; i < 16; i++) {
+        texels[i][channel] = static_cast<uint8_t>(palette[(indices >> (3 * i)) & 7]);
+    }
+}
+
+void loadBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t texels[16][4]) {
+    for (uint32_t y = 0; y < 4; y++) {
+        const uint32_t row = std::min(blockY * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            const uint32_t column = std::min(blockX * 4 + x, width - 1);
+            std::memcpy(texels[y * 4 + x], &rgba[(static_cast<size_t>(row) * width + column) * 4], 4);
+        }
+    }
+}
+
+void storeBlock(const uint8_t texels[16][4], uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t* rgba) {
+    for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+        for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++) {
+            std::memcpy(&rgba[((static_cast<size_t>(blockY) * 4 + y) * width + blockX * 4 + x) * 4], texels[y * 4 + x], 4);
+        }
+    }
+}
+
+} //namespace
+
+uint32_t getBlockSize(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t getCompressedSize(BlockFormat format, uint32_t width, uint32_t height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+void encode(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks) {
+    const uint32_t blockSize = getBlockSize(format);
+    uint8_t texels[16][4];
+
+    for (uint32_t blockY = 0; blockY < (height + 3) / 4; blockY++) {
+        for (uint32_t blockX = 0; blockX < (width + 3) / 4; blockX++) {
+            loadBlock(rgba, width, height, blockX, blockY, texels);
+            switch (format) {
+                case BlockFormat::BC1:
+                    encodeColorBlock(texels, blocks);
+                    break;
+                case BlockFormat::BC3:
+                    encodeChannelBlock(texels, 3, blocks);
+                    encodeColorBlock(texels, blocks + 8);
+                    break;
+                case BlockFormat::BC4:
+                    encodeChannelBlock(texels, 0, blocks);
+                    break;
+                case BlockFormat::BC5:
+                    encodeChannelBlock(texels, 0, blocks);
+                    encodeChannelBlock(texels, 1, blocks + 8);
+                    break;
+            }
+            blocks += blockSize;
+        }
+    }
+}
+
+void decode(BlockFormat format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba) {
+    const uint32_t blockSize = getBlockSize(format);
+    uint8_t texels[16][4];
+
+    for (uint32_t blockY = 0; blockY < (height + 3) / 4; blockY++) {
+        for (uint32_t blockX = 0; blockX < (width + 3) / 4; blockX++) {
+            for (uint32_t i = 0; i < 16; i++) {
+                texels[i][0] = texels[i][1] = texels[i][2] = 0;
+                texels[i][3] = 255;
+            }
+
+            switch (format) {
+                case BlockFormat::BC1:
+                    decodeColorBlock(blocks, false, texels);
+                    break;
+                case BlockFormat::BC3:
+                    decodeColorBlock(blocks + 8, true, texels);
+                    decodeChannelBlock(blocks, 3, texels);
+                    break;
+                case BlockFormat::BC4:
+                    decodeChannelBlock(blocks, 0, texels);
+                    break;
+                case BlockFormat::BC5:
+                    decodeChannelBlock(blocks, 0, texels);
+                    decodeChannelBlock(blocks + 8, 1, texels);
+                    break;
+            }
+
+            storeBlock(texels, width, height, blockX, blockY, rgba);
+            blocks += blockSize;
+        }
+    }
+}
+
+} //namespace block_compression
+
+} //namespace sublimation
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sublimation {
+
+namespace block_compression {
+
+// 4x4 texel block formats the offline baker writes and the loader can decode when the device can't sample them
+enum class BlockFormat {
+    BC1, ///< rgb, 8 bytes per block
+    BC3, ///< rgb plus interpolated alpha, 16 bytes per block
+    BC4, ///< one channel, 8 bytes per block
+    BC5 ///< two channels, 16 bytes per block
+};
+
+uint32_t getBlockSize(BlockFormat format);
+// blocks are padded to cover the texels past the last multiple of four
+size_t getCompressedSize(BlockFormat format, uint32_t width, uint32_t height);
+
+// rgba is tightly packed RGBA8, blocks are written row by row. BC4 takes the red channel, BC5 red and green,
+// texels past the edge repeat the last row and column
+void encode(BlockFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks);
+// inverse of encode, BC4 decodes to (r, 0, 0, 1) and BC5 to (r, g, 0, 1) like the sampler would return them
+void decode(BlockFormat format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba);
+
+} //namespace block_compression
+
+} //namespace sublimation
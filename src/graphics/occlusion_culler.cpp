@@ -0,0 +1,397 @@
+#include <graphics/occlusion_culler.h>
+
+#include <graphics/vulkan/descriptor.h>
+#include <graphics/vulkan/rendering_device.h>
+#include <graphics/vulkan/texture.h>
+#include <graphics/vulkan/utils.h>
+#include <scene/scene.h>
+
+#include <glm/gtc/matrix_access.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace sublimation {
+
+void OcclusionCuller::initialize() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    vkw::ShaderStageInfo cullShaderInfo = {};
+    cullShaderInfo.stages[0].filepath = "cull.comp.glsl";
+    cullShaderInfo.stages[0].stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    cullShaderInfo.stageCount = 1;
+    cullShaderInfo.name = "cull";
+    cullPass.shader = rd->createShaderFromSPIRV(cullShaderInfo);
+
+    vkw::ShaderStageInfo hizShaderInfo = {};
+    hizShaderInfo.stages[0].filepath = "hiz.comp.glsl";
+    hizShaderInfo.stages[0].stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    hizShaderInfo.stageCount = 1;
+    hizShaderInfo.name = "hiz";
+    hizPass.shader = rd->createShaderFromSPIRV(hizShaderInfo);
+
+    hizShaderInfo.stages[0].filepath = "hiz_ms.comp.glsl";
+    hizShaderInfo.name = "hiz_ms";
+    hizMSPass.shader = rd->createShaderFromSPIRV(hizShaderInfo);
+
+    // only ever read with texelFetch, filtering and lod clamps don't apply, so depth and pyramid share it immutably
+    hizSampler = vkw::Texture::getImageSampler(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, false);
+
+    // layout bindings
+    // TODO: move when reflection is done
+    vkw::DescriptorLayoutBuilder layoutBuilder;
+    cullSetLayout = layoutBuilder.addResource(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addResource(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addResource(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addResource(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addResource(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addResource(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addResource(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, VK_SHADER_STAGE_COMPUTE_BIT, hizSampler)
+                            .build("cull");
+    hizSetLayout = layoutBuilder.addResource(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, VK_SHADER_STAGE_COMPUTE_BIT, hizSampler)
+                           .addResource(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+                           .build("hiz");
+
+    rd->getShader(cullPass.shader)->layouts.push_back(cullSetLayout);
+    rd->getShader(cullPass.shader)->pushConstantRange = sizeof(uint32_t);
+    rd->getShader(hizPass.shader)->layouts.push_back(hizSetLayout);
+    rd->getShader(hizPass.shader)->pushConstantRange = sizeof(HiZPushConstants);
+
+    cullPass.pipelineLayout = rd->createPipelineLayout(cullPass.shader);
+    hizPass.pipelineLayout = rd->createPipelineLayout(hizPass.shader);
+    hizMSPass.pipelineLayout = hizPass.pipelineLayout;
+
+    vkw::PipelineInfo pipelineInfo{
+        .pipelineLayout = rd->getPipelineLayout(cullPass.pipelineLayout)
+    };
+    cullPass.pipeline = rd->createPipeline(pipelineInfo, cullPass.shader);
+
+    pipelineInfo.pipelineLayout = rd->getPipelineLayout(hizPass.pipelineLayout);
+    hizPass.pipeline = rd->createPipeline(pipelineInfo, hizPass.shader);
+    hizMSPass.pipeline = rd->createPipeline(pipelineInfo, hizMSPass.shader);
+}
+
+void OcclusionCuller::createFrameResources(uint32_t framesInFlight) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    vkw::DescriptorAllocator& allocator = rd->getDescriptorAllocator();
+
+    this->framesInFlight = framesInFlight;
+
+    // sets can't be handed back to the allocator, so keep the ones from a larger frame count around
+    if (frames.size() < framesInFlight) {
+        frames.resize(framesInFlight);
+    }
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        FrameResources& frame = frames[i];
+        for (auto& cullSet : frame.cullSets) {
+            if (cullSet == VK_NULL_HANDLE) {
+                cullSet = allocator.allocate(cullSetLayout);
+            }
+        }
+
+        frame.cullData = rd->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, sizeof(GpuCullData));
+        if (capacity > 0) {
+            frame.drawData = rd->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, capacity * sizeof(GpuDrawData));
+        }
+        frame.dirty = true;
+    }
+}
+
+void OcclusionCuller::destroyFrameResources() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        rd->destroyBuffer(frames[i].cullData);
+        rd->destroyBuffer(frames[i].drawData);
+        frames[i].cullData = {};
+        frames[i].drawData = {};
+    }
+    framesInFlight = 0;
+}
+
+void OcclusionCuller::createBuffers(uint32_t capacity) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    this->capacity = capacity;
+
+    const VkDeviceSize commandsSize = capacity * sizeof(VkDrawIndexedIndirectCommand);
+    const VkBufferUsageFlags commandUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    for (uint32_t i = 0; i < visibilityLatency; i++) {
+        visibility[i] = rd->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, capacity * sizeof(uint32_t));
+        earlyCommands[i] = rd->createBuffer(commandUsage, VMA_MEMORY_USAGE_GPU_ONLY, commandsSize);
+        // nothing is known about the new primitives, draw them all early once
+        resetVisibility[i] = true;
+    }
+    lateCommands = rd->createBuffer(commandUsage, VMA_MEMORY_USAGE_GPU_ONLY, commandsSize);
+    mainCommands = rd->createBuffer(commandUsage, VMA_MEMORY_USAGE_GPU_ONLY, commandsSize);
+
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        frames[i].drawData = rd->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, capacity * sizeof(GpuDrawData));
+        frames[i].dirty = true;
+    }
+}
+
+void OcclusionCuller::destroyBuffers() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    for (uint32_t i = 0; i < visibilityLatency; i++) {
+        rd->destroyBuffer(visibility[i]);
+        rd->destroyBuffer(earlyCommands[i]);
+    }
+    rd->destroyBuffer(lateCommands);
+    rd->destroyBuffer(mainCommands);
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        rd->destroyBuffer(frames[i].drawData);
+        frames[i].drawData = {};
+    }
+    capacity = 0;
+}
+
+void OcclusionCuller::destroyPyramid() {
+    if (hizImage == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    VkDevice device = rd->getDevice();
+    VmaAllocator allocator = rd->getAllocator();
+
+    std::vector<VkImageView> views = hizLevelViews;
+    views.push_back(hizView);
+    VkImage image = hizImage;
+    VmaAllocation allocation = hizAllocation;
+    rd->deferDestroy([device, allocator, views, image, allocation]() {
+        for (auto view : views) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+        vmaDestroyImage(allocator, image, allocation);
+    });
+
+    hizImage = VK_NULL_HANDLE;
+    hizAllocation = VK_NULL_HANDLE;
+    hizView = VK_NULL_HANDLE;
+    hizLevelViews.clear();
+    hizLevels = 0;
+}
+
+void OcclusionCuller::resize(glm::uvec2 extent, vkw::Texture* depth) {
+    destroyPyramid();
+
+    // power of two levels keep every texel an exact 2x2 footprint of the level above
+    hizSize = { std::bit_floor(extent.x), std::bit_floor(extent.y) };
+    hizLevels = std::bit_width(std::max(hizSize.x, hizSize.y));
+
+    VmaAllocationInfo allocInfo;
+    vkw::Texture::createImage(hizImage, hizAllocation, allocInfo, { hizSize.x, hizSize.y, 1 }, VK_FORMAT_R32_SFLOAT, VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hizLevels, 1, VK_IMAGE_TYPE_2D);
+    vkw::Texture::createImageView(hizView, hizImage, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, hizLevels, 0, 1, 0);
+
+    hizLevelViews.resize(hizLevels);
+    for (uint32_t level = 0; level < hizLevels; level++) {
+        vkw::Texture::createImageView(hizLevelViews[level], hizImage, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, level, 1, 0);
+    }
+
+    depthExtent = extent;
+    depthView = depth->getImageView();
+    depthSampler = depth->getSampler();
+    depthSamples = depth->getSamples();
+
+    for (auto& frame : frames) {
+        frame.dirty = true;
+    }
+}
+
+void OcclusionCuller::update(const Scene& scene, uint32_t frameIndex, uint64_t frame, const glm::mat4& viewProjection) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    ring = static_cast<uint32_t>(frame % visibilityLatency);
+
+    drawCount = scene.getClusterCount();
+    if (drawCount > capacity) {
+        // buffers still bound by frames in flight retire through the deletion queue
+        const uint32_t newCapacity = std::max(drawCount, 2 * capacity);
+        destroyBuffers();
+        createBuffers(newCapacity);
+    }
+
+    FrameResources& resources = frames[frameIndex];
+    if (drawCount > 0) {
+        drawData.resize(drawCount);
+        scene.getClusterData(drawData);
+        ((vkw::StorageBuffer*)rd->getBuffer(resources.drawData))->update(drawData.data(), drawCount * sizeof(GpuDrawData));
+    }
+
+    // planes point inwards, a box is outside once its farthest corner along the normal is behind one of them
+    const glm::vec4 row0 = glm::row(viewProjection, 0);
+    const glm::vec4 row1 = glm::row(viewProjection, 1);
+    const glm::vec4 row2 = glm::row(viewProjection, 2);
+    const glm::vec4 row3 = glm::row(viewProjection, 3);
+    const GpuCullData cullData{
+        .viewProjection = viewProjection,
+        .frustumPlanes = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2 },
+        .cameraPosition = scene.getSceneData().cameraPosition,
+        .hizSize = glm::vec2(hizSize),
+        .drawCount = drawCount,
+        .hizLevels = hizLevels
+    };
+    ((vkw::UniformBuffer*)rd->getBuffer(resources.cullData))->update(&cullData);
+
+    if (resources.dirty && capacity > 0 && hizImage != VK_NULL_HANDLE) {
+        writeDescriptors(resources);
+    }
+}
+
+void OcclusionCuller::writeDescriptors(FrameResources& frame) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    vkw::DescriptorAllocator& allocator = rd->getDescriptorAllocator();
+
+    vkw::DescriptorWriter writer;
+    writer.bindBuffer(0, rd->getBuffer(frame.cullData), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    writer.bindBuffer(1, rd->getBuffer(frame.drawData), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.bindBuffer(4, rd->getBuffer(lateCommands), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.bindBuffer(5, rd->getBuffer(mainCommands), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.bindImage(6, hizView, hizSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    for (uint32_t i = 0; i < visibilityLatency; i++) {
+        writer.bindBuffer(2, rd->getBuffer(visibility[i]), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.bindBuffer(3, rd->getBuffer(earlyCommands[i]), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.writeSet(frame.cullSets[i]);
+    }
+
+    while (frame.hizSets.size() < hizLevels) {
+        frame.hizSets.push_back(allocator.allocate(hizSetLayout));
+    }
+
+    for (uint32_t level = 0; level < hizLevels; level++) {
+        if (level == 0) {
+            writer.bindImage(0, depthView, depthSampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        } else {
+            writer.bindImage(0, hizLevelViews[level - 1], hizSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        }
+        writer.bindImage(1, hizLevelViews[level], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        writer.writeSet(frame.hizSets[level]);
+    }
+
+    frame.dirty = false;
+}
+
+void OcclusionCuller::recordEarlyCull(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (drawCount == 0) {
+        return;
+    }
+
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    // the frame that last used this visibility and these commands has retired before the submission starts,
+    // the wait on the frame timeline orders it, so only the fill needs a barrier
+    if (resetVisibility[ring]) {
+        vkCmdFillBuffer(commandBuffer, rd->getBuffer(visibility[ring])->getBuffer(), 0, VK_WHOLE_SIZE, 1);
+
+        VkMemoryBarrier fillBarrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+        resetVisibility[ring] = false;
+    }
+
+    dispatchCull(commandBuffer, frameIndex, 0);
+}
+
+void OcclusionCuller::recordHiZ(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (drawCount == 0) {
+        return;
+    }
+
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    FrameResources& frame = frames[frameIndex];
+    VkPipelineLayout pipelineLayout = rd->getPipelineLayout(hizPass.pipelineLayout);
+
+    // contents of the last frame are dropped, its late cull has to be done reading them
+    VkImageMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = hizImage,
+        .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, hizLevels, 0, 1 }
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    glm::ivec2 srcSize = glm::ivec2(depthExtent);
+    for (uint32_t level = 0; level < hizLevels; level++) {
+        const glm::ivec2 dstSize = glm::max(glm::ivec2(hizSize >> level), glm::ivec2(1));
+
+        if (level == 0) {
+            const vkw::Pipeline& pass = depthSamples != VK_SAMPLE_COUNT_1_BIT ? hizMSPass : hizPass;
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, rd->getPipeline(pass.pipeline));
+        } else if (level == 1 && depthSamples != VK_SAMPLE_COUNT_1_BIT) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, rd->getPipeline(hizPass.pipeline));
+        }
+
+        const HiZPushConstants pushConstants{
+            .srcSize = srcSize,
+            .dstSize = dstSize,
+            .sampleCount = static_cast<int32_t>(depthSamples)
+        };
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.hizSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, 0, sizeof(HiZPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (dstSize.x + 7) / 8, (dstSize.y + 7) / 8, 1);
+
+        // the next level and the late cull read this one
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        srcSize = dstSize;
+    }
+}
+
+void OcclusionCuller::recordLateCull(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (drawCount == 0) {
+        return;
+    }
+
+    dispatchCull(commandBuffer, frameIndex, 1);
+}
+
+void OcclusionCuller::dispatchCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t phase) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    VkPipelineLayout pipelineLayout = rd->getPipelineLayout(cullPass.pipelineLayout);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, rd->getPipeline(cullPass.pipeline));
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frames[frameIndex].cullSets[ring], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, 0, sizeof(uint32_t), &phase);
+    vkCmdDispatch(commandBuffer, (drawCount + 63) / 64, 1, 1);
+
+    VkMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VkBuffer OcclusionCuller::getEarlyCommands() const {
+    vkw::Buffer* buffer = vkw::RenderingDevice::getSingleton()->getBuffer(earlyCommands[ring]);
+    return buffer ? buffer->getBuffer() : VK_NULL_HANDLE;
+}
+
+VkBuffer OcclusionCuller::getLateCommands() const {
+    vkw::Buffer* buffer = vkw::RenderingDevice::getSingleton()->getBuffer(lateCommands);
+    return buffer ? buffer->getBuffer() : VK_NULL_HANDLE;
+}
+
+VkBuffer OcclusionCuller::getMainCommands() const {
+    vkw::Buffer* buffer = vkw::RenderingDevice::getSingleton()->getBuffer(mainCommands);
+    return buffer ? buffer->getBuffer() : VK_NULL_HANDLE;
+}
+
+} //namespace sublimation
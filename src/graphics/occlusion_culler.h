@@ -0,0 +1,124 @@
+#pragma once
+
+#include <volk.h>
+#include <glm/glm.hpp>
+#include <vk_mem_alloc.h>
+
+#include <graphics/vulkan/pipeline.h>
+#include <graphics/vulkan/resource_pool.h>
+#include <scene/model.h>
+
+#include <vector>
+
+namespace sublimation {
+
+namespace vkw {
+class Texture;
+}
+
+class Scene;
+
+struct GpuCullData {
+    glm::mat4 viewProjection;
+    glm::vec4 frustumPlanes[6];
+    glm::vec4 cameraPosition; ///< apex side of the backface cones
+    glm::vec2 hizSize;
+    uint32_t drawCount;
+    uint32_t hizLevels;
+};
+
+struct HiZPushConstants {
+    glm::ivec2 srcSize;
+    glm::ivec2 dstSize;
+    int32_t sampleCount;
+};
+
+// Two-phase occlusion culling against a Hi-Z pyramid of the depth pre-pass
+// the early phase draws what was visible two frames ago, the pyramid is built from that depth,
+// and the late phase tests everything against it: newly visible primitives finish the depth pass
+// and the visibility result is kept for a later frame. Commands are one VkDrawIndexedIndirectCommand
+// per cluster at the primitive's firstCluster onwards, the culled ones have no instances. Clusters whose
+// normal cone faces away from the camera are dropped in both phases.
+// The early phase is recorded on the async compute queue and only waits for the frame whose visibility it reads,
+// so it overlaps with the previous frame's graphics work. Hi-Z and the late phase read this frame's depth
+// and stay on the graphics queue.
+// Buffer hazards aren't tracked by the render graph, the record functions place their own barriers
+class OcclusionCuller {
+public:
+    // frames between the late cull writing visibility and the early cull reading it, visibility and early commands
+    // are double buffered so the early cull never touches what the frame still on the graphics queue uses
+    static constexpr uint32_t visibilityLatency = 2;
+
+    OcclusionCuller() = default;
+
+    void initialize();
+    void createFrameResources(uint32_t framesInFlight);
+    void destroyFrameResources();
+
+    // rebuilds the pyramid for a new surface, depth is the pre-pass attachment the first level is reduced from
+    void resize(glm::uvec2 extent, vkw::Texture* depth);
+    // uploads this frame's bounds and camera, grows the buffers when the scene has more clusters
+    // frame selects the visibility and early commands the record functions use
+    void update(const Scene& scene, uint32_t frameIndex, uint64_t frame, const glm::mat4& viewProjection);
+
+    // the early cull goes on the compute queue, Hi-Z and the late cull on the graphics queue
+    void recordEarlyCull(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+    void recordHiZ(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+    void recordLateCull(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    VkBuffer getEarlyCommands() const;
+    VkBuffer getLateCommands() const;
+    VkBuffer getMainCommands() const;
+    uint32_t getDrawCount() const { return drawCount; }
+
+private:
+    struct FrameResources {
+        vkw::BufferHandle drawData;
+        vkw::BufferHandle cullData;
+        VkDescriptorSet cullSets[visibilityLatency] = {}; ///< one per visibility buffer
+        std::vector<VkDescriptorSet> hizSets; ///< one per pyramid level
+        bool dirty = true; ///< sets are rewritten the next time the slot records, never while in flight
+    };
+
+    void createBuffers(uint32_t capacity);
+    void destroyBuffers();
+    void destroyPyramid();
+    void writeDescriptors(FrameResources& frame);
+    void dispatchCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t phase);
+
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout hizSetLayout = VK_NULL_HANDLE;
+    vkw::Pipeline cullPass;
+    vkw::Pipeline hizPass;
+    vkw::Pipeline hizMSPass; ///< first level from multisampled depth, shares the layout of hizPass
+
+    std::vector<FrameResources> frames;
+    uint32_t framesInFlight = 0;
+
+    // shared by all frames, every frame's culling reads the visibility written visibilityLatency frames earlier
+    vkw::BufferHandle visibility[visibilityLatency];
+    vkw::BufferHandle earlyCommands[visibilityLatency];
+    vkw::BufferHandle lateCommands;
+    vkw::BufferHandle mainCommands;
+    uint32_t capacity = 0;
+    uint32_t drawCount = 0;
+    uint32_t ring = 0; ///< visibility and early commands of the frame being recorded
+    bool resetVisibility[visibilityLatency] = { true, true };
+    std::vector<GpuDrawData> drawData;
+
+    // Hi-Z pyramid, R32 max depth with the first level at the power of two below the surface size
+    VkImage hizImage = VK_NULL_HANDLE;
+    VmaAllocation hizAllocation = VK_NULL_HANDLE;
+    VkImageView hizView = VK_NULL_HANDLE;
+    std::vector<VkImageView> hizLevelViews;
+    VkSampler hizSampler = VK_NULL_HANDLE;
+    glm::uvec2 hizSize{ 0 };
+    uint32_t hizLevels = 0;
+
+    glm::uvec2 depthExtent{ 0 };
+    VkImageView depthView = VK_NULL_HANDLE;
+    VkSampler depthSampler = VK_NULL_HANDLE;
+    VkSampleCountFlagBits depthSamples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+} //namespace sublimation
@@ -0,0 +1,839 @@
+#include <graphics/render_graph.h>
+
+#include <graphics/vulkan/rendering_device.h>
+#include <graphics/vulkan/texture.h>
+#include <graphics/vulkan/utils.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sublimation {
+
+RGResourceId RenderGraphBuilder::createTexture(const std::string& name, const RGTextureDesc& desc) {
+    RenderGraphResource resource{
+        .name = name,
+        .desc = desc
+    };
+    graph.resources.push_back(std::move(resource));
+
+    return static_cast<RGResourceId>(graph.resources.size() - 1);
+}
+
+void RenderGraphBuilder::writeColor(RGResourceId resource, VkAttachmentLoadOp loadOp, VkClearColorValue clearColor) {
+    RGResourceUse use{
+        .resource = resource,
+        .usage = RGUsage::ColorAttachment,
+        .loadOp = loadOp
+    };
+    use.clearValue.color = clearColor;
+    addUse(use);
+}
+
+void RenderGraphBuilder::writeDepth(RGResourceId resource, VkAttachmentLoadOp loadOp, float clearDepth) {
+    RGResourceUse use{
+        .resource = resource,
+        .usage = RGUsage::DepthAttachment,
+        .loadOp = loadOp
+    };
+    use.clearValue.depthStencil = { clearDepth, 0 };
+    addUse(use);
+}
+
+void RenderGraphBuilder::readDepth(RGResourceId resource) {
+    addUse({ .resource = resource, .usage = RGUsage::DepthReadOnly, .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD });
+}
+
+void RenderGraphBuilder::resolve(RGResourceId source, RGResourceId destination) {
+    addUse({ .resource = destination, .usage = RGUsage::ResolveAttachment, .resolveSource = source });
+}
+
+void RenderGraphBuilder::sample(RGResourceId resource, VkPipelineStageFlags stages) {
+    addUse({ .resource = resource, .usage = RGUsage::Sampled, .stages = stages });
+}
+
+void RenderGraphBuilder::readStorage(RGResourceId resource, VkPipelineStageFlags stages) {
+    addUse({ .resource = resource, .usage = RGUsage::StorageRead, .stages = stages });
+}
+
+void RenderGraphBuilder::writeStorage(RGResourceId resource, VkPipelineStageFlags stages) {
+    addUse({ .resource = resource, .usage = RGUsage::StorageWrite, .stages = stages });
+}
+
+void RenderGraphBuilder::setSideEffect() {
+    graph.passes[passIndex].sideEffect = true;
+}
+
+void RenderGraphBuilder::addUse(const RGResourceUse& use) {
+    if (use.resource >= graph.resources.size()) {
+        throw std::runtime_error("ERROR::RenderGraphBuilder:addUse: unknown resource in pass '" + graph.passes[passIndex].name + "'!");
+    }
+
+    graph.passes[passIndex].uses.push_back(use);
+}
+
+void RenderGraph::reset() {
+    releaseResources();
+
+    passes.clear();
+    resources.clear();
+}
+
+RGResourceId RenderGraph::importSwapchain(const std::string& name) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    RenderGraphResource resource{
+        .name = name,
+        .desc = { .format = rd->getSwapChain().getFormat() },
+        .isSwapchain = true
+    };
+    resources.push_back(std::move(resource));
+
+    return static_cast<RGResourceId>(resources.size() - 1);
+}
+
+void RenderGraph::addPass(const std::string& name, RGPassType type, const std::function<void(RenderGraphBuilder&)>& setup,
+        std::function<void(VkCommandBuffer commandBuffer)>&& execute) {
+    RenderGraphPass pass{
+        .name = name,
+        .type = type,
+        .execute = std::move(execute)
+    };
+    passes.push_back(std::move(pass));
+
+    RenderGraphBuilder builder(*this, static_cast<uint32_t>(passes.size() - 1));
+    setup(builder);
+}
+
+void RenderGraph::compile(glm::uvec2 graphExtent) {
+    releaseResources();
+    extent = graphExtent;
+
+    cullPasses();
+    mergePasses();
+    computeLifetimes();
+    allocateResources();
+    buildPasses();
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t swapchainImageIndex) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    for (auto& pass : passes) {
+        if (pass.culled) {
+            continue;
+        }
+
+        if (pass.swapchainBarrier != UINT32_MAX) {
+            pass.imageBarriers[pass.swapchainBarrier].image = rd->getSwapChain().getImage(swapchainImageIndex);
+        }
+        if (!pass.imageBarriers.empty()) {
+            vkCmdPipelineBarrier(commandBuffer, pass.barrierSrcStages, pass.barrierDstStages, 0, 0, nullptr, 0, nullptr,
+                    static_cast<uint32_t>(pass.imageBarriers.size()), pass.imageBarriers.data());
+        }
+
+        if (pass.type == RGPassType::Compute) {
+            pass.execute(commandBuffer);
+            continue;
+        }
+
+        if (dynamicRendering) {
+            const VkRect2D renderArea{ { 0, 0 }, pass.extent };
+            const VkViewport viewport{ 0.f, 0.f, (float)pass.extent.width, (float)pass.extent.height, 0.f, 1.f };
+
+            pass.renderTarget.beginRendering(commandBuffer, renderArea, swapchainImageIndex, pass.clearValues.data());
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &renderArea);
+
+            pass.execute(commandBuffer);
+
+            vkCmdEndRenderingKHR(commandBuffer);
+            continue;
+        }
+
+        if (pass.subpass == 0) {
+            const RenderGraphPass& owner = passes[pass.renderPassOwner];
+            const VkRect2D renderArea{ { 0, 0 }, owner.extent };
+            VkRenderPassBeginInfo renderPassBeginInfo{
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .renderPass = rd->getRenderPass(owner.renderPass),
+                .framebuffer = owner.renderTarget.getFramebuffer(owner.usesSwapchain ? swapchainImageIndex : 0),
+                .renderArea = renderArea,
+                .clearValueCount = static_cast<uint32_t>(owner.clearValues.size()),
+                .pClearValues = owner.clearValues.data()
+            };
+
+            const VkViewport viewport{ 0.f, 0.f, (float)owner.extent.width, (float)owner.extent.height, 0.f, 1.f };
+
+            vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &renderArea);
+        } else {
+            vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+        }
+
+        pass.execute(commandBuffer);
+
+        if (pass.endsRenderPass) {
+            vkCmdEndRenderPass(commandBuffer);
+        }
+    }
+
+    if (hasPresentBarrier) {
+        presentBarrier.image = rd->getSwapChain().getImage(swapchainImageIndex);
+        vkCmdPipelineBarrier(commandBuffer, presentBarrierSrcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &presentBarrier);
+    }
+}
+
+bool RenderGraph::isPassActive(const std::string& name) const {
+    for (const auto& pass : passes) {
+        if (pass.name == name) {
+            return !pass.culled;
+        }
+    }
+
+    return false;
+}
+
+vkw::RenderPassHandle RenderGraph::getRenderPass(const std::string& name) const {
+    for (const auto& pass : passes) {
+        if (pass.name == name) {
+            return pass.renderPass;
+        }
+    }
+
+    return {};
+}
+
+vkw::Texture* RenderGraph::getTexture(RGResourceId resource) const {
+    if (resource >= resources.size()) {
+        return nullptr;
+    }
+
+    return vkw::RenderingDevice::getSingleton()->getTexture(resources[resource].texture);
+}
+
+vkw::RenderingFormats RenderGraph::getRenderingFormats(const std::string& name) const {
+    for (const auto& pass : passes) {
+        if (pass.name == name) {
+            return passes[pass.renderPassOwner].renderTarget.getRenderingFormats(pass.subpass);
+        }
+    }
+
+    return {};
+}
+
+uint32_t RenderGraph::getSubpass(const std::string& name) const {
+    for (const auto& pass : passes) {
+        if (pass.name == name) {
+            return pass.subpass;
+        }
+    }
+
+    return 0;
+}
+
+RGResourceId RenderGraph::findResource(const std::string& name) const {
+    for (size_t i = 0; i < resources.size(); i++) {
+        if (resources[i].name == name) {
+            return static_cast<RGResourceId>(i);
+        }
+    }
+
+    return RG_INVALID_RESOURCE;
+}
+
+void RenderGraph::cullPasses() {
+    // walk backwards from the swapchain and side effects, a pass survives if a surviving pass reads what it writes
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t i = 0; i < resources.size(); i++) {
+        needed[i] = resources[i].isSwapchain;
+    }
+
+    for (size_t p = passes.size(); p-- > 0;) {
+        RenderGraphPass& pass = passes[p];
+
+        pass.culled = !pass.sideEffect;
+        for (const auto& use : pass.uses) {
+            if (isWrite(use) && needed[use.resource]) {
+                pass.culled = false;
+            }
+        }
+
+        if (pass.culled) {
+            continue;
+        }
+
+        for (const auto& use : pass.uses) {
+            if (isRead(use)) {
+                needed[use.resource] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::mergePasses() {
+    auto isShaderUse = [](const RGResourceUse& use) {
+        return use.usage == RGUsage::Sampled || use.usage == RGUsage::StorageRead || use.usage == RGUsage::StorageWrite;
+    };
+    auto getExtent = [this](const RGResourceUse& use) {
+        const RenderGraphResource& resource = resources[use.resource];
+        return resource.desc.extent.x && !resource.isSwapchain ? resource.desc.extent : extent;
+    };
+    // size of the attachments of a pass, 0 when there are none
+    auto getPassExtent = [&](const RenderGraphPass& pass) {
+        for (const auto& use : pass.uses) {
+            if (!isShaderUse(use)) {
+                return getExtent(use);
+            }
+        }
+        return glm::uvec2(0);
+    };
+
+    uint32_t previous = UINT32_MAX;
+    for (uint32_t p = 0; p < passes.size(); p++) {
+        RenderGraphPass& pass = passes[p];
+        if (pass.culled) {
+            continue;
+        }
+
+        pass.renderPassOwner = p;
+        pass.subpass = 0;
+        pass.endsRenderPass = true;
+
+        // shader reads and writes need barriers outside of the render pass, so only attachment-only passes can join one
+        bool merge = subpassMerging && !dynamicRendering && previous != UINT32_MAX && pass.type == RGPassType::Raster && passes[previous].type == RGPassType::Raster
+                && std::none_of(pass.uses.begin(), pass.uses.end(), isShaderUse);
+        if (merge) {
+            const glm::uvec2 size = getPassExtent(passes[previous]);
+            merge = size.x != 0;
+            for (const auto& use : pass.uses) {
+                merge = merge && getExtent(use) == size;
+            }
+        }
+
+        if (merge) {
+            RenderGraphPass& prev = passes[previous];
+            pass.renderPassOwner = prev.renderPassOwner;
+            pass.subpass = prev.subpass + 1;
+            prev.endsRenderPass = false;
+        }
+
+        previous = p;
+    }
+}
+
+void RenderGraph::computeLifetimes() {
+    std::vector<bool> written(resources.size(), false);
+
+    for (uint32_t p = 0; p < passes.size(); p++) {
+        const RenderGraphPass& pass = passes[p];
+        if (pass.culled) {
+            continue;
+        }
+
+        for (const auto& use : pass.uses) {
+            RenderGraphResource& resource = resources[use.resource];
+
+            if (!resource.isSwapchain && !written[use.resource] && isRead(use) && !isWrite(use)) {
+                throw std::runtime_error("ERROR::RenderGraph:compile: '" + resource.name + "' is read by '" + pass.name + "' before anything writes it!");
+            }
+            if (pass.type == RGPassType::Compute && use.usage != RGUsage::Sampled && use.usage != RGUsage::StorageRead && use.usage != RGUsage::StorageWrite) {
+                throw std::runtime_error("ERROR::RenderGraph:compile: compute pass '" + pass.name + "' can't use attachments!");
+            }
+
+            written[use.resource] = written[use.resource] || isWrite(use);
+            resource.firstPass = std::min(resource.firstPass, p);
+            resource.lastPass = std::max(resource.lastPass, p);
+
+            switch (use.usage) {
+                case RGUsage::ColorAttachment:
+                case RGUsage::ResolveAttachment:
+                    resource.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                    break;
+                case RGUsage::DepthAttachment:
+                case RGUsage::DepthReadOnly:
+                    resource.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                    break;
+                case RGUsage::Sampled:
+                    resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+                    break;
+                case RGUsage::StorageRead:
+                case RGUsage::StorageWrite:
+                    resource.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+                    break;
+            }
+        }
+    }
+
+    // contents never leave the pass (cleared or discarded on load, not stored), so the image never needs to hit memory
+    const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    for (auto& resource : resources) {
+        if (!resource.isSwapchain && resource.firstPass != UINT32_MAX && passes[resource.firstPass].renderPassOwner == passes[resource.lastPass].renderPassOwner
+                && !(resource.usage & ~attachmentUsage)) {
+            resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+    }
+}
+
+void RenderGraph::allocateResources() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    std::vector<uint32_t> transients;
+    uint32_t memoryTypeBits = UINT32_MAX;
+    VkDeviceSize alignment = 1;
+    unaliasedMemorySize = 0;
+    lazyMemorySize = 0;
+
+    const bool lazyMemory = rd->hasLazilyAllocatedMemory();
+
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        RenderGraphResource& resource = resources[i];
+        if (resource.isSwapchain || resource.firstPass == UINT32_MAX) {
+            continue;
+        }
+
+        const glm::uvec2 size = resource.desc.extent.x ? resource.desc.extent : extent;
+        resource.texture = rd->createTexture(vkw::TEXTURE_ATTACHMENT, glm::ivec2(size),
+                { .format = resource.desc.format, .usage = resource.usage, .samples = resource.desc.samples }, 0);
+        resource.memoryRequirements = static_cast<vkw::TextureAttachment*>(rd->getTexture(resource.texture))->getMemoryRequirements();
+
+        unaliasedMemorySize += resource.memoryRequirements.size;
+
+        // lazy memory is only committed if the tile memory spills, keep it out of the shared block
+        if (lazyMemory && (resource.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)) {
+            resource.memory = rd->allocateMemory(resource.memoryRequirements, VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED);
+            resource.lazy = true;
+            static_cast<vkw::TextureAttachment*>(rd->getTexture(resource.texture))->bindMemory(rd->getMemory(resource.memory), 0);
+
+            memoryBlocks.push_back(resource.memory);
+            lazyMemorySize += resource.memoryRequirements.size;
+            continue;
+        }
+
+        memoryTypeBits &= resource.memoryRequirements.memoryTypeBits;
+        alignment = std::max(alignment, resource.memoryRequirements.alignment);
+        transients.push_back(i);
+    }
+
+    if (transients.empty()) {
+        transientMemorySize = 0;
+        return;
+    }
+
+    if (memoryTypeBits == 0) {
+        // no common memory type, give up on aliasing and allocate each attachment on its own
+        transientMemorySize = 0;
+        for (uint32_t i : transients) {
+            RenderGraphResource& resource = resources[i];
+            resource.memory = rd->allocateMemory(resource.memoryRequirements);
+            static_cast<vkw::TextureAttachment*>(rd->getTexture(resource.texture))->bindMemory(rd->getMemory(resource.memory), 0);
+
+            memoryBlocks.push_back(resource.memory);
+            transientMemorySize += resource.memoryRequirements.size;
+        }
+        return;
+    }
+
+    // largest first, each resource goes into the lowest gap not used by a resource it is alive together with
+    std::sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b) {
+        return resources[a].memoryRequirements.size > resources[b].memoryRequirements.size;
+    });
+
+    auto alignUp = [](VkDeviceSize value, VkDeviceSize align) { return (value + align - 1) / align * align; };
+
+    // attachments stay bound for the whole render pass, so lifetimes are widened to the render passes they are used in
+    auto lifetimeStart = [this](const RenderGraphResource& resource) { return passes[resource.firstPass].renderPassOwner; };
+    auto lifetimeEnd = [this](const RenderGraphResource& resource) {
+        uint32_t end = resource.lastPass;
+        for (uint32_t p = resource.lastPass + 1; p < passes.size(); p++) {
+            if (!passes[p].culled && passes[p].renderPassOwner == passes[resource.lastPass].renderPassOwner) {
+                end = p;
+            }
+        }
+        return end;
+    };
+
+    VkDeviceSize totalSize = 0;
+    std::vector<uint32_t> placed;
+    for (uint32_t i : transients) {
+        RenderGraphResource& resource = resources[i];
+
+        std::vector<uint32_t> overlapping;
+        for (uint32_t j : placed) {
+            if (lifetimeStart(resources[j]) <= lifetimeEnd(resource) && lifetimeStart(resource) <= lifetimeEnd(resources[j])) {
+                overlapping.push_back(j);
+            }
+        }
+        std::sort(overlapping.begin(), overlapping.end(), [this](uint32_t a, uint32_t b) {
+            return resources[a].offset < resources[b].offset;
+        });
+
+        VkDeviceSize offset = 0;
+        for (uint32_t j : overlapping) {
+            const VkDeviceSize aligned = alignUp(offset, resource.memoryRequirements.alignment);
+            if (aligned + resource.memoryRequirements.size <= resources[j].offset) {
+                break;
+            }
+            offset = std::max(offset, resources[j].offset + resources[j].memoryRequirements.size);
+        }
+
+        resource.offset = alignUp(offset, resource.memoryRequirements.alignment);
+        totalSize = std::max(totalSize, resource.offset + resource.memoryRequirements.size);
+        placed.push_back(i);
+    }
+
+    for (uint32_t i : transients) {
+        for (uint32_t j : transients) {
+            const RenderGraphResource& a = resources[i];
+            const RenderGraphResource& b = resources[j];
+            if (i != j && a.offset < b.offset + b.memoryRequirements.size && b.offset < a.offset + a.memoryRequirements.size) {
+                resources[i].aliased = true;
+            }
+        }
+    }
+
+    const VkMemoryRequirements requirements{
+        .size = totalSize,
+        .alignment = alignment,
+        .memoryTypeBits = memoryTypeBits
+    };
+    vkw::MemoryHandle memory = rd->allocateMemory(requirements);
+    memoryBlocks.push_back(memory);
+
+    for (uint32_t i : transients) {
+        resources[i].memory = memory;
+        static_cast<vkw::TextureAttachment*>(rd->getTexture(resources[i].texture))->bindMemory(rd->getMemory(memory), resources[i].offset);
+    }
+
+    transientMemorySize = totalSize;
+}
+
+void RenderGraph::buildPasses() {
+    // the graph runs the same way every frame, so a resource starts the frame in the state its last use left it in.
+    // Memory shared with other attachments also has to wait for their last use before being overwritten
+    std::vector<ResourceState> states(resources.size());
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        const RenderGraphResource& resource = resources[i];
+        if (resource.firstPass == UINT32_MAX) {
+            continue;
+        }
+
+        if (resource.isSwapchain) {
+            // chains with the acquire semaphore wait at color attachment output
+            states[i] = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 };
+            continue;
+        }
+
+        for (uint32_t j = 0; j < resources.size(); j++) {
+            const RenderGraphResource& other = resources[j];
+            const bool sharesMemory = i == j || (!other.isSwapchain && other.firstPass != UINT32_MAX && other.memory == resource.memory
+                    && resource.offset < other.offset + other.memoryRequirements.size && other.offset < resource.offset + resource.memoryRequirements.size);
+            if (!sharesMemory) {
+                continue;
+            }
+
+            for (const auto& use : passes[other.lastPass].uses) {
+                if (use.resource == j) {
+                    ResourceState last = getUseState(use, other.desc.format);
+                    states[i].stages |= last.stages;
+                    states[i].access |= last.access;
+                }
+            }
+        }
+        states[i].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    // swapchain barriers are recorded without an image, execute() fills in the acquired one
+    auto makeBarrier = [this](RGResourceId resource, const ResourceState& current, const ResourceState& target, bool discard) {
+        const VkFormat format = resources[resource].desc.format;
+        VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        if (vkw::Texture::hasDepth(format)) {
+            aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (vkw::Texture::hasStencil(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        }
+
+        return VkImageMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = current.access,
+            .dstAccessMask = target.access,
+            .oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : current.layout,
+            .newLayout = target.layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = resources[resource].isSwapchain ? VK_NULL_HANDLE : getTexture(resource)->getImage(),
+            .subresourceRange = { aspectMask, 0, 1, 0, 1 }
+        };
+    };
+
+    for (uint32_t p = 0; p < passes.size(); p++) {
+        RenderGraphPass& pass = passes[p];
+        if (pass.culled) {
+            continue;
+        }
+
+        // shader resources transition with explicit barriers ahead of the pass, so do attachments without render passes
+        for (const auto& use : pass.uses) {
+            const bool shaderUse = use.usage == RGUsage::Sampled || use.usage == RGUsage::StorageRead || use.usage == RGUsage::StorageWrite;
+            if (!shaderUse && !dynamicRendering) {
+                continue;
+            }
+
+            const RenderGraphResource& resource = resources[use.resource];
+            const ResourceState target = getUseState(use, resource.desc.format);
+            ResourceState& current = states[use.resource];
+
+            const VkAccessFlags writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            if (current.layout == target.layout && !(current.access & writeAccess) && !(target.access & writeAccess)) {
+                current.stages |= target.stages;
+                continue;
+            }
+
+            if (resource.isSwapchain) {
+                pass.swapchainBarrier = static_cast<uint32_t>(pass.imageBarriers.size());
+            }
+            pass.imageBarriers.push_back(makeBarrier(use.resource, current, target, !shaderUse && use.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD));
+            pass.barrierSrcStages |= current.stages ? current.stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            pass.barrierDstStages |= target.stages;
+
+            current = target;
+        }
+
+        if (pass.type == RGPassType::Raster) {
+            buildRenderPass(p, states);
+        }
+    }
+
+    // without a render pass final layout the swapchain has to be handed to presentation explicitly
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        if (dynamicRendering && resources[i].isSwapchain && resources[i].firstPass != UINT32_MAX) {
+            const ResourceState present{ VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0 };
+            presentBarrier = makeBarrier(i, states[i], present, false);
+            presentBarrierSrcStages = states[i].stages;
+            hasPresentBarrier = true;
+        }
+    }
+}
+
+void RenderGraph::buildRenderPass(uint32_t passIndex, std::vector<ResourceState>& states) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    RenderGraphPass& pass = passes[passIndex];
+    RenderGraphPass& owner = passes[pass.renderPassOwner];
+
+    if (pass.subpass == 0) {
+        for (auto& state : states) {
+            state.subpass = VK_SUBPASS_EXTERNAL;
+        }
+    } else {
+        owner.renderTarget.nextSubpass();
+    }
+
+    std::vector<const RGResourceUse*> colors;
+    std::vector<const RGResourceUse*> resolves;
+    const RGResourceUse* depth = nullptr;
+    for (const auto& use : pass.uses) {
+        if (use.usage == RGUsage::ColorAttachment) {
+            colors.push_back(&use);
+        } else if (use.usage == RGUsage::ResolveAttachment) {
+            resolves.push_back(&use);
+        } else if (use.usage == RGUsage::DepthAttachment || use.usage == RGUsage::DepthReadOnly) {
+            depth = &use;
+        }
+    }
+
+    if (colors.empty() && resolves.empty() && !depth) {
+        throw std::runtime_error("ERROR::RenderGraph:compile: raster pass '" + pass.name + "' has no attachments!");
+    }
+
+    // resolve references have to line up with the color references
+    std::vector<const RGResourceUse*> orderedResolves;
+    if (!resolves.empty()) {
+        for (const auto* color : colors) {
+            auto it = std::find_if(resolves.begin(), resolves.end(), [color](const RGResourceUse* use) {
+                return use->resolveSource == color->resource;
+            });
+            if (it == resolves.end()) {
+                throw std::runtime_error("ERROR::RenderGraph:compile: every color attachment of '" + pass.name + "' needs a resolve target once one has!");
+            }
+            orderedResolves.push_back(*it);
+        }
+    }
+
+    // outside work syncs through EXTERNAL, earlier subpasses of the same render pass through by-region dependencies
+    auto addDependency = [&](const ResourceState& current, const ResourceState& target) {
+        auto it = std::find_if(owner.dependencies.begin(), owner.dependencies.end(), [&](const VkSubpassDependency& dependency) {
+            return dependency.srcSubpass == current.subpass && dependency.dstSubpass == pass.subpass;
+        });
+        if (it == owner.dependencies.end()) {
+            owner.dependencies.push_back({
+                .srcSubpass = current.subpass,
+                .dstSubpass = pass.subpass,
+                .dependencyFlags = current.subpass == VK_SUBPASS_EXTERNAL ? 0u : VK_DEPENDENCY_BY_REGION_BIT });
+            it = owner.dependencies.end() - 1;
+        }
+
+        it->srcStageMask |= current.stages;
+        it->srcAccessMask |= current.access;
+        it->dstStageMask |= target.stages;
+        it->dstAccessMask |= target.access;
+    };
+
+    auto addAttachment = [&](const RGResourceUse& use, VkAttachmentLoadOp loadOp) -> vkw::AttachmentInfo {
+        const RenderGraphResource& resource = resources[use.resource];
+        const ResourceState target = getUseState(use, resource.desc.format);
+        ResourceState& current = states[use.resource];
+
+        vkw::AttachmentInfo attachment = resource.isSwapchain ? vkw::AttachmentInfo{ &rd->getSwapChain() } : vkw::AttachmentInfo{ getTexture(use.resource) };
+        attachment.loadAction = loadOp;
+        // nothing after this render pass needs the contents, let tilers skip the write back
+        const bool usedLater = passes[resource.lastPass].renderPassOwner != pass.renderPassOwner;
+        attachment.storeAction = resource.isSwapchain || usedLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.layout = target.layout;
+        attachment.initialLayout = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? current.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        const bool present = resource.isSwapchain && resource.lastPass == passIndex && !dynamicRendering;
+        attachment.finalLayout = present ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : target.layout;
+
+        if (!dynamicRendering) {
+            addDependency(current, target);
+        }
+
+        current = { attachment.finalLayout, target.stages, target.access, pass.subpass };
+        owner.usesSwapchain = owner.usesSwapchain || resource.isSwapchain;
+
+        const glm::uvec2 size = resource.desc.extent.x ? resource.desc.extent : extent;
+        owner.extent = { size.x, size.y };
+
+        return attachment;
+    };
+
+    // attachments shared with an earlier subpass keep their index and clear value
+    auto addClearValue = [&](uint32_t attachmentIndex, const RGResourceUse& use) {
+        if (attachmentIndex == owner.clearValues.size()) {
+            owner.clearValues.push_back(use.clearValue);
+        }
+    };
+
+    for (const auto* use : colors) {
+        vkw::AttachmentInfo attachment = addAttachment(*use, use->loadOp);
+        addClearValue(owner.renderTarget.addColorAttachment(attachment), *use);
+    }
+    for (const auto* use : orderedResolves) {
+        vkw::AttachmentInfo attachment = addAttachment(*use, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+        addClearValue(owner.renderTarget.addColorResolveAttachment(attachment), *use);
+    }
+    if (depth) {
+        vkw::AttachmentInfo attachment = addAttachment(*depth, depth->loadOp);
+        addClearValue(owner.renderTarget.setDepthStencilAttachment(attachment), *depth);
+    }
+
+    if (!pass.endsRenderPass) {
+        return;
+    }
+
+    // dynamic rendering only needs the attachment list, no render pass or framebuffer objects to rebuild
+    if (dynamicRendering) {
+        return;
+    }
+
+    for (auto& dependency : owner.dependencies) {
+        if (dependency.srcStageMask == 0) {
+            dependency.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+    }
+
+    owner.renderPass = rd->createRenderPass(owner.renderTarget, owner.dependencies, owner.name);
+
+    const uint32_t framebufferCount = owner.usesSwapchain ? rd->getSwapChain().getImageCount() : 1;
+    owner.renderTarget.setupFramebuffers(framebufferCount, owner.extent, rd->getRenderPass(owner.renderPass));
+
+    for (uint32_t p = pass.renderPassOwner; p <= passIndex; p++) {
+        if (!passes[p].culled && passes[p].renderPassOwner == pass.renderPassOwner) {
+            passes[p].renderPass = owner.renderPass;
+        }
+    }
+}
+
+void RenderGraph::releaseResources() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    for (auto& pass : passes) {
+        pass.renderTarget.destroy();
+        // merged passes share the owner's handle, repeated destroys of a stale handle are ignored
+        rd->destroyRenderPass(pass.renderPass);
+
+        pass.renderPass = {};
+        pass.culled = false;
+        pass.renderPassOwner = 0;
+        pass.subpass = 0;
+        pass.endsRenderPass = true;
+        pass.usesSwapchain = false;
+        pass.extent = {};
+        pass.clearValues.clear();
+        pass.dependencies.clear();
+        pass.imageBarriers.clear();
+        pass.swapchainBarrier = UINT32_MAX;
+        pass.barrierSrcStages = 0;
+        pass.barrierDstStages = 0;
+    }
+
+    // textures are queued before their memory, so they are gone by the time it is freed
+    for (auto& resource : resources) {
+        rd->destroyTexture(resource.texture);
+
+        resource.texture = {};
+        resource.usage = 0;
+        resource.firstPass = UINT32_MAX;
+        resource.lastPass = 0;
+        resource.offset = 0;
+        resource.memoryRequirements = {};
+        resource.memory = {};
+        resource.aliased = false;
+        resource.lazy = false;
+    }
+
+    for (auto memory : memoryBlocks) {
+        rd->freeMemory(memory);
+    }
+    memoryBlocks.clear();
+    transientMemorySize = 0;
+    lazyMemorySize = 0;
+    hasPresentBarrier = false;
+}
+
+RenderGraph::ResourceState RenderGraph::getUseState(const RGResourceUse& use, VkFormat format) {
+    const bool load = use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+
+    switch (use.usage) {
+        case RGUsage::ColorAttachment:
+        case RGUsage::ResolveAttachment:
+            return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (load ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0u) };
+        case RGUsage::DepthAttachment:
+            return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+        case RGUsage::DepthReadOnly:
+            return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT };
+        case RGUsage::Sampled:
+            return { vkw::Texture::hasDepth(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                use.stages, VK_ACCESS_SHADER_READ_BIT };
+        case RGUsage::StorageRead:
+            return { VK_IMAGE_LAYOUT_GENERAL, use.stages, VK_ACCESS_SHADER_READ_BIT };
+        case RGUsage::StorageWrite:
+            return { VK_IMAGE_LAYOUT_GENERAL, use.stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT };
+    }
+
+    return {};
+}
+
+bool RenderGraph::isWrite(const RGResourceUse& use) {
+    return use.usage == RGUsage::ColorAttachment || use.usage == RGUsage::ResolveAttachment || use.usage == RGUsage::DepthAttachment
+            || use.usage == RGUsage::StorageWrite;
+}
+
+bool RenderGraph::isRead(const RGResourceUse& use) {
+    const bool loads = use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD
+            && (use.usage == RGUsage::ColorAttachment || use.usage == RGUsage::DepthAttachment);
+
+    return loads || use.usage == RGUsage::DepthReadOnly || use.usage == RGUsage::Sampled || use.usage == RGUsage::StorageRead;
+}
+
+} //namespace sublimation
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <volk.h>
+#include <glm/glm.hpp>
+#include <vk_mem_alloc.h>
+
+#include <graphics/vulkan/render_target.h>
+#include <graphics/vulkan/resource_pool.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sublimation {
+
+using RGResourceId = uint32_t;
+constexpr RGResourceId RG_INVALID_RESOURCE = UINT32_MAX;
+
+struct RGTextureDesc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    glm::uvec2 extent{ 0 }; ///< 0 = graph extent
+};
+
+enum class RGPassType {
+    Raster,
+    Compute
+};
+
+// how a pass touches a resource, decides layout, stages and access
+enum class RGUsage {
+    ColorAttachment,
+    ResolveAttachment,
+    DepthAttachment, ///< depth test and write
+    DepthReadOnly, ///< depth test only
+    Sampled,
+    StorageRead,
+    StorageWrite
+};
+
+struct RGResourceUse {
+    RGResourceId resource;
+    RGUsage usage;
+    VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    VkClearValue clearValue{};
+    VkPipelineStageFlags stages = 0; ///< shader stages for non attachment uses
+    RGResourceId resolveSource = RG_INVALID_RESOURCE;
+};
+
+class RenderGraph;
+
+// handed to a pass' setup callback to declare what it reads and writes
+class RenderGraphBuilder {
+public:
+    RenderGraphBuilder(RenderGraph& graph, uint32_t passIndex) :
+            graph(graph), passIndex(passIndex) {}
+
+    RGResourceId createTexture(const std::string& name, const RGTextureDesc& desc);
+
+    void writeColor(RGResourceId resource, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, VkClearColorValue clearColor = { { 0.f, 0.f, 0.f, 1.f } });
+    void writeDepth(RGResourceId resource, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, float clearDepth = 1.f);
+    void readDepth(RGResourceId resource);
+    void resolve(RGResourceId source, RGResourceId destination);
+
+    void sample(RGResourceId resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    void readStorage(RGResourceId resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    void writeStorage(RGResourceId resource, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    // keeps the pass alive even if nothing reads its outputs
+    void setSideEffect();
+
+private:
+    void addUse(const RGResourceUse& use);
+
+    RenderGraph& graph;
+    uint32_t passIndex;
+};
+
+struct RenderGraphPass {
+    std::string name;
+    RGPassType type = RGPassType::Raster;
+    bool sideEffect = false;
+    std::vector<RGResourceUse> uses;
+    std::function<void(VkCommandBuffer commandBuffer)> execute;
+
+    // compiled state
+    bool culled = false;
+    uint32_t renderPassOwner = 0; ///< first pass of the render pass this one records into, itself unless merged
+    uint32_t subpass = 0;
+    bool endsRenderPass = true;
+    vkw::RenderPassHandle renderPass;
+
+    // render pass state, only filled in on the owner
+    bool usesSwapchain = false;
+    VkExtent2D extent{};
+    vkw::RenderTarget renderTarget;
+    std::vector<VkClearValue> clearValues;
+    std::vector<VkSubpassDependency> dependencies;
+
+    // barriers recorded before the pass, attachment transitions go through the render pass instead
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    uint32_t swapchainBarrier = UINT32_MAX; ///< barrier whose image is the acquired swapchain image
+    VkPipelineStageFlags barrierSrcStages = 0;
+    VkPipelineStageFlags barrierDstStages = 0;
+};
+
+struct RenderGraphResource {
+    std::string name;
+    RGTextureDesc desc;
+    bool isSwapchain = false;
+
+    // compiled state
+    VkImageUsageFlags usage = 0;
+    uint32_t firstPass = UINT32_MAX;
+    uint32_t lastPass = 0;
+    VkDeviceSize offset = 0;
+    VkMemoryRequirements memoryRequirements{};
+    vkw::MemoryHandle memory;
+    bool aliased = false; ///< shares memory with another resource
+    bool lazy = false; ///< transient attachment backed by lazily allocated memory
+    vkw::TextureHandle texture;
+};
+
+// Frame render graph
+// passes declare the resources they read and write, compile() culls passes nobody consumes,
+// places transient attachments in one allocation with non-overlapping lifetimes sharing memory,
+// and derives render passes, layout transitions and barriers from the declared uses.
+// With subpass merging enabled, consecutive raster passes that only touch attachments of the same size
+// become subpasses of one render pass with by-region dependencies, so attachments they share can stay on tile.
+// Attachments that live inside a single pass are never loaded or stored, they get TRANSIENT_ATTACHMENT usage
+// and lazily allocated memory where the device has it
+class RenderGraph {
+public:
+    RenderGraph() = default;
+
+    // drops passes and resource declarations, physical resources are released through the deletion queue
+    void reset();
+
+    RGResourceId importSwapchain(const std::string& name);
+    void addPass(const std::string& name, RGPassType type, const std::function<void(RenderGraphBuilder&)>& setup,
+            std::function<void(VkCommandBuffer commandBuffer)>&& execute);
+
+    // take effect on the next compile(), both change what pipelines have to be built against
+    void setSubpassMerging(bool enable) { subpassMerging = enable; }
+    // passes record with vkCmdBeginRendering and explicit layout barriers, no render pass or framebuffer objects.
+    // Pipelines are built against getRenderingFormats() and stay valid across resizes. Disables subpass merging
+    void setDynamicRendering(bool enable) { dynamicRendering = enable; }
+    bool isDynamicRendering() const { return dynamicRendering; }
+
+    void compile(glm::uvec2 extent);
+    void execute(VkCommandBuffer commandBuffer, uint32_t swapchainImageIndex);
+
+    bool isPassActive(const std::string& name) const;
+    vkw::RenderPassHandle getRenderPass(const std::string& name) const;
+    uint32_t getSubpass(const std::string& name) const;
+    vkw::RenderingFormats getRenderingFormats(const std::string& name) const;
+    vkw::Texture* getTexture(RGResourceId resource) const;
+    RGResourceId findResource(const std::string& name) const;
+
+    VkDeviceSize getTransientMemorySize() const { return transientMemorySize; }
+    VkDeviceSize getUnaliasedMemorySize() const { return unaliasedMemorySize; }
+    VkDeviceSize getLazyMemorySize() const { return lazyMemorySize; }
+
+private:
+    friend RenderGraphBuilder;
+
+    struct ResourceState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+        uint32_t subpass = VK_SUBPASS_EXTERNAL; ///< subpass of the open render pass that used it last
+    };
+
+    void cullPasses();
+    void mergePasses();
+    void computeLifetimes();
+    void allocateResources();
+    void buildPasses();
+    void buildRenderPass(uint32_t passIndex, std::vector<ResourceState>& states);
+    void releaseResources();
+
+    static ResourceState getUseState(const RGResourceUse& use, VkFormat format);
+    static bool isWrite(const RGResourceUse& use);
+    static bool isRead(const RGResourceUse& use);
+
+    std::vector<RenderGraphPass> passes;
+    std::vector<RenderGraphResource> resources;
+
+    glm::uvec2 extent{ 0 };
+    bool subpassMerging = false;
+    bool dynamicRendering = false;
+    std::vector<vkw::MemoryHandle> memoryBlocks;
+    VkDeviceSize transientMemorySize = 0;
+    VkDeviceSize unaliasedMemorySize = 0;
+    VkDeviceSize lazyMemorySize = 0;
+
+    VkImageMemoryBarrier presentBarrier{};
+    VkPipelineStageFlags presentBarrierSrcStages = 0;
+    bool hasPresentBarrier = false;
+};
+
+} //namespace sublimation
@@ -3,40 +3,17 @@
 #include <graphics/render_system.h>
 
 #include <core/engine.h>
+#include <core/job_system.h>
 #include <graphics/vulkan/rendering_device.h>
 #include <graphics/vulkan/utils.h>
 #include <graphics/vulkan/descriptor.h>
 #include <graphics/vulkan/texture.h>
 
-namespace sublimation {
-
-void DepthPrePass::setupRenderPass() {
-    VkSubpassDependency dependency{
-        .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
-        .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
-    };
-
-    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-    renderPass = rd->createRenderPass(renderTarget, dependency, "depth");
-}
-
-void ForwardPass::setupRenderPass() {
-    VkSubpassDependency dependency{
-        .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
-    };
+#include <algorithm>
+#include <array>
+#include <iostream>
 
-    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-    renderPass = rd->createRenderPass(renderTarget, dependency, "forward");
-}
+namespace sublimation {
 
 RenderSystem* RenderSystem::getSingleton() {
     static RenderSystem singleton;
@@ -45,32 +22,28 @@ RenderSystem* RenderSystem::getSingleton() {
 
 void RenderSystem::initialize() {
     vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-    rd->initialize();
+    rd->initialize(framesInFlight);
+    JobSystem::getSingleton()->initialize();
+    timestampPeriod = rd->getPhysicalDeviceProperties().limits.timestampPeriod;
 
     // load shaders - descriptor layout with reflection
     loadShaders();
     // setup pipeline layouts
     createPipelineLayouts();
+    occlusionCuller.initialize();
 
-    // set up descriptors
-    createDescriptors();
-
+    renderGraph.setSubpassMerging(subpassMerging);
+    renderGraph.setDynamicRendering(dynamicRendering && rd->hasDynamicRendering());
     updateRenderSurfaces();
 
-    // create render passes
-    forwardPass.setupRenderPass();
-    depthPrePass.setupRenderPass();
+    // render passes are created along with the render surfaces
 
     // create pipelines
     createPipelines();
 
-    // write descriptors
-
-    createSyncObjects();
-
-    for (int i = 0; i < maxFrameLag; i++) {
-		sceneDataBuffers.emplace_back(sizeof(GpuSceneData));
-	}
+    // per frame in flight resources: scene buffers, descriptors, sync objects and queries
+    createFrameResources();
+    lastFrameStart = std::chrono::steady_clock::now();
 }
 
 void RenderSystem::loadShaders() {
@@ -94,6 +67,9 @@ void RenderSystem::loadShaders() {
 
     depthPrePass.shader = rd->createShaderFromSPIRV(depthShaderInfo);
 
+    rd->getShader(forwardPass.shader)->pushConstantRange = sizeof(MeshPushConstants);
+    rd->getShader(depthPrePass.shader)->pushConstantRange = sizeof(MeshPushConstants);
+
 
     // layout bindings
     // TODO: move when reflection is done
@@ -105,14 +81,6 @@ void RenderSystem::loadShaders() {
 		.pImmutableSamplers = nullptr
 	};
 
-	VkDescriptorSetLayoutBinding directionalLayoutBinding{
-		.binding = 1,
-		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr
-	};
-
     {
         std::vector<VkDescriptorSetLayoutBinding> bindings = { globalsLayoutBinding };
         VkDescriptorSetLayoutCreateInfo layoutCreateInfo{
@@ -123,13 +91,13 @@ void RenderSystem::loadShaders() {
 
 	    VkDescriptorSetLayout layout;
 	    CHECK_VKRESULT(vkCreateDescriptorSetLayout(rd->getDevice(), &layoutCreateInfo, nullptr, &layout));
-        depthPrePass.shader.layouts.push_back(layout);
+        rd->getShader(depthPrePass.shader)->layouts.push_back(layout);
     }
 
     {
         globalsLayoutBinding.stageFlags |= VK_SHADER_STAGE_FRAGMENT_BIT;
 
-        std::vector<VkDescriptorSetLayoutBinding> bindings = { globalsLayoutBinding, directionalLayoutBinding };
+        std::vector<VkDescriptorSetLayoutBinding> bindings = { globalsLayoutBinding };
         VkDescriptorSetLayoutCreateInfo layoutCreateInfo{
 		    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 		    .bindingCount = (uint32_t)bindings.size(),
@@ -138,9 +106,12 @@ void RenderSystem::loadShaders() {
 
 	    VkDescriptorSetLayout layout;
 	    CHECK_VKRESULT(vkCreateDescriptorSetLayout(rd->getDevice(), &layoutCreateInfo, nullptr, &layout));
-        forwardPass.shader.layouts.push_back(layout);
+        rd->getShader(forwardPass.shader)->layouts.push_back(layout);
     }
 
+    // material textures are all created linear and clamped, the placeholder included
+    const VkSampler materialSampler = rd->getSampler({});
+
     VkDescriptorSetLayoutBinding matauxLayoutBinding{
 		.binding = 0,
 		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
@@ -154,39 +125,26 @@ void RenderSystem::loadShaders() {
 		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 		.descriptorCount = 1,
 		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr
+		.pImmutableSamplers = &materialSampler
 	};
-	VkDescriptorSetLayoutBinding metallicLayoutBinding{
+	// occlusion, roughness and metallic packed in r/g/b
+	VkDescriptorSetLayoutBinding ormLayoutBinding{
 		.binding = 2,
 		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 		.descriptorCount = 1,
 		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr
-	};
-	VkDescriptorSetLayoutBinding roughLayoutBinding{
-		.binding = 3,
-		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr
-	};
-	VkDescriptorSetLayoutBinding ambientLayoutBinding{
-		.binding = 4,
-		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr
+		.pImmutableSamplers = &materialSampler
 	};
 	VkDescriptorSetLayoutBinding normalLayoutBinding{
-		.binding = 5,
+		.binding = 3,
 		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 		.descriptorCount = 1,
 		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr
+		.pImmutableSamplers = &materialSampler
 	};
 
     {
-	    std::vector<VkDescriptorSetLayoutBinding> bindings = { matauxLayoutBinding, albedoLayoutBinding, metallicLayoutBinding, roughLayoutBinding, ambientLayoutBinding, normalLayoutBinding };
+	    std::vector<VkDescriptorSetLayoutBinding> bindings = { matauxLayoutBinding, albedoLayoutBinding, ormLayoutBinding, normalLayoutBinding };
         VkDescriptorSetLayoutCreateInfo layoutCreateInfo{
 		    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 		    .bindingCount = (uint32_t)bindings.size(),
@@ -195,7 +153,7 @@ void RenderSystem::loadShaders() {
 
 	    VkDescriptorSetLayout layout;
 	    CHECK_VKRESULT(vkCreateDescriptorSetLayout(rd->getDevice(), &layoutCreateInfo, nullptr, &layout));
-	    forwardPass.shader.layouts.push_back(layout);
+	    rd->getShader(forwardPass.shader)->layouts.push_back(layout);
     }
 }
 
@@ -204,15 +162,19 @@ void RenderSystem::createPipelineLayouts() {
 
     forwardPass.pipelineLayout = rd->createPipelineLayout(forwardPass.shader);
     depthPrePass.pipelineLayout = rd->createPipelineLayout(depthPrePass.shader);
+
+    depthLatePass.shader = depthPrePass.shader;
+    depthLatePass.pipelineLayout = depthPrePass.pipelineLayout;
 }
 
 void RenderSystem::createDescriptors() {
     vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-    vkw::DescriptorAllocator allocator = rd->getDescriptorAllocator();
+    vkw::DescriptorAllocator& allocator = rd->getDescriptorAllocator();
 
-    for (uint32_t i = 0; i < maxFrameLag; i++) {
-        forwardPass.descriptors.push_back(allocator.allocate(forwardPass.shader.layouts[0]));
-        depthPrePass.descriptors.push_back(allocator.allocate(depthPrePass.shader.layouts[0]));
+    // sets can't be handed back to the allocator, so keep the ones from a larger frame count around
+    for (uint32_t i = static_cast<uint32_t>(forwardPass.descriptors.size()); i < framesInFlight; i++) {
+        forwardPass.descriptors.push_back(allocator.allocate(rd->getShader(forwardPass.shader)->layouts[0]));
+        depthPrePass.descriptors.push_back(allocator.allocate(rd->getShader(depthPrePass.shader)->layouts[0]));
     }
 
     //for (const auto& layout : forwardPass.shader.layouts) {
@@ -244,21 +206,46 @@ void RenderSystem::createPipelines() {
         vkw::PipelineInfo pipelineInfo{
             .rasterizationInfo = rasterInfo,
             .depthStencilInfo = depthStencilInfo,
-            .pipelineLayout = depthPrePass.pipelineLayout,
-            .renderPass = depthPrePass.renderPass.renderPass
+            .pipelineLayout = rd->getPipelineLayout(depthPrePass.pipelineLayout),
+            .renderPass = rd->getRenderPass(depthPrePass.renderPass),
+            .subpass = depthPrePass.subpass,
+            .renderingFormats = depthPrePass.renderingFormats,
+            .vertexFormat = vertexFormat,
+            .positionOnly = true
         };
         depthPrePass.pipeline = rd->createPipeline(pipelineInfo, depthPrePass.shader);
+
+        // same state as the early pass, built against the render pass it shares with the forward pass when merged
+        if (occlusionCulling) {
+            pipelineInfo.renderPass = rd->getRenderPass(depthLatePass.renderPass);
+            pipelineInfo.subpass = depthLatePass.subpass;
+            pipelineInfo.renderingFormats = depthLatePass.renderingFormats;
+            depthLatePass.pipeline = rd->createPipeline(pipelineInfo, depthLatePass.shader);
+        }
     }
 
     {
         depthStencilInfo.depthWriteEnable = VK_FALSE;
         depthStencilInfo.compareOp = VK_COMPARE_OP_EQUAL;
 
+        // one blend state per color attachment
+        vkw::BlendStateInfo blendStateInfo{
+            .attachmentCount = 1
+        };
+        blendStateInfo.blendStates[0] = {
+            .blendEnable = VK_FALSE,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+        };
+
         vkw::PipelineInfo pipelineInfo{
             .rasterizationInfo = rasterInfo,
             .depthStencilInfo = depthStencilInfo,
-            .pipelineLayout = forwardPass.pipelineLayout,
-            .renderPass = forwardPass.renderPass.renderPass
+            .blendStateInfo = blendStateInfo,
+            .pipelineLayout = rd->getPipelineLayout(forwardPass.pipelineLayout),
+            .renderPass = rd->getRenderPass(forwardPass.renderPass),
+            .subpass = forwardPass.subpass,
+            .renderingFormats = forwardPass.renderingFormats,
+            .vertexFormat = vertexFormat
         };
         forwardPass.pipeline = rd->createPipeline(pipelineInfo, forwardPass.shader);
     }
@@ -268,107 +255,452 @@ void RenderSystem::createSyncObjects() {
     vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
     VkDevice device = rd->getDevice();
 
-    presentCompleteSemaphores.resize(maxFrameLag);
-    renderCompleteSemaphores.resize(maxFrameLag);
-    inFlightFences.resize(maxFrameLag);
+    presentCompleteSemaphores.resize(framesInFlight);
+    renderCompleteSemaphores.resize(framesInFlight);
 
     VkSemaphoreCreateInfo semaphoreCreateInfo{
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
         .pNext = nullptr
     };
 
-    VkFenceCreateInfo fenceCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT
-    };
-
-    for (uint32_t i = 0; i < maxFrameLag; i++) {
+    for (uint32_t i = 0; i < framesInFlight; i++) {
         CHECK_VKRESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &presentCompleteSemaphores[i]));
 
         CHECK_VKRESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &renderCompleteSemaphores[i]));
+    }
+}
+
+void RenderSystem::createFrameResources() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    createSyncObjects();
+    createDescriptors();
+    occlusionCuller.createFrameResources(framesInFlight);
+
+    vkw::DescriptorWriter writer;
+    for (uint32_t i = 0; i < framesInFlight; i++) {
+        sceneDataBuffers.push_back(rd->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, sizeof(GpuSceneData)));
 
-        CHECK_VKRESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &inFlightFences[i]));
+        writer.bindBuffer(0, rd->getBuffer(sceneDataBuffers[i]), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        writer.writeSet(forwardPass.descriptors[i]);
+        writer.bindBuffer(0, rd->getBuffer(sceneDataBuffers[i]), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        writer.writeSet(depthPrePass.descriptors[i]);
     }
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2 * framesInFlight
+    };
+    CHECK_VKRESULT(vkCreateQueryPool(rd->getDevice(), &queryPoolCreateInfo, nullptr, &timestampQueryPool));
+    timestampsWritten.assign(framesInFlight, false);
+}
+
+void RenderSystem::destroyFrameResources() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    VkDevice device = rd->getDevice();
+
+    // the swapchain may still be waiting on the last render complete semaphores, so let them retire with the frame
+    std::vector<VkSemaphore> semaphores = presentCompleteSemaphores;
+    semaphores.insert(semaphores.end(), renderCompleteSemaphores.begin(), renderCompleteSemaphores.end());
+    VkQueryPool queryPool = timestampQueryPool;
+    rd->deferDestroy([device, semaphores, queryPool]() {
+        for (auto semaphore : semaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        vkDestroyQueryPool(device, queryPool, nullptr);
+    });
+    presentCompleteSemaphores.clear();
+    renderCompleteSemaphores.clear();
+    timestampQueryPool = VK_NULL_HANDLE;
+
+    for (auto buffer : sceneDataBuffers) {
+        rd->destroyBuffer(buffer);
+    }
+    sceneDataBuffers.clear();
+
+    occlusionCuller.destroyFrameResources();
+}
+
+void RenderSystem::setFramesInFlight(uint32_t count) {
+    if (count == 0) {
+        throw std::runtime_error("ERROR::RenderSystem:setFramesInFlight: at least one frame in flight is required!");
+    }
+
+    pendingFramesInFlight = count;
+}
+
+void RenderSystem::applyFramesInFlight() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    // drain through the timeline rather than idling the whole device
+    rd->waitForFrame(frameNumber);
+
+    destroyFrameResources();
+    framesInFlight = pendingFramesInFlight;
+    pendingFramesInFlight = 0;
+
+    rd->setFramesInFlight(framesInFlight);
+    createFrameResources();
+}
+
+void RenderSystem::applyRenderSettings() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    if (pendingSamples != 0) {
+        rd->setMSAASamples(pendingSamples);
+    }
+    pendingSamples = static_cast<VkSampleCountFlagBits>(0);
+    renderSettingsChanged = false;
+
+    // sample count and subpass layout are baked into the render passes and pipelines, old ones retire through the deletion queue
+    renderGraph.setSubpassMerging(subpassMerging);
+    renderGraph.setDynamicRendering(dynamicRendering && rd->hasDynamicRendering());
+    buildRenderGraph();
+
+    rd->destroyPipeline(depthPrePass.pipeline);
+    rd->destroyPipeline(depthLatePass.pipeline);
+    rd->destroyPipeline(forwardPass.pipeline);
+    createPipelines();
 }
 
 void RenderSystem::update(Scene& scene) {
+    // pipelines follow the vertex format the scene's model was imported with
+    if (scene.getVertexFormat() != vertexFormat) {
+        vertexFormat = scene.getVertexFormat();
+        renderSettingsChanged = true;
+    }
+
     // update uniform data ...
     scene.updateSceneBufferData();
+    scene.selectLods(static_cast<float>(height), lodPixelThreshold);
+    // swapped textures reach the material sets once render() has waited for their frame slot
+    scene.updateTextureStreaming(static_cast<float>(height), textureBudget);
+
+    // rasterises occluders and tests bounds while the CPU goes on with the frame, collected before recording
+    // the setting is read once here so every begin() is paired with the finish() in render()
+    softwareOcclusionActive = softwareOcclusionCulling && !occlusionCulling;
+    if (softwareOcclusionActive) {
+        softwareOcclusion.begin(scene, scene.getSceneData().projection * scene.getSceneData().view);
+    }
+}
 
+void RenderSystem::render() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    Scene& scene = Engine::getSingleton()->activeScene;
+
+    if (pendingFramesInFlight != 0 && pendingFramesInFlight != framesInFlight) {
+        applyFramesInFlight();
+    }
+    pendingFramesInFlight = 0;
+
+    if (renderSettingsChanged) {
+        applyRenderSettings();
+    }
+
+    const auto frameStart = std::chrono::steady_clock::now();
+
+    frameNumber++;
+    frameIndex = static_cast<uint32_t>(frameNumber % framesInFlight);
+
+    // the slot is free again once the frame that last used it has retired
+    if (frameNumber > framesInFlight) {
+        rd->waitForFrame(frameNumber - framesInFlight);
+    }
+    const auto waitEnd = std::chrono::steady_clock::now();
+
+    rd->beginFrame(frameNumber);
+    rd->resetCommandPool(frameIndex);
+
+    FrameStats sample{
+        .cpuFrameTime = std::chrono::duration<float, std::milli>(frameStart - lastFrameStart).count(),
+        .cpuWaitTime = std::chrono::duration<float, std::milli>(waitEnd - frameStart).count()
+    };
+    lastFrameStart = frameStart;
+
+    if (timestampsWritten[frameIndex]) {
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(rd->getDevice(), timestampQueryPool, 2 * frameIndex, 2, sizeof(timestamps), timestamps,
+                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            sample.gpuFrameTime = static_cast<float>(timestamps[1] - timestamps[0]) * timestampPeriod * 1e-6f;
+        }
+    }
+
+    ((vkw::UniformBuffer*)rd->getBuffer(sceneDataBuffers[frameIndex]))->update(&scene.getSceneData());
     updateDescriptorSets(scene);
+    if (occlusionCulling) {
+        occlusionCuller.update(scene, frameIndex, frameNumber, scene.getSceneData().projection * scene.getSceneData().view);
+    }
+
+    // compute goes first so it can start while the graphics queue finishes the previous frame
+    const bool computeSubmitted = submitAsyncCompute();
+    std::vector<vkw::SemaphoreSubmitInfo> computeWaits;
+    if (computeSubmitted) {
+        // the late cull on the graphics queue rewrites the visibility the early cull reads
+        computeWaits.push_back({ rd->getComputeTimeline(), frameNumber,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+                | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT });
+    }
+
+    uint32_t imageIndex;
+    VkResult result = rd->getSwapChain().acquireNextImage(presentCompleteSemaphores[frameIndex], &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        if (softwareOcclusionActive) {
+            softwareOcclusion.finish();
+        }
+
+        // still signal this frame's value so waits on the timeline keep advancing, frame N implies compute N is done
+        const vkw::SemaphoreSubmitInfo signal{ rd->getFrameTimeline(), frameNumber };
+        rd->submit(rd->getGraphicsQueue(), {}, computeWaits, { &signal, 1 });
+
+        updateRenderSurfaces();
+        return;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        throw std::runtime_error("ERROR::RenderSystem:render: failed to acquire swapchain image!");
+    }
+
+    VkCommandBuffer commandBuffer = rd->getCommandBufferOneTime(frameIndex, true);
+
+    vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 2 * frameIndex, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, 2 * frameIndex);
+
+    // ahead of the passes, nothing samples the new textures before this frame has retired
+    scene.recordTextureUploads(commandBuffer, frameNumber);
+
+    if (softwareOcclusionActive) {
+        softwareOcclusion.finish();
+    }
+    renderGraph.execute(commandBuffer, imageIndex);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, 2 * frameIndex + 1);
+    timestampsWritten[frameIndex] = true;
+
+    CHECK_VKRESULT(vkEndCommandBuffer(commandBuffer));
+
+    std::vector<vkw::SemaphoreSubmitInfo> waits = computeWaits;
+    waits.push_back({ presentCompleteSemaphores[frameIndex], 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT });
+    const vkw::SemaphoreSubmitInfo signals[] = {
+        { renderCompleteSemaphores[frameIndex] },
+        { rd->getFrameTimeline(), frameNumber }
+    };
+    rd->submit(rd->getGraphicsQueue(), { &commandBuffer, 1 }, waits, signals);
+
+    result = rd->getSwapChain().queuePresent(rd->getPresentQueue(), imageIndex, renderCompleteSemaphores[frameIndex]);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        updateRenderSurfaces();
+    } else if (result != VK_SUCCESS) {
+        throw std::runtime_error("ERROR::RenderSystem:render: failed to present swapchain image!");
+    }
+
+    sample.framesQueued = static_cast<float>(frameNumber - rd->getCompletedFrame());
+    updateFrameStats(sample);
 }
 
-void RenderSystem::render() {
-    // TODO: implement
+void RenderSystem::addAsyncComputePass(AsyncComputePass&& pass) {
+    asyncComputePasses.push_back(std::move(pass));
 }
 
-void RenderSystem::updateDescriptorSets(Scene& scene) {
-    // TODO: write descriptor sets
+bool RenderSystem::submitAsyncCompute() {
+    const bool earlyCull = occlusionCulling && occlusionCuller.getDrawCount() > 0;
+    if (!earlyCull && asyncComputePasses.empty()) {
+        return false;
+    }
 
-    // material descriptor created here?
-    scene.updateSceneDescriptors(forwardPass.shader.layouts[1]);
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
 
-    vkw::DescriptorWriter writer;
+    VkCommandBuffer commandBuffer = rd->getComputeCommandBuffer(frameIndex, true);
+    uint32_t frameLatency = 0;
+    auto addLatency = [&frameLatency](uint32_t latency) {
+        if (latency != 0) {
+            frameLatency = frameLatency == 0 ? latency : std::min(frameLatency, latency);
+        }
+    };
 
-    for (uint32_t i = 0; i < maxFrameLag; i++) {
-        writer.bindBuffer(0, &sceneDataBuffers[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        writer.writeSet(forwardPass.descriptors[0 + i]);
+    if (earlyCull) {
+        occlusionCuller.recordEarlyCull(commandBuffer, frameIndex);
+        addLatency(OcclusionCuller::visibilityLatency);
+    }
+    for (auto& pass : asyncComputePasses) {
+        pass.record(commandBuffer, frameIndex);
+        addLatency(pass.frameLatency);
     }
+    CHECK_VKRESULT(vkEndCommandBuffer(commandBuffer));
+
+    // per-slot resources are already free (the CPU waited for the slot), so compute for this frame only waits
+    // for the oldest graphics output it reads and runs while the graphics queue is still busy with the previous frame
+    std::vector<vkw::SemaphoreSubmitInfo> waits;
+    if (frameLatency != 0 && frameNumber > frameLatency) {
+        waits.push_back({ rd->getFrameTimeline(), frameNumber - frameLatency, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT });
+    }
+    const vkw::SemaphoreSubmitInfo signal{ rd->getComputeTimeline(), frameNumber };
+
+    rd->submit(rd->getComputeQueue(), { &commandBuffer, 1 }, waits, { &signal, 1 });
+
+    return true;
 }
 
-void RenderSystem::updateRenderSurfaces() {
-    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-    rd->deviceWaitIdle();
-    cleanupRenderSurfaces();
+void RenderSystem::updateFrameStats(const FrameStats& sample) {
+    accumulatedStats.cpuFrameTime += sample.cpuFrameTime;
+    accumulatedStats.cpuWaitTime += sample.cpuWaitTime;
+    accumulatedStats.gpuFrameTime += sample.gpuFrameTime;
+    accumulatedStats.framesQueued += sample.framesQueued;
+    accumulatedFrames++;
 
-    rd->updateSwapchain(&width, &height);
-    vkw::Swapchain swapChain = rd->getSwapChain();
+    if (accumulatedFrames < statsWindow) {
+        return;
+    }
 
-    const auto color = rd->createTexture(vkw::TEXTURE_2D, { width, height },
-            { swapChain.getFormat(),
-                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                    VK_FILTER_LINEAR,
-                    VK_SAMPLER_ADDRESS_MODE_REPEAT,
-                    rd->getMSAASamples(),
-                    false },
-            0);
+    const float inv = 1.f / static_cast<float>(accumulatedFrames);
+    frameStats.cpuFrameTime = accumulatedStats.cpuFrameTime * inv;
+    frameStats.cpuWaitTime = accumulatedStats.cpuWaitTime * inv;
+    frameStats.gpuFrameTime = accumulatedStats.gpuFrameTime * inv;
+    frameStats.framesQueued = accumulatedStats.framesQueued * inv;
+    frameStats.overlap = frameStats.cpuFrameTime > 0.f ? 1.f - frameStats.cpuWaitTime / frameStats.cpuFrameTime : 0.f;
 
-    vkw::AttachmentInfo attachment{ color };
-    forwardPass.renderTarget.addColorAttachment(attachment);
+    accumulatedStats = {};
+    accumulatedFrames = 0;
 
-    const auto depth = rd->createTexture(vkw::TEXTURE_DEPTH, { width, height },
-            { .samples = rd->getMSAASamples() }, 0);
+    if (reportFrameStats) {
+        std::cout << "INFO::RenderSystem:render: " << framesInFlight << " frames in flight, cpu " << frameStats.cpuFrameTime
+                  << "ms (wait " << frameStats.cpuWaitTime << "ms), gpu " << frameStats.gpuFrameTime << "ms, overlap "
+                  << frameStats.overlap * 100.f << "%, queued " << frameStats.framesQueued << '\n';
+    }
+}
 
-    attachment = vkw::AttachmentInfo{ depth };
-    attachment.loadAction = VK_ATTACHMENT_LOAD_OP_LOAD;
-    attachment.storeAction = VK_ATTACHMENT_STORE_OP_STORE;
-    forwardPass.renderTarget.setDepthStencilAttachment(attachment);
+void RenderSystem::updateDescriptorSets(Scene& scene) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
 
-    attachment = vkw::AttachmentInfo{ depth };
-    depthPrePass.renderTarget.setDepthStencilAttachment(attachment);
+    // per-frame scene data sets are written once in createFrameResources
+    // material sets are per frame slot too, only the slot being recorded is touched and its last frame has retired
+    scene.updateSceneDescriptors(rd->getShader(forwardPass.shader)->layouts[1], frameIndex);
+}
 
-    attachment = vkw::AttachmentInfo{ &swapChain }; // TODO: potential problem? pointer goes out of scope after function
-    attachment.loadAction = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    forwardPass.renderTarget.addColorResolveAttachment(attachment);
+const uint8_t* RenderSystem::getSoftwareVisibility() const {
+    return softwareOcclusionActive ? softwareOcclusion.getVisibility() : nullptr;
+}
 
-    forwardPass.setupRenderPass();
-    depthPrePass.setupRenderPass();
+void RenderSystem::buildRenderGraph() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    renderGraph.reset();
+
+    const RGResourceId backbuffer = renderGraph.importSwapchain("backbuffer");
+    const VkSampleCountFlagBits samples = rd->getMSAASamples();
+    RGResourceId depth = RG_INVALID_RESOURCE;
+
+    if (!occlusionCulling) {
+        renderGraph.addPass("depth", RGPassType::Raster, [&](RenderGraphBuilder& builder) {
+            depth = builder.createTexture("depth", { .format = vkw::Texture::findDepthFormat(), .samples = samples });
+            builder.writeDepth(depth);
+        }, [this](VkCommandBuffer commandBuffer) {
+            vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+            VkPipelineLayout pipelineLayout = rd->getPipelineLayout(depthPrePass.pipelineLayout);
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rd->getPipeline(depthPrePass.pipeline));
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &depthPrePass.descriptors[frameIndex], 0, nullptr);
+
+            Engine::getSingleton()->activeScene.draw(commandBuffer, pipelineLayout, RenderFlag::PositionOnly, 1, getSoftwareVisibility());
+        });
+    } else {
+        // the early cull was submitted to the async compute queue, its visible set goes first
+        // and the pyramid built from that depth decides what else to draw
+        renderGraph.addPass("depth", RGPassType::Raster, [&](RenderGraphBuilder& builder) {
+            depth = builder.createTexture("depth", { .format = vkw::Texture::findDepthFormat(), .samples = samples });
+            builder.writeDepth(depth);
+        }, [this](VkCommandBuffer commandBuffer) {
+            vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+            VkPipelineLayout pipelineLayout = rd->getPipelineLayout(depthPrePass.pipelineLayout);
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rd->getPipeline(depthPrePass.pipeline));
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &depthPrePass.descriptors[frameIndex], 0, nullptr);
+
+            Engine::getSingleton()->activeScene.drawIndirect(commandBuffer, occlusionCuller.getEarlyCommands(), pipelineLayout, RenderFlag::PositionOnly);
+        });
+
+        renderGraph.addPass("hiz", RGPassType::Compute, [&](RenderGraphBuilder& builder) {
+            builder.sample(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            builder.setSideEffect();
+        }, [this](VkCommandBuffer commandBuffer) {
+            occlusionCuller.recordHiZ(commandBuffer, frameIndex);
+        });
+
+        renderGraph.addPass("cull late", RGPassType::Compute, [&](RenderGraphBuilder& builder) {
+            builder.setSideEffect();
+        }, [this](VkCommandBuffer commandBuffer) {
+            occlusionCuller.recordLateCull(commandBuffer, frameIndex);
+        });
+
+        // only writes attachments, so it merges with the forward pass
+        renderGraph.addPass("depth late", RGPassType::Raster, [&](RenderGraphBuilder& builder) {
+            builder.writeDepth(depth, VK_ATTACHMENT_LOAD_OP_LOAD);
+        }, [this](VkCommandBuffer commandBuffer) {
+            vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+            VkPipelineLayout pipelineLayout = rd->getPipelineLayout(depthLatePass.pipelineLayout);
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rd->getPipeline(depthLatePass.pipeline));
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &depthPrePass.descriptors[frameIndex], 0, nullptr);
+
+            Engine::getSingleton()->activeScene.drawIndirect(commandBuffer, occlusionCuller.getLateCommands(), pipelineLayout, RenderFlag::PositionOnly);
+        });
+    }
 
-    const uint32_t imageCount = swapChain.getImageCount();
-    forwardPass.renderTarget.setupFramebuffers(imageCount, { width, height }, forwardPass.renderPass.renderPass);
-    depthPrePass.renderTarget.setupFramebuffers(1, { width, height }, depthPrePass.renderPass.renderPass);
+    renderGraph.addPass("forward", RGPassType::Raster, [&](RenderGraphBuilder& builder) {
+        builder.readDepth(depth);
+        if (samples == VK_SAMPLE_COUNT_1_BIT) {
+            builder.writeColor(backbuffer);
+            return;
+        }
+
+        // multisampled color only lives inside this pass, it ends up transient and never stored
+        const RGResourceId color = builder.createTexture("color", { .format = rd->getSwapChain().getFormat(), .samples = samples });
+        builder.writeColor(color);
+        builder.resolve(color, backbuffer);
+    }, [this](VkCommandBuffer commandBuffer) {
+        vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+        VkPipelineLayout pipelineLayout = rd->getPipelineLayout(forwardPass.pipelineLayout);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rd->getPipeline(forwardPass.pipeline));
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &forwardPass.descriptors[frameIndex], 0, nullptr);
+
+        Scene& scene = Engine::getSingleton()->activeScene;
+        if (occlusionCulling) {
+            scene.drawIndirect(commandBuffer, occlusionCuller.getMainCommands(), pipelineLayout, RenderFlag::BindImages, 1);
+        } else {
+            scene.draw(commandBuffer, pipelineLayout, RenderFlag::BindImages, 1, getSoftwareVisibility());
+        }
+    });
+
+    renderGraph.compile({ width, height });
+
+    // recreated render passes stay compatible with the ones the pipelines were built against as long as the sample count holds
+    // with dynamic rendering the render pass handles stay invalid and pipelines only depend on the formats
+    depthPrePass.renderPass = renderGraph.getRenderPass("depth");
+    depthPrePass.subpass = renderGraph.getSubpass("depth");
+    depthPrePass.renderingFormats = renderGraph.getRenderingFormats("depth");
+    forwardPass.renderPass = renderGraph.getRenderPass("forward");
+    forwardPass.subpass = renderGraph.getSubpass("forward");
+    forwardPass.renderingFormats = renderGraph.getRenderingFormats("forward");
+    if (occlusionCulling) {
+        depthLatePass.renderPass = renderGraph.getRenderPass("depth late");
+        depthLatePass.subpass = renderGraph.getSubpass("depth late");
+        depthLatePass.renderingFormats = renderGraph.getRenderingFormats("depth late");
+        occlusionCuller.resize({ width, height }, renderGraph.getTexture(depth));
+    }
+}
+
+void RenderSystem::updateRenderSurfaces() {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    // surfaces still in use by in-flight frames are released through the deletion queue, no need to drain the GPU
+    cleanupRenderSurfaces();
+
+    rd->updateSwapchain(&width, &height);
+
+    buildRenderGraph();
 
     Engine::getSingleton()->activeScene.getCamera()->updateViewportSize(width, height);
 }
 
 void RenderSystem::cleanupRenderSurfaces() {
-    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-    forwardPass.renderTarget.destroy();
-    rd->destroyRenderPass(forwardPass.renderPass.name);
-
-    depthPrePass.renderTarget.destroy();
-    rd->destroyRenderPass(depthPrePass.renderPass.name);
+    renderGraph.reset();
 }
 
 } //namespace sublimation
\ No newline at end of file
@@ -2,11 +2,16 @@
 
 #include <volk.h>
 
+#include <graphics/occlusion_culler.h>
+#include <graphics/render_graph.h>
+#include <graphics/software_occlusion.h>
 #include <graphics/vulkan/descriptor.h>
 #include <graphics/vulkan/pipeline.h>
-#include <graphics/vulkan/render_target.h>
 
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace sublimation {
@@ -17,16 +22,28 @@ class Texture;
 
 class Scene;
 
-struct DepthPrePass : public vkw::Pipeline {
-    vkw::RenderTarget renderTarget;
+// render passes and attachments of both passes are owned by the render graph
+struct DepthPrePass : public vkw::Pipeline {};
 
-    virtual void setupRenderPass() override;
-};
+struct ForwardPass : public vkw::Pipeline {};
 
-struct ForwardPass : public vkw::Pipeline {
-    vkw::RenderTarget renderTarget;
+// Compute work recorded on the async compute queue ahead of the frame's graphics work
+// the frame's graphics submission waits for it, so results can feed culling, indirect draws and lighting
+struct AsyncComputePass {
+    std::string name;
+    std::function<void(VkCommandBuffer commandBuffer, uint32_t frameIndex)> record;
+    // frames back of the newest graphics output it reads, 0 when it only reads what the CPU wrote
+    // 1 serialises with the previous frame, 2 and up only wait for frames that already left the graphics queue
+    uint32_t frameLatency = 0;
+};
 
-    virtual void setupRenderPass() override;
+// CPU/GPU pacing numbers, averaged over the last statistics window
+struct FrameStats {
+    float cpuFrameTime = 0.f; ///< ms between the starts of consecutive frames
+    float cpuWaitTime = 0.f; ///< ms the CPU blocked on the frame timeline
+    float gpuFrameTime = 0.f; ///< ms between the first and last GPU timestamp of a frame
+    float overlap = 0.f; ///< fraction of the CPU frame spent recording instead of waiting on the GPU
+    float framesQueued = 0.f; ///< frames submitted but not yet retired by the GPU
 };
 
 class RenderSystem {
@@ -42,7 +59,45 @@ public:
     void render();
 
     uint32_t getFrameIndex() const { return frameIndex; }
-    uint32_t getMaxFrameLag() const { return maxFrameLag; }
+    uint64_t getFrameNumber() const { return frameNumber; }
+
+    // takes effect at the start of the next frame, more frames trade latency for throughput
+    void setFramesInFlight(uint32_t count);
+    uint32_t getFramesInFlight() const { return framesInFlight; }
+
+    // render settings take effect at the start of the next frame
+    // 1x renders straight into the swapchain without a resolve
+    void setMSAASamples(VkSampleCountFlagBits samples) {
+        pendingSamples = samples;
+        renderSettingsChanged = true;
+    }
+    // runs the depth pre-pass and forward pass as subpasses of one render pass, depth then never leaves tile memory
+    void setSubpassMerging(bool enable) {
+        subpassMerging = enable;
+        renderSettingsChanged = true;
+    }
+    // records without render pass and framebuffer objects where VK_KHR_dynamic_rendering is available, takes precedence over subpass merging
+    void setDynamicRendering(bool enable) {
+        dynamicRendering = enable;
+        renderSettingsChanged = true;
+    }
+    // culls primitives against the frustum and a Hi-Z pyramid of the depth pre-pass, see OcclusionCuller
+    void setOcclusionCulling(bool enable) {
+        occlusionCulling = enable;
+        renderSettingsChanged = true;
+    }
+    // CPU fallback while GPU occlusion culling is off, runs on the job system alongside the rest of the frame
+    // off by default, takes effect with the next update()
+    void setSoftwareOcclusionCulling(bool enable) { softwareOcclusionCulling = enable; }
+    // largest screen space error in pixels a simplified level of detail may have, 0 always draws full detail
+    void setLodPixelThreshold(float pixels) { lodPixelThreshold = pixels; }
+    // device memory streamed texture mips may take, textures drawn least recently drop their finest levels beyond it
+    void setTextureBudget(VkDeviceSize bytes) { textureBudget = bytes; }
+
+    void addAsyncComputePass(AsyncComputePass&& pass);
+
+    const FrameStats& getFrameStats() const { return frameStats; }
+    void setFrameStatsReporting(bool enable) { reportFrameStats = enable; }
 
 private:
     void loadShaders();
@@ -50,31 +105,72 @@ private:
     void createDescriptors();
     void createPipelines();
     void createSyncObjects();
+    void createFrameResources();
+    void destroyFrameResources();
+    void applyFramesInFlight();
+    void applyRenderSettings();
+
+    bool submitAsyncCompute();
+
+    void updateFrameStats(const FrameStats& sample);
 
-    // called when scene changes - descriptor sets
+    // writes the material sets of the current frame slot the scene changed since it was last recorded
     void updateDescriptorSets(Scene& scene);
 
+    // declares the frame's passes and resources and compiles them for the current surface size
+    void buildRenderGraph();
+    // per drawIndex results of the software culler for the non GPU culled draws, nullptr draws everything
+    const uint8_t* getSoftwareVisibility() const;
+
     // called every time frame size changes
     void updateRenderSurfaces();
     void cleanupRenderSurfaces();
 
     uint32_t width = 1920;
     uint32_t height = 1080;
-    const uint32_t maxFrameLag = 2;
+    uint32_t framesInFlight = 2;
+    uint32_t pendingFramesInFlight = 0;
+    VkSampleCountFlagBits pendingSamples = static_cast<VkSampleCountFlagBits>(0);
+    bool subpassMerging = true;
+    bool dynamicRendering = false;
+    bool occlusionCulling = true;
+    bool softwareOcclusionCulling = false;
+    bool softwareOcclusionActive = false; ///< software culling was started by this frame's update()
+    float lodPixelThreshold = 1.f;
+    VkDeviceSize textureBudget = 1ull << 30;
+    vkw::VertexFormat vertexFormat = vkw::VertexFormat::Float;
+    bool renderSettingsChanged = false;
     bool windowResized = false;
 
-    uint32_t frameIndex = 0;
-    uint32_t currentBuffer = 0;
+    uint32_t frameIndex = 0; ///< slot of the frame being recorded, frameNumber % framesInFlight
+    uint64_t frameNumber = 0; ///< value the frame timeline reaches once this frame is done
 
     ForwardPass forwardPass;
     DepthPrePass depthPrePass;
+    DepthPrePass depthLatePass; ///< shares shader, layout and descriptors with depthPrePass, only the render pass differs
+    OcclusionCuller occlusionCuller;
+    SoftwareOcclusion softwareOcclusion;
+    RenderGraph renderGraph;
 
     // Resources
-    std::vector<vkw::UniformBuffer> sceneDataBuffers;
+    std::vector<vkw::BufferHandle> sceneDataBuffers;
+
+    std::vector<AsyncComputePass> asyncComputePasses;
 
+    // binary semaphores are still needed for the swapchain, frame completion goes through the device's frame timeline
     std::vector<VkSemaphore> presentCompleteSemaphores;
     std::vector<VkSemaphore> renderCompleteSemaphores;
-    std::vector<VkFence> inFlightFences;
+
+    // Frame statistics
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE; ///< 2 timestamps per frame slot
+    std::vector<bool> timestampsWritten;
+    float timestampPeriod = 1.f;
+    std::chrono::steady_clock::time_point lastFrameStart;
+    FrameStats frameStats;
+    FrameStats accumulatedStats;
+    uint32_t accumulatedFrames = 0;
+    uint32_t statsWindow = 120;
+    bool reportFrameStats = false;
 };
 
 } //namespace sublimation
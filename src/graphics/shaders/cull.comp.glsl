@@ -0,0 +1,148 @@
+#version 450
+
+layout (local_size_x = 64) in;
+
+struct DrawData {
+    vec4 boundsMin;
+    vec4 boundsMax;
+    vec4 coneApex;
+    vec4 coneAxis; ///< w is the cutoff, 1 disables the test
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint pad0;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout (set = 0, binding = 0) uniform CullData {
+    mat4 viewProjection;
+    vec4 frustumPlanes[6];
+    vec4 cameraPosition;
+    vec2 hizSize;
+    uint drawCount;
+    uint hizLevels;
+} cull;
+
+layout (std430, set = 0, binding = 1) readonly buffer DrawDataBuffer {
+    DrawData draws[];
+};
+
+// 1 if the cluster passed the late test two frames ago, double buffered so the early phase can run on
+// the async compute queue while the previous frame still writes the other buffer
+layout (std430, set = 0, binding = 2) buffer VisibilityBuffer {
+    uint visibility[];
+};
+
+layout (std430, set = 0, binding = 3) writeonly buffer EarlyCommands {
+    DrawCommand earlyCommands[];
+};
+
+layout (std430, set = 0, binding = 4) writeonly buffer LateCommands {
+    DrawCommand lateCommands[];
+};
+
+layout (std430, set = 0, binding = 5) writeonly buffer MainCommands {
+    DrawCommand mainCommands[];
+};
+
+layout (set = 0, binding = 6) uniform sampler2D hiz;
+
+layout (push_constant) uniform PushConstants {
+    uint phase; ///< 0 = early, 1 = late
+} pc;
+
+bool isInFrustum(vec3 boundsMin, vec3 boundsMax) {
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = cull.frustumPlanes[i];
+        // corner farthest along the plane normal
+        vec3 corner = mix(boundsMin, boundsMax, greaterThan(plane.xyz, vec3(0.0)));
+        if (dot(plane.xyz, corner) + plane.w < 0.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// every triangle of the cluster faces away from the camera
+bool isBackfacing(vec3 coneApex, vec4 coneAxis) {
+    return coneAxis.w < 1.0 && dot(normalize(coneApex - cull.cameraPosition.xyz), coneAxis.xyz) >= coneAxis.w;
+}
+
+bool isOccluded(vec3 boundsMin, vec3 boundsMax) {
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearest = 1.0;
+
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = vec3((i & 1) != 0 ? boundsMax.x : boundsMin.x,
+                (i & 2) != 0 ? boundsMax.y : boundsMin.y,
+                (i & 4) != 0 ? boundsMax.z : boundsMin.z);
+        vec4 clip = cull.viewProjection * vec4(corner, 1.0);
+        // crosses the near plane, the screen rectangle is unbounded
+        if (clip.w <= 0.0) {
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearest = min(nearest, ndc.z);
+    }
+
+    uvMin = clamp(uvMin, vec2(0.0), vec2(1.0));
+    uvMax = clamp(uvMax, vec2(0.0), vec2(1.0));
+
+    // level at which the rectangle spans at most 2x2 texels
+    vec2 size = (uvMax - uvMin) * cull.hizSize;
+    int level = int(ceil(log2(max(max(size.x, size.y), 1.0))));
+    level = min(level, int(cull.hizLevels) - 1);
+
+    ivec2 levelSize = textureSize(hiz, level);
+    ivec2 t0 = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 t1 = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float depth = max(max(texelFetch(hiz, t0, level).r, texelFetch(hiz, ivec2(t1.x, t0.y), level).r),
+            max(texelFetch(hiz, ivec2(t0.x, t1.y), level).r, texelFetch(hiz, t1, level).r));
+
+    return nearest > depth;
+}
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= cull.drawCount) {
+        return;
+    }
+
+    DrawData draw = draws[id];
+    DrawCommand command = DrawCommand(draw.indexCount, 0u, draw.firstIndex, draw.vertexOffset, 0u);
+
+    bool inFrustum = isInFrustum(draw.boundsMin.xyz, draw.boundsMax.xyz) && !isBackfacing(draw.coneApex.xyz, draw.coneAxis);
+    // visible two frames ago, drawn before the pyramid exists
+    bool drawnEarly = inFrustum && visibility[id] != 0;
+
+    if (pc.phase == 0) {
+        command.instanceCount = drawnEarly ? 1u : 0u;
+        earlyCommands[id] = command;
+        return;
+    }
+
+    bool visible = inFrustum && !isOccluded(draw.boundsMin.xyz, draw.boundsMax.xyz);
+
+    // newly visible clusters complete the depth buffer, shading covers both sets
+    command.instanceCount = (visible && !drawnEarly) ? 1u : 0u;
+    lateCommands[id] = command;
+    command.instanceCount = (visible || drawnEarly) ? 1u : 0u;
+    mainCommands[id] = command;
+
+    visibility[id] = visible ? 1u : 0u;
+}
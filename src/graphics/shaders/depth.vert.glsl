@@ -10,13 +10,14 @@ layout (set = 0, binding = 0) uniform GlobalUniforms {
 
 layout (push_constant) uniform PushConstants {
     mat4 model;
+    vec4 positionOffset;
+    vec4 positionScale;
 } meshConstants;
 
+// only the position stream is bound in depth passes, unorm16 relative to the mesh bounds when packed
 layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec3 inNormal;
-layout (location = 2) in vec2 inTexCoord;
-layout (location = 3) in vec3 inTangent;
 
 void main() {
-    gl_Position = ubo.projection * ubo.view * meshConstants.model * vec4(inPos, 1.0);
+    vec3 position = meshConstants.positionOffset.xyz + inPos * meshConstants.positionScale.xyz;
+    gl_Position = ubo.projection * ubo.view * meshConstants.model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -16,26 +16,29 @@ layout (set = 0, binding = 0) uniform GlobalUniforms {
 
     uint pad0;
     uint pad1;
-} ubo;
 
-layout (set = 0, binding = 1) uniform DirectionalLight {
-    vec4 direction;
-    vec4 colori;
-} directionalLight;
+    vec4 lightDirection;
+    vec4 lightColor;
+    float lightIntensity;
+} ubo;
 
 layout (set = 1, binding = 0) uniform MaterialAux {
+    vec4 albedoFactor;
+    vec4 ormFactor;
+
     uint normalMapMode;
     uint roughnessGlossyMode;
+    uint textureMask; // MaterialTexture bits, slots without one use the factor and are bound to a placeholder
 
     uint pad0;
-    uint pad1;
 } aux;
 
+const uint ALBEDO_TEXTURE = 0x1;
+const uint ORM_TEXTURE = 0x2;
+
 layout (set = 1, binding = 1) uniform sampler2D albedoSampler;
-layout (set = 1, binding = 2) uniform sampler2D metallicSampler;
-layout (set = 1, binding = 3) uniform sampler2D roughnessSampler;
-layout (set = 1, binding = 4) uniform sampler2D ambientSampler;
-layout (set = 1, binding = 5) uniform sampler2D normalSampler;
+layout (set = 1, binding = 2) uniform sampler2D ormSampler; // occlusion, roughness, metallic in r, g, b
+layout (set = 1, binding = 3) uniform sampler2D normalSampler;
 
 const float PI = 3.14159265359;
 
@@ -55,17 +58,20 @@ float linearDepth(float depth) {
 
 void main() {
     vec3 N = normalize(fragNormal);
-    vec3 V = normalize(ubo.camPos - fragPos);
+    vec3 V = normalize(ubo.camPos.xyz - fragPos);
 
-    vec3 albedo = texture(albedoSampler, fragTexCoord).rgb;
-    float metallic = texture(metallicSampler, fragTexCoord).b;
-    float roughness = texture(roughnessSampler, fragTexCoord).g;
-    roughness = aux.roughnessGlossyMode == 1 ? 1 - roughness : roughness;
-    float ao = texture(ambientSampler, fragTexCoord).r;
+    // albedo is sampled from an sRGB image, the other material values come packed in one fetch
+    // the mask is the same for the whole draw, so constant slots skip their fetch without divergence
+    vec3 albedo = (aux.textureMask & ALBEDO_TEXTURE) != 0 ? texture(albedoSampler, fragTexCoord).rgb : aux.albedoFactor.rgb;
+    vec3 orm = (aux.textureMask & ORM_TEXTURE) != 0 ? texture(ormSampler, fragTexCoord).rgb : aux.ormFactor.rgb;
+    float ao = orm.r;
+    float roughness = aux.roughnessGlossyMode == 1 ? 1 - orm.g : orm.g;
+    float metallic = orm.b;
 
     if (aux.normalMapMode == 1) {
-        N = texture(normalSampler, fragTexCoord).rgb;
-        N = N * 2.0 - 1.0;
+        // z is rebuilt from x and y, so two channel (BC5) maps read the same as three channel ones
+        vec2 xy = texture(normalSampler, fragTexCoord).rg * 2.0 - 1.0;
+        N = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
         N = normalize(TBN * N);
     }
 
@@ -76,10 +82,10 @@ void main() {
 
     // Directional light
     {
-        vec3 L = normalize(-directionalLight.direction.xyz);
+        vec3 L = normalize(-ubo.lightDirection.xyz);
         vec3 H = normalize(V + L);
         // skip attenuation
-        vec3 radiance = directionalLight.colori.rgb * directionalLight.colori.a;
+        vec3 radiance = ubo.lightColor.rgb * ubo.lightIntensity;
 
         float NDF = distributionGGX(N, H, roughness);
         float G = geometrySmith(N, V, L, roughness);
@@ -10,9 +10,14 @@ layout (set = 0, binding = 0) uniform GlobalUniforms {
 
 layout (push_constant) uniform PushConstants {
     mat4 model;
+    vec4 positionOffset;
+    vec4 positionScale;
 } meshConstants;
 
-layout (location = 0) in vec3 inPos;
+// packed vertices carry unorm16 positions, octahedral normals and tangents, and the bitangent sign in inPos.w
+layout (constant_id = 0) const bool packedVertices = false;
+
+layout (location = 0) in vec4 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inTexCoord;
 layout (location = 3) in vec3 inTangent;
@@ -22,20 +27,29 @@ layout (location = 1) out vec3 fragNormal;
 layout (location = 2) out vec2 fragTexCoord;
 layout (location = 3) out mat3 TBN;
 
+vec3 octahedralDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+    return normalize(v);
+}
+
 void main() {
-    gl_Position = ubo.projection * ubo.view * meshConstants.model * vec4(inPos, 1.0);
-    fragPos = vec3(meshConstants.model * vec4(inPos, 1.0));
-    fragNormal = vec3(mat4(mat3(meshConstants.model)) * vec4(inNormal, 1.0));
+    // offset 0 and scale 1 for float vertices, whose missing w reads as 1
+    vec3 position = meshConstants.positionOffset.xyz + inPos.xyz * meshConstants.positionScale.xyz;
+    vec3 normal = packedVertices ? octahedralDecode(inNormal.xy) : inNormal;
+    vec3 tangent = packedVertices ? octahedralDecode(inTangent.xy) : inTangent;
+    float bitangentSign = inPos.w * 2.0 - 1.0;
+
+    gl_Position = ubo.projection * ubo.view * meshConstants.model * vec4(position, 1.0);
+    fragPos = vec3(meshConstants.model * vec4(position, 1.0));
+    fragNormal = vec3(mat4(mat3(meshConstants.model)) * vec4(normal, 1.0));
     fragTexCoord = inTexCoord;
 
-    camPos = ubo.camPos.xyz;
-    camNear = ubo.camNear;
-    camFar = ubo.camFar;
-
-    vec3 T = normalize(vec3(meshConstants.model * vec4(inTangent, 0.0)));
-    vec3 N = normalize(vec3(meshConstants.model * vec4(inNormal, 0.0)));
+    vec3 T = normalize(vec3(meshConstants.model * vec4(tangent, 0.0)));
+    vec3 N = normalize(vec3(meshConstants.model * vec4(normal, 0.0)));
 
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
+    vec3 B = cross(N, T) * bitangentSign;
     TBN = mat3(T, B, N);
 }
\ No newline at end of file
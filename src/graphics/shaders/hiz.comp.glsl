@@ -0,0 +1,34 @@
+#version 450
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// depth for the first level, the previous pyramid level for the others
+layout (set = 0, binding = 0) uniform sampler2D srcDepth;
+layout (set = 0, binding = 1, r32f) uniform writeonly image2D dstDepth;
+
+layout (push_constant) uniform PushConstants {
+    ivec2 srcSize;
+    ivec2 dstSize;
+    int sampleCount;
+} pc;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, pc.dstSize))) {
+        return;
+    }
+
+    // source texels covered by this one, up to 3x3 for odd and non power of two sizes
+    ivec2 begin = (texel * pc.srcSize) / pc.dstSize;
+    ivec2 end = min(((texel + 1) * pc.srcSize + pc.dstSize - 1) / pc.dstSize, pc.srcSize);
+
+    // farthest depth, anything behind it is hidden over the whole texel
+    float depth = 0.0;
+    for (int y = begin.y; y < end.y; y++) {
+        for (int x = begin.x; x < end.x; x++) {
+            depth = max(depth, texelFetch(srcDepth, ivec2(x, y), 0).r);
+        }
+    }
+
+    imageStore(dstDepth, texel, vec4(depth));
+}
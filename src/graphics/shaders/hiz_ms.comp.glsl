@@ -0,0 +1,35 @@
+#version 450
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// first pyramid level from multisampled depth
+layout (set = 0, binding = 0) uniform sampler2DMS srcDepth;
+layout (set = 0, binding = 1, r32f) uniform writeonly image2D dstDepth;
+
+layout (push_constant) uniform PushConstants {
+    ivec2 srcSize;
+    ivec2 dstSize;
+    int sampleCount;
+} pc;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, pc.dstSize))) {
+        return;
+    }
+
+    ivec2 begin = (texel * pc.srcSize) / pc.dstSize;
+    ivec2 end = min(((texel + 1) * pc.srcSize + pc.dstSize - 1) / pc.dstSize, pc.srcSize);
+
+    // every sample counts, a pixel is only as close as its farthest sample
+    float depth = 0.0;
+    for (int y = begin.y; y < end.y; y++) {
+        for (int x = begin.x; x < end.x; x++) {
+            for (int s = 0; s < pc.sampleCount; s++) {
+                depth = max(depth, texelFetch(srcDepth, ivec2(x, y), s).r);
+            }
+        }
+    }
+
+    imageStore(dstDepth, texel, vec4(depth));
+}
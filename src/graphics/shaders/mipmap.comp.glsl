@@ -0,0 +1,61 @@
+#version 450
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// level the pass starts from, bilinear at the centre of a texel one level down averages the 2x2 texels under it
+layout (set = 0, binding = 0) uniform sampler2D src;
+// the next levelCount levels, unused ones are bound to the last level, formats come from the views
+layout (set = 0, binding = 1) uniform writeonly image2D dst0;
+layout (set = 0, binding = 2) uniform writeonly image2D dst1;
+layout (set = 0, binding = 3) uniform writeonly image2D dst2;
+layout (set = 0, binding = 4) uniform writeonly image2D dst3;
+
+layout (push_constant) uniform PushConstants {
+    uint levelCount;
+    uint srgb; // the storage views are UNORM aliases of an sRGB image, filtering stays linear and stores are encoded
+} pc;
+
+shared vec4 tile[8][8];
+
+vec3 linearToSrgb(vec3 color) {
+    return mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, greaterThan(color, vec3(0.0031308)));
+}
+
+void store(uint level, ivec2 texel, vec4 color) {
+    if (pc.srgb != 0) {
+        color.rgb = linearToSrgb(color.rgb);
+    }
+
+    if (level == 0 && all(lessThan(texel, imageSize(dst0)))) {
+        imageStore(dst0, texel, color);
+    } else if (level == 1 && all(lessThan(texel, imageSize(dst1)))) {
+        imageStore(dst1, texel, color);
+    } else if (level == 2 && all(lessThan(texel, imageSize(dst2)))) {
+        imageStore(dst2, texel, color);
+    } else if (level == 3 && all(lessThan(texel, imageSize(dst3)))) {
+        imageStore(dst3, texel, color);
+    }
+}
+
+void main() {
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+
+    vec4 color = textureLod(src, (vec2(texel) + 0.5) / vec2(imageSize(dst0)), 0.0);
+    store(0, texel, color);
+    tile[local.y][local.x] = color;
+
+    // every further level keeps a quarter of the threads, each averages its 2x2 block of the level before
+    for (uint level = 1; level < pc.levelCount; level++) {
+        memoryBarrierShared();
+        barrier();
+
+        int stride = 1 << level;
+        int gap = stride >> 1;
+        if (local.x % stride == 0 && local.y % stride == 0) {
+            color = 0.25 * (tile[local.y][local.x] + tile[local.y][local.x + gap] + tile[local.y + gap][local.x] + tile[local.y + gap][local.x + gap]);
+            tile[local.y][local.x] = color;
+            store(level, ivec2(gl_WorkGroupID.xy) * (8 >> level) + local / stride, color);
+        }
+    }
+}
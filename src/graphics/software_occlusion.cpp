@@ -0,0 +1,325 @@
+#include <graphics/software_occlusion.h>
+
+#include <scene/scene.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace sublimation {
+
+namespace {
+
+// one row segment of pixels per iteration, picked at compile time
+#if defined(__AVX2__)
+struct Lanes {
+    static constexpr uint32_t count = 8;
+    using Float = __m256;
+    using Mask = __m256;
+
+    static Float set(float value) { return _mm256_set1_ps(value); }
+    static Float ramp() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+    static Float load(const float* source) { return _mm256_loadu_ps(source); }
+    static void store(float* destination, Float value) { _mm256_storeu_ps(destination, value); }
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    static Mask greaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Float select(Float a, Float b, Mask mask) { return _mm256_blendv_ps(a, b, mask); }
+    static bool any(Mask mask) { return _mm256_movemask_ps(mask) != 0; }
+};
+#elif defined(__SSE2__) || defined(_M_X64)
+struct Lanes {
+    static constexpr uint32_t count = 4;
+    using Float = __m128;
+    using Mask = __m128;
+
+    static Float set(float value) { return _mm_set1_ps(value); }
+    static Float ramp() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+    static Float load(const float* source) { return _mm_loadu_ps(source); }
+    static void store(float* destination, Float value) { _mm_storeu_ps(destination, value); }
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+    static Mask greaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+    // no blendv before SSE4.1
+    static Float select(Float a, Float b, Mask mask) { return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b)); }
+    static bool any(Mask mask) { return _mm_movemask_ps(mask) != 0; }
+};
+#else
+struct Lanes {
+    static constexpr uint32_t count = 1;
+    using Float = float;
+    using Mask = bool;
+
+    static Float set(float value) { return value; }
+    static Float ramp() { return 0.f; }
+    static Float load(const float* source) { return *source; }
+    static void store(float* destination, Float value) { *destination = value; }
+    static Float add(Float a, Float b) { return a + b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Float min(Float a, Float b) { return std::min(a, b); }
+    static Mask greaterEqual(Float a, Float b) { return a >= b; }
+    static Mask both(Mask a, Mask b) { return a && b; }
+    static Float select(Float a, Float b, Mask mask) { return mask ? b : a; }
+    static bool any(Mask mask) { return mask; }
+};
+#endif
+
+static_assert(SoftwareOcclusion::width % Lanes::count == 0, "rows have to be a whole number of lane groups");
+
+constexpr float MIN_CLIP_W = 1e-5f;
+
+} //namespace
+
+void SoftwareOcclusion::begin(const Scene& scene, const glm::mat4& viewProjection) {
+    JobSystem* jobSystem = JobSystem::getSingleton();
+
+    // results of a frame that never called finish() are dropped
+    jobSystem->wait(context);
+    ready = false;
+
+    this->viewProjection = viewProjection;
+    candidates.clear();
+    scene.getOccluders(candidates);
+    drawData.resize(scene.getPrimitiveCount());
+    scene.getDrawData(drawData);
+    visibility.assign(drawData.size(), 1);
+
+    jobSystem->execute(context, [this]() { run(); });
+}
+
+const uint8_t* SoftwareOcclusion::finish() {
+    JobSystem::getSingleton()->wait(context);
+    ready = true;
+
+    return visibility.data();
+}
+
+void SoftwareOcclusion::run() {
+    JobSystem* jobSystem = JobSystem::getSingleton();
+    JobContext phase;
+
+    selectOccluders();
+    jobSystem->dispatch(phase, static_cast<uint32_t>(occluders.size()), 1, [this](JobArgs args) { setupTriangles(args.jobIndex); });
+    jobSystem->wait(phase);
+
+    // bands don't share pixels, so they rasterise without synchronisation
+    std::fill(depth.begin(), depth.end(), 1.f);
+    jobSystem->dispatch(phase, height / bandHeight, 1, [this](JobArgs args) { rasterizeBand(args.jobIndex); });
+    jobSystem->wait(phase);
+
+    jobSystem->dispatch(phase, static_cast<uint32_t>(drawData.size()), 64, [this](JobArgs args) { testBounds(args.jobIndex); });
+    jobSystem->wait(phase);
+
+    culledCount = static_cast<uint32_t>(std::count(visibility.begin(), visibility.end(), 0));
+}
+
+void SoftwareOcclusion::selectOccluders() {
+    // largest on screen first, approximated by bounding radius over distance
+    std::vector<std::pair<float, uint32_t>> scores;
+    scores.reserve(candidates.size());
+    for (uint32_t i = 0; i < candidates.size(); i++) {
+        const AABB& bounds = candidates[i].bounds;
+        const glm::vec4 clip = viewProjection * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.f);
+        const float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+        scores.emplace_back(radius / std::max(clip.w, MIN_CLIP_W), i);
+    }
+    std::sort(scores.begin(), scores.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    occluders.clear();
+    triangleOffsets.clear();
+    uint32_t triangleCount = 0;
+    for (const auto& [score, index] : scores) {
+        const uint32_t count = candidates[index].indexCount / 3;
+        if (occluders.size() == maxOccluders || triangleCount + count > maxOccluderTriangles) {
+            continue;
+        }
+
+        occluders.push_back(candidates[index]);
+        triangleOffsets.push_back(triangleCount);
+        triangleCount += count;
+    }
+
+    triangles.resize(triangleCount);
+}
+
+void SoftwareOcclusion::setupTriangles(uint32_t occluderIndex) {
+    const Occluder& occluder = occluders[occluderIndex];
+    const glm::mat4 modelViewProjection = viewProjection * occluder.model;
+    const uint32_t first = triangleOffsets[occluderIndex];
+
+    for (uint32_t t = 0; t < occluder.indexCount / 3; t++) {
+        ScreenTriangle& triangle = triangles[first + t];
+        // empty until it passes setup
+        triangle.minY = 1;
+        triangle.maxY = 0;
+
+        glm::vec3 screen[3];
+        bool clipped = false;
+        for (uint32_t k = 0; k < 3; k++) {
+            const glm::vec4 clip = modelViewProjection * glm::vec4(occluder.vertices[occluder.indices[3 * t + k]], 1.f);
+            // crosses the near plane, leaving out occluder triangles is always safe
+            if (clip.w <= MIN_CLIP_W) {
+                clipped = true;
+                break;
+            }
+
+            const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen[k] = { (ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z };
+        }
+        if (clipped) {
+            continue;
+        }
+
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+        if (std::abs(area) < 1e-6f) {
+            continue;
+        }
+        const float orientation = area > 0.f ? 1.f : -1.f;
+        area *= orientation;
+
+        // edge e runs from vertex e to e + 1, its value over the area is the weight of the opposite vertex
+        triangle.depthA = triangle.depthB = triangle.depthC = 0.f;
+        for (uint32_t e = 0; e < 3; e++) {
+            const glm::vec3& p = screen[e];
+            const glm::vec3& q = screen[(e + 1) % 3];
+            const float a = (p.y - q.y) * orientation;
+            const float b = (q.x - p.x) * orientation;
+            const float c = -(a * p.x + b * p.y);
+            const float opposite = screen[(e + 2) % 3].z;
+
+            triangle.depthA += a * opposite / area;
+            triangle.depthB += b * opposite / area;
+            triangle.depthC += c * opposite / area;
+
+            // the pixel corner farthest inside the edge has to pass too
+            triangle.edgeA[e] = a;
+            triangle.edgeB[e] = b;
+            triangle.edgeC[e] = c - 0.5f * (std::abs(a) + std::abs(b));
+        }
+        triangle.depthC += 0.5f * (std::abs(triangle.depthA) + std::abs(triangle.depthB));
+        triangle.maxDepth = std::max({ screen[0].z, screen[1].z, screen[2].z });
+
+        const glm::vec3 lower = glm::min(glm::min(screen[0], screen[1]), screen[2]);
+        const glm::vec3 upper = glm::max(glm::max(screen[0], screen[1]), screen[2]);
+        triangle.minX = std::max(static_cast<int32_t>(std::floor(lower.x)), 0);
+        triangle.maxX = std::min(static_cast<int32_t>(std::ceil(upper.x)) - 1, static_cast<int32_t>(width) - 1);
+        triangle.minY = std::max(static_cast<int32_t>(std::floor(lower.y)), 0);
+        triangle.maxY = std::min(static_cast<int32_t>(std::ceil(upper.y)) - 1, static_cast<int32_t>(height) - 1);
+        if (triangle.minX > triangle.maxX) {
+            triangle.minY = 1;
+            triangle.maxY = 0;
+        }
+    }
+}
+
+void SoftwareOcclusion::rasterizeBand(uint32_t band) {
+    const int32_t bandMin = static_cast<int32_t>(band * bandHeight);
+    const int32_t bandMax = bandMin + static_cast<int32_t>(bandHeight) - 1;
+    const Lanes::Float ramp = Lanes::ramp();
+
+    for (const auto& triangle : triangles) {
+        const int32_t y0 = std::max(triangle.minY, bandMin);
+        const int32_t y1 = std::min(triangle.maxY, bandMax);
+        if (y0 > y1) {
+            continue;
+        }
+
+        const int32_t x0 = triangle.minX - triangle.minX % static_cast<int32_t>(Lanes::count);
+        const Lanes::Float maxDepth = Lanes::set(triangle.maxDepth);
+
+        for (int32_t y = y0; y <= y1; y++) {
+            const float py = static_cast<float>(y) + 0.5f;
+            float* row = depth.data() + y * width;
+
+            // per row constants, only x varies across lanes
+            Lanes::Float rowEdge[3];
+            Lanes::Float edgeA[3];
+            for (uint32_t e = 0; e < 3; e++) {
+                rowEdge[e] = Lanes::set(triangle.edgeB[e] * py + triangle.edgeC[e]);
+                edgeA[e] = Lanes::set(triangle.edgeA[e]);
+            }
+            const Lanes::Float rowDepth = Lanes::set(triangle.depthB * py + triangle.depthC);
+            const Lanes::Float depthA = Lanes::set(triangle.depthA);
+            const Lanes::Float zero = Lanes::set(0.f);
+
+            for (int32_t x = x0; x <= triangle.maxX; x += Lanes::count) {
+                const Lanes::Float px = Lanes::add(Lanes::set(static_cast<float>(x) + 0.5f), ramp);
+
+                Lanes::Mask inside = Lanes::greaterEqual(Lanes::add(Lanes::mul(edgeA[0], px), rowEdge[0]), zero);
+                inside = Lanes::both(inside, Lanes::greaterEqual(Lanes::add(Lanes::mul(edgeA[1], px), rowEdge[1]), zero));
+                inside = Lanes::both(inside, Lanes::greaterEqual(Lanes::add(Lanes::mul(edgeA[2], px), rowEdge[2]), zero));
+
+                const Lanes::Float z = Lanes::min(Lanes::add(Lanes::mul(depthA, px), rowDepth), maxDepth);
+                const Lanes::Float current = Lanes::load(row + x);
+                Lanes::store(row + x, Lanes::select(current, Lanes::min(current, z), inside));
+            }
+        }
+    }
+}
+
+void SoftwareOcclusion::testBounds(uint32_t drawIndex) {
+    const GpuDrawData& draw = drawData[drawIndex];
+
+    glm::vec2 lower{ FLT_MAX };
+    glm::vec2 upper{ -FLT_MAX };
+    float nearest = FLT_MAX;
+    for (uint32_t i = 0; i < 8; i++) {
+        const glm::vec3 corner{ (i & 1) ? draw.boundsMax.x : draw.boundsMin.x,
+            (i & 2) ? draw.boundsMax.y : draw.boundsMin.y,
+            (i & 4) ? draw.boundsMax.z : draw.boundsMin.z };
+        const glm::vec4 clip = viewProjection * glm::vec4(corner, 1.f);
+        // crosses the near plane, the screen rectangle is unbounded
+        if (clip.w <= MIN_CLIP_W) {
+            return;
+        }
+
+        const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        const glm::vec2 screen{ (ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height };
+        lower = glm::min(lower, screen);
+        upper = glm::max(upper, screen);
+        nearest = std::min(nearest, ndc.z);
+    }
+
+    // off screen or past the far plane
+    if (upper.x <= 0.f || upper.y <= 0.f || lower.x >= width || lower.y >= height || nearest > 1.f) {
+        visibility[drawIndex] = 0;
+        return;
+    }
+
+    const int32_t x0 = std::max(static_cast<int32_t>(std::floor(lower.x)), 0);
+    const int32_t x1 = std::min(static_cast<int32_t>(std::ceil(upper.x)) - 1, static_cast<int32_t>(width) - 1);
+    const int32_t y0 = std::max(static_cast<int32_t>(std::floor(lower.y)), 0);
+    const int32_t y1 = std::min(static_cast<int32_t>(std::ceil(upper.y)) - 1, static_cast<int32_t>(height) - 1);
+
+    // visible as soon as one pixel of the rectangle is not closer than the box
+    const Lanes::Float ramp = Lanes::ramp();
+    const Lanes::Float boxDepth = Lanes::set(nearest);
+    const Lanes::Float first = Lanes::set(static_cast<float>(x0));
+    const Lanes::Float last = Lanes::set(static_cast<float>(x1));
+    const int32_t xStart = x0 - x0 % static_cast<int32_t>(Lanes::count);
+
+    for (int32_t y = y0; y <= y1; y++) {
+        const float* row = depth.data() + y * width;
+        for (int32_t x = xStart; x <= x1; x += Lanes::count) {
+            const Lanes::Float px = Lanes::add(Lanes::set(static_cast<float>(x)), ramp);
+            const Lanes::Mask inRect = Lanes::both(Lanes::greaterEqual(px, first), Lanes::greaterEqual(last, px));
+            if (Lanes::any(Lanes::both(inRect, Lanes::greaterEqual(Lanes::load(row + x), boxDepth)))) {
+                return;
+            }
+        }
+    }
+
+    visibility[drawIndex] = 0;
+}
+
+} //namespace sublimation
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <core/job_system.h>
+#include <scene/model.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace sublimation {
+
+class Scene;
+
+// Software occlusion culling for when the GPU culling path is off
+// the largest occluders on screen are rasterised on the CPU into a low resolution depth buffer (SSE2, AVX2 when
+// built with SUBLIMATION_USE_AVX2), then every primitive's bounds are tested against it.
+// Both steps stay conservative: a pixel only takes an occluder's depth if the triangle covers it completely,
+// and that depth is the farthest the triangle gets within the pixel.
+// The work runs on the job system between begin() and finish(), the main thread keeps going in the meantime
+class SoftwareOcclusion {
+public:
+    static constexpr uint32_t width = 256;
+    static constexpr uint32_t height = 128;
+    static constexpr uint32_t bandHeight = 16; ///< rows rasterised per job
+    static constexpr uint32_t maxOccluders = 32;
+    static constexpr uint32_t maxOccluderTriangles = 8192; ///< per frame, over all selected occluders
+
+    SoftwareOcclusion() = default;
+
+    // snapshots the scene's bounds and occluders, the model must stay loaded until finish()
+    void begin(const Scene& scene, const glm::mat4& viewProjection);
+    // waits for the jobs, a zero entry at a primitive's drawIndex means it is hidden or off screen
+    const uint8_t* finish();
+    const uint8_t* getVisibility() const { return ready ? visibility.data() : nullptr; }
+
+    uint32_t getCulledCount() const { return culledCount; }
+
+private:
+    struct ScreenTriangle {
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3]; ///< offset so the edge test passes only for fully covered pixels
+        float depthA;
+        float depthB;
+        float depthC; ///< offset to the farthest depth within a pixel
+        float maxDepth;
+        int32_t minX, maxX, minY, maxY;
+    };
+
+    void run();
+    void selectOccluders();
+    void setupTriangles(uint32_t occluderIndex);
+    void rasterizeBand(uint32_t band);
+    void testBounds(uint32_t drawIndex);
+
+    glm::mat4 viewProjection{ 1.f };
+    std::vector<Occluder> candidates;
+    std::vector<Occluder> occluders;
+    std::vector<uint32_t> triangleOffsets; ///< first triangle of each occluder in triangles
+    std::vector<ScreenTriangle> triangles;
+    std::vector<GpuDrawData> drawData;
+
+    std::vector<float> depth = std::vector<float>(width * height);
+    std::vector<uint8_t> visibility;
+    uint32_t culledCount = 0;
+
+    JobContext context;
+    bool ready = false;
+};
+
+} //namespace sublimation
@@ -7,7 +7,7 @@ namespace sublimation {
 
 namespace vkw {
 
-Buffer::Buffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VmaMemoryUsage properties, const void* data) {
+Buffer::Buffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VmaMemoryUsage properties, const void* data) : size(size) {
     RenderingDevice* rd = RenderingDevice::getSingleton();
     VkDevice device = rd->getDevice();
 
@@ -18,17 +18,39 @@ Buffer::Buffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VmaMemoryUsage
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE
     };
 
+    // buffers both queues use are shared between families instead of transferring ownership every frame,
+    // uniforms included since the async compute culling reads the same per-frame data as the graphics passes
+    const uint32_t queueFamilies[] = { rd->getGraphicsQueueFamily(), rd->getComputeQueueFamily() };
+    const VkBufferUsageFlags sharedUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    if ((usageFlags & sharedUsage) && queueFamilies[0] != queueFamilies[1]) {
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferCreateInfo.queueFamilyIndexCount = 2;
+        bufferCreateInfo.pQueueFamilyIndices = queueFamilies;
+    }
+
+    // mapping is ignored for memory the host can't see, so device only buffers without unified memory stay unmapped
     VmaAllocationCreateInfo allocCreateInfo{
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
         .usage = properties
     };
+    if (properties == VMA_MEMORY_USAGE_GPU_ONLY && data == nullptr) {
+        allocCreateInfo.flags = 0;
+    }
+
+    // with unified memory host written buffers live in device local memory, device only ones given data in mappable memory
+    if (rd->hasUnifiedMemory()) {
+        if (properties == VMA_MEMORY_USAGE_CPU_TO_GPU) {
+            allocCreateInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        } else if (properties == VMA_MEMORY_USAGE_GPU_ONLY && data != nullptr) {
+            allocCreateInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        }
+    }
 
     CHECK_VKRESULT(vmaCreateBuffer(rd->getAllocator(), &bufferCreateInfo, &allocCreateInfo, &buffer, &allocation, &allocInfo));
+    mapped = allocInfo.pMappedData;
 
-    if (data != nullptr) {
-        void* mapped;
-        vmaMapMemory(rd->getAllocator(), allocation, &mapped);
-        memcpy(mapped, data, (size_t)bufferCreateInfo.size);
-        vmaUnmapMemory(rd->getAllocator(), allocation);
+    if (data != nullptr && mapped != nullptr) {
+        write(data, size);
     }
 }
 
@@ -36,27 +58,23 @@ Buffer::~Buffer() {
     vmaDestroyBuffer(RenderingDevice::getSingleton()->getAllocator(), buffer, allocation);
 }
 
-UniformBuffer::UniformBuffer(VkDeviceSize size, const void* data) :
-        Buffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, nullptr) {
-    vmaMapMemory(RenderingDevice::getSingleton()->getAllocator(), allocation, &mapped);
-    if (data != nullptr) {
-        update(data);
-    }
+void Buffer::write(const void* data, VkDeviceSize size) {
+    memcpy(mapped, data, (size_t)size);
+    vmaFlushAllocation(RenderingDevice::getSingleton()->getAllocator(), allocation, 0, size);
 }
 
+UniformBuffer::UniformBuffer(VkDeviceSize size, const void* data) :
+        Buffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, data) {}
+
 void UniformBuffer::update(const void* data) {
-    memcpy(mapped, data, allocInfo.size);
+    write(data, size);
 }
 
 StorageBuffer::StorageBuffer(VkDeviceSize size, const void* data) :
-        Buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, nullptr) {
-    vmaMapMemory(RenderingDevice::getSingleton()->getAllocator(), allocation, &mapped);
-    if (data != nullptr) {
-        update(data);
-    }
-}
-void StorageBuffer::update(const void* data) {
-    memcpy(mapped, data, allocInfo.size);
+        Buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, data) {}
+
+void StorageBuffer::update(const void* data, VkDeviceSize size) {
+    write(data, size == VK_WHOLE_SIZE ? getSize() : size);
 }
 
 } // namespace vkw
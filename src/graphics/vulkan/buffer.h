@@ -7,18 +7,27 @@ namespace sublimation {
 
 namespace vkw {
 
+// Host access is persistently mapped, GPU_ONLY buffers created with data are placed in host visible device local memory
+// when the device has it (see RenderingDevice::hasUnifiedMemory) and written in place, without it data is dropped
+// and the caller has to stage it, isMapped tells the two apart
 class Buffer {
 public:
     Buffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage properties, const void* data = nullptr);
     virtual ~Buffer();
 
     const VkBuffer& getBuffer() const { return buffer; }
-    VkDeviceSize getSize() const { return allocInfo.size; }
+    VkDeviceSize getSize() const { return size; }
+    bool isMapped() const { return mapped != nullptr; }
 
 protected:
+    // copies into the mapping and flushes it for non coherent memory
+    void write(const void* data, VkDeviceSize size);
+
     VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize size; ///< size asked for, the allocation can be larger
     VmaAllocation allocation;
     VmaAllocationInfo allocInfo;
+    void* mapped = nullptr;
 };
 
 class UniformBuffer : public Buffer {
@@ -26,19 +35,14 @@ public:
     UniformBuffer(VkDeviceSize size, const void* data = nullptr);
 
     void update(const void* data);
-
-private:
-    void* mapped = nullptr;
 };
 
 class StorageBuffer : public Buffer {
 public:
     StorageBuffer(VkDeviceSize size, const void* data = nullptr);
 
-    void update(const void* data);
-
-private:
-    void* mapped = nullptr;
+    // size defaults to the whole buffer
+    void update(const void* data, VkDeviceSize size = VK_WHOLE_SIZE);
 };
 
 } // namespace vkw
@@ -13,17 +13,19 @@ struct CommandPoolContainer {
     std::vector<VkCommandBuffer> commandBuffers; // 1 buffer per pool for now
 };
 
-void CommandBufferManager::initialize() {
+void CommandBufferManager::initialize(uint32_t numFrames, uint32_t queueFamily) {
     RenderingDevice* rd = RenderingDevice::getSingleton();
+    queueFamilyIndex = queueFamily;
 
-    const uint32_t numPools = rd->getSwapChain().getImageCount();
+    // pools are recycled once the frame that used them retires, so size by frames in flight rather than swapchain images
+    const uint32_t numPools = numFrames;
     commandPools.resize(numPools);
 
     for (size_t i = 0; i < numPools; i++) {
         VkCommandPoolCreateInfo commandPoolCreateInfo{
             .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
             .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-            .queueFamilyIndex = rd->getGraphicsQueueFamily()
+            .queueFamilyIndex = queueFamilyIndex
         };
 
         CHECK_VKRESULT(vkCreateCommandPool(rd->getDevice(), &commandPoolCreateInfo, nullptr, &commandPools[i].commandPool));
@@ -44,11 +46,14 @@ void CommandBufferManager::initialize() {
 void CommandBufferManager::destroy() {
     RenderingDevice* rd = RenderingDevice::getSingleton();
 
-    const uint32_t numPools = rd->getSwapChain().getImageCount();
-
-    for (size_t i = 0; i < numPools; i++) {
-        vkDestroyCommandPool(rd->getDevice(), commandPools[i].commandPool, nullptr);
+    for (auto& pool : commandPools) {
+        vkDestroyCommandPool(rd->getDevice(), pool.commandPool, nullptr);
     }
+    commandPools.clear();
+}
+
+uint32_t CommandBufferManager::getNumPools() const {
+    return static_cast<uint32_t>(commandPools.size());
 }
 
 void CommandBufferManager::resetPool(uint32_t frameIdx) {
@@ -63,7 +68,7 @@ const VkCommandPool& CommandBufferManager::getCommandPool(uint32_t frameIdx) {
 }
 
 VkCommandBuffer CommandBufferManager::getCommandBuffer(uint32_t frameIdx) {
-    CommandPoolContainer pool = commandPools[frameIdx];
+    CommandPoolContainer& pool = commandPools[frameIdx];
 
     if (pool.index < pool.commandBuffers.size()) {
         auto buffer = pool.commandBuffers[pool.index++];
@@ -13,9 +13,11 @@ class CommandBufferManager {
 public:
     CommandBufferManager() = default;
 
-    void initialize();
+    void initialize(uint32_t numFrames, uint32_t queueFamily);
     void destroy();
 
+    uint32_t getNumPools() const;
+
     void resetPool(uint32_t frameIdx);
 
     const VkCommandPool& getCommandPool(uint32_t frameIdx);
@@ -23,8 +25,9 @@ public:
     VkCommandBuffer getCommandBufferOneTime(uint32_t frameIdx, bool begin = false);
 
 private:
-    // 1 command pool per thread per swapchain frame
+    // 1 command pool per thread per frame in flight
     std::vector<CommandPoolContainer> commandPools;
+    uint32_t queueFamilyIndex = 0;
 };
 
 } //namespace vkw
@@ -0,0 +1,30 @@
+#include <graphics/vulkan/deletion_queue.h>
+
+namespace sublimation {
+
+namespace vkw {
+
+void DeletionQueue::push(uint64_t frame, std::function<void()>&& deleter) {
+    pendingDeletions.push_back({ frame, std::move(deleter) });
+}
+
+void DeletionQueue::flush(uint64_t completedFrame) {
+    // frame values only grow, so everything that is ready sits at the front
+    while (!pendingDeletions.empty() && pendingDeletions.front().frame <= completedFrame) {
+        std::function<void()> deleter = std::move(pendingDeletions.front().deleter);
+        pendingDeletions.pop_front();
+        deleter();
+    }
+}
+
+void DeletionQueue::flushAll() {
+    while (!pendingDeletions.empty()) {
+        std::function<void()> deleter = std::move(pendingDeletions.front().deleter);
+        pendingDeletions.pop_front();
+        deleter();
+    }
+}
+
+} //namespace vkw
+
+} //namespace sublimation
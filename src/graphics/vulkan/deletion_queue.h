@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace sublimation {
+
+namespace vkw {
+
+// Holds on to released Vulkan objects until the frame that last used them has finished on the GPU
+// entries are tagged with frame timeline values, so they retire in the order they were queued
+class DeletionQueue {
+public:
+    DeletionQueue() = default;
+
+    // queue a deleter for the frame currently being recorded
+    void push(uint64_t frame, std::function<void()>&& deleter);
+
+    // run deleters of every frame up to and including completedFrame
+    void flush(uint64_t completedFrame);
+    void flushAll();
+
+    size_t size() const { return pendingDeletions.size(); }
+
+private:
+    struct PendingDeletion {
+        uint64_t frame;
+        std::function<void()> deleter;
+    };
+
+    std::deque<PendingDeletion> pendingDeletions;
+};
+
+} //namespace vkw
+
+} //namespace sublimation
@@ -20,16 +20,24 @@ VkDescriptorSetLayout DescriptorLayoutBuilder::build(std::string name) {
     VkDescriptorSetLayout descriptorSetLayout;
     CHECK_VKRESULT(vkCreateDescriptorSetLayout(RenderingDevice::getSingleton()->getDevice(), &layoutCreateInfo, nullptr, &descriptorSetLayout));
     layoutBindings.clear();
+    immutableSamplers.clear();
 
     return descriptorSetLayout;
 }
 
-DescriptorLayoutBuilder& DescriptorLayoutBuilder::addResource(VkDescriptorType type, const uint32_t binding, const VkShaderStageFlagBits stage) {
+DescriptorLayoutBuilder& DescriptorLayoutBuilder::addResource(VkDescriptorType type, const uint32_t binding, const VkShaderStageFlagBits stage,
+        VkSampler immutableSampler) {
+    const VkSampler* samplers = nullptr;
+    if (immutableSampler != VK_NULL_HANDLE) {
+        immutableSamplers.push_back(immutableSampler);
+        samplers = &immutableSamplers.back();
+    }
+
     layoutBindings.push_back({ .binding = binding,
             .descriptorType = type,
             .descriptorCount = 1,
             .stageFlags = static_cast<VkShaderStageFlags>(stage),
-            .pImmutableSamplers = nullptr });
+            .pImmutableSamplers = samplers });
 
     return *this;
 }
@@ -132,6 +140,8 @@ VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount, std::span<Po
 
     VkDescriptorPool pool;
     CHECK_VKRESULT(vkCreateDescriptorPool(RenderingDevice::getSingleton()->getDevice(), &poolCreateInfo, nullptr, &pool));
+
+    return pool;
 }
 
 void DescriptorWriter::bindImage(uint32_t binding, Texture* texture, VkDescriptorType type) {
@@ -152,6 +162,24 @@ void DescriptorWriter::bindImage(uint32_t binding, Texture* texture, VkDescripto
     descriptorWrites.push_back(write);
 }
 
+void DescriptorWriter::bindImage(uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType type) {
+    VkDescriptorImageInfo& info = imageInfos.emplace_back(VkDescriptorImageInfo{
+            .sampler = sampler,
+            .imageView = imageView,
+            .imageLayout = layout });
+
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = VK_NULL_HANDLE,
+        .dstBinding = binding,
+        .descriptorCount = 1,
+        .descriptorType = type,
+        .pImageInfo = &info
+    };
+
+    descriptorWrites.push_back(write);
+}
+
 void DescriptorWriter::bindBuffer(uint32_t binding, Buffer* buffer, VkDescriptorType type) {
     VkDescriptorBufferInfo& info = bufferInfos.emplace_back(VkDescriptorBufferInfo{
             .buffer = buffer->getBuffer(),
@@ -21,12 +21,15 @@ public:
 
     ~DescriptorLayoutBuilder() = default;
 
-    DescriptorLayoutBuilder& addResource(VkDescriptorType type, const uint32_t binding, const VkShaderStageFlagBits stage);
+    // an immutable sampler is baked into the layout, the sampler of image writes to that binding is then ignored
+    DescriptorLayoutBuilder& addResource(VkDescriptorType type, const uint32_t binding, const VkShaderStageFlagBits stage,
+            VkSampler immutableSampler = VK_NULL_HANDLE);
 
     [[nodiscard]] VkDescriptorSetLayout build(std::string name);
 
 private:
     std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    std::deque<VkSampler> immutableSamplers; ///< pointed to by layoutBindings until build
 };
 
 class DescriptorAllocator {
@@ -58,6 +61,8 @@ struct DescriptorWriter {
     std::vector<VkWriteDescriptorSet> descriptorWrites;
 
     void bindImage(uint32_t binding, Texture* texture, VkDescriptorType type);
+    // single mip views and images not owned by a Texture
+    void bindImage(uint32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout, VkDescriptorType type);
     void bindBuffer(uint32_t binding, Buffer* buffer, VkDescriptorType type);
 
     void writeSet(VkDescriptorSet descriptorSet);
@@ -0,0 +1,217 @@
+#include <graphics/vulkan/mip_generator.h>
+
+#include <graphics/vulkan/rendering_device.h>
+#include <graphics/vulkan/texture.h>
+#include <graphics/vulkan/utils.h>
+
+#include <graphics/render_system.h>
+
+#include <algorithm>
+
+namespace sublimation {
+
+namespace vkw {
+
+namespace {
+
+VkFormat getStorageFormat(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_SRGB:
+            return VK_FORMAT_R8_UNORM;
+        case VK_FORMAT_R8G8_SRGB:
+            return VK_FORMAT_R8G8_UNORM;
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return VK_FORMAT_R8G8B8A8_UNORM;
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return VK_FORMAT_B8G8R8A8_UNORM;
+        default:
+            return format;
+    }
+}
+
+VkImageMemoryBarrier getLevelBarrier(VkImage image, uint32_t baseLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+    return {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1 }
+    };
+}
+
+} //namespace
+
+bool MipGenerator::isSupported(VkFormat format) {
+    // the shader leaves the format to the views
+    if (!RenderingDevice::getSingleton()->getPhysicalDeviceFeatures().shaderStorageImageWriteWithoutFormat) {
+        return false;
+    }
+
+    return Texture::findSupportedFormat({ format }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != VK_FORMAT_UNDEFINED
+            && Texture::findSupportedFormat({ getStorageFormat(format) }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != VK_FORMAT_UNDEFINED;
+}
+
+VkImageCreateFlags MipGenerator::getImageFlags(VkFormat format) {
+    // sRGB formats can't be storage images themselves, only their UNORM views can
+    return getStorageFormat(format) != format ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT : 0;
+}
+
+void MipGenerator::beginBatch() {
+    batchDepth++;
+}
+
+void MipGenerator::endBatch() {
+    if (batchDepth > 0 && --batchDepth == 0) {
+        flush();
+    }
+}
+
+void MipGenerator::add(VkImage image, const VkExtent3D& extent, VkFormat format, uint32_t mipLevels) {
+    requests.push_back({ image, extent, format, mipLevels });
+
+    if (batchDepth == 0) {
+        flush();
+    }
+}
+
+void MipGenerator::destroy() {
+    // pipeline, layout and shader are released with the rest of the device's
+    if (initialized) {
+        descriptorAllocator.destroyPools();
+        initialized = false;
+    }
+}
+
+void MipGenerator::initialize() {
+    RenderingDevice* rd = RenderingDevice::getSingleton();
+
+    ShaderStageInfo shaderInfo = {};
+    shaderInfo.stages[0].filepath = "mipmap.comp.glsl";
+    shaderInfo.stages[0].stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderInfo.stageCount = 1;
+    shaderInfo.name = "mipmap";
+    pass.shader = rd->createShaderFromSPIRV(shaderInfo);
+
+    DescriptorLayoutBuilder layoutBuilder;
+    setLayout = layoutBuilder.addResource(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, VK_SHADER_STAGE_COMPUTE_BIT, rd->getSampler({}))
+                        .addResource(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addResource(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addResource(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .addResource(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4, VK_SHADER_STAGE_COMPUTE_BIT)
+                        .build("mipmap");
+    rd->getShader(pass.shader)->layouts.push_back(setLayout);
+    rd->getShader(pass.shader)->pushConstantRange = sizeof(PushConstants);
+
+    pass.pipelineLayout = rd->createPipelineLayout(pass.shader);
+    PipelineInfo pipelineInfo{
+        .pipelineLayout = rd->getPipelineLayout(pass.pipelineLayout)
+    };
+    pass.pipeline = rd->createPipeline(pipelineInfo, pass.shader);
+
+    std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelsPerPass }
+    };
+    descriptorAllocator.initialize(64, sizes);
+
+    initialized = true;
+}
+
+void MipGenerator::flush() {
+    if (requests.empty()) {
+        return;
+    }
+    if (!initialized) {
+        initialize();
+    }
+
+    RenderingDevice* rd = RenderingDevice::getSingleton();
+    VkDevice device = rd->getDevice();
+    VkPipelineLayout pipelineLayout = rd->getPipelineLayout(pass.pipelineLayout);
+    VkCommandBuffer commandBuffer = rd->getCommandBufferOneTime(RenderSystem::getSingleton()->getFrameIndex());
+
+    // the uploaded level is the first source, the others are only ever written before they are read
+    std::vector<VkImageMemoryBarrier> barriers;
+    uint32_t maxLevels = 0;
+    for (const Request& request : requests) {
+        barriers.push_back(getLevelBarrier(request.image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        if (request.mipLevels > 1) {
+            barriers.push_back(getLevelBarrier(request.image, 1, request.mipLevels - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                    0, VK_ACCESS_SHADER_WRITE_BIT));
+        }
+        maxLevels = std::max(maxLevels, request.mipLevels);
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, rd->getPipeline(pass.pipeline));
+
+    // one round per levelsPerPass levels, every image that still has levels left takes part in it
+    std::vector<VkImageView> views;
+    DescriptorWriter writer;
+    for (uint32_t srcLevel = 0; srcLevel + 1 < maxLevels; srcLevel += levelsPerPass) {
+        barriers.clear();
+
+        for (const Request& request : requests) {
+            if (srcLevel + 1 >= request.mipLevels) {
+                continue;
+            }
+
+            const uint32_t levelCount = std::min(levelsPerPass, request.mipLevels - 1 - srcLevel);
+            const VkFormat storageFormat = getStorageFormat(request.format);
+
+            VkImageView srcView;
+            Texture::createImageView(srcView, request.image, VK_IMAGE_VIEW_TYPE_2D, request.format, VK_IMAGE_ASPECT_COLOR_BIT, 1, srcLevel, 1, 0);
+            views.push_back(srcView);
+            writer.bindImage(0, srcView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+            VkImageView dstView = VK_NULL_HANDLE;
+            for (uint32_t i = 0; i < levelsPerPass; i++) {
+                if (i < levelCount) {
+                    Texture::createImageView(dstView, request.image, VK_IMAGE_VIEW_TYPE_2D, storageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, srcLevel + 1 + i, 1, 0);
+                    views.push_back(dstView);
+                }
+                writer.bindImage(1 + i, dstView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+            }
+
+            VkDescriptorSet set = descriptorAllocator.allocate(setLayout);
+            writer.writeSet(set);
+
+            const PushConstants pushConstants{
+                .levelCount = levelCount,
+                .srgb = storageFormat != request.format ? 1u : 0u
+            };
+            const uint32_t width = std::max(request.extent.width >> (srcLevel + 1), 1u);
+            const uint32_t height = std::max(request.extent.height >> (srcLevel + 1), 1u);
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, 0, sizeof(PushConstants), &pushConstants);
+            vkCmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1);
+
+            // the last level written is the next round's source, the whole chain is sampled once it's done
+            barriers.push_back(getLevelBarrier(request.image, srcLevel + 1, levelCount, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+
+    rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
+
+    for (VkImageView view : views) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    descriptorAllocator.clearPools();
+    requests.clear();
+}
+
+} //namespace vkw
+
+} //namespace sublimation
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <volk.h>
+
+#include <graphics/vulkan/descriptor.h>
+#include <graphics/vulkan/pipeline.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace sublimation {
+
+namespace vkw {
+
+// Builds mip chains in a compute shader that writes levelsPerPass levels per dispatch through shared memory
+// images added between beginBatch and endBatch are recorded into one command buffer, the passes of all of them
+// running between the same barriers, outside a batch an image is generated right away
+class MipGenerator {
+public:
+    static constexpr uint32_t levelsPerPass = 4;
+
+    // sRGB formats are written through their UNORM alias, formats without storage support use Texture::generateMipmaps
+    static bool isSupported(VkFormat format);
+    // usage and create flags an image of format needs to be added
+    static VkImageUsageFlags getImageUsage() { return VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT; }
+    static VkImageCreateFlags getImageFlags(VkFormat format);
+
+    void beginBatch();
+    void endBatch();
+
+    // level 0 has to be in TRANSFER_DST_OPTIMAL, every level ends up in SHADER_READ_ONLY_OPTIMAL
+    void add(VkImage image, const VkExtent3D& extent, VkFormat format, uint32_t mipLevels);
+
+    void destroy();
+
+private:
+    struct Request {
+        VkImage image;
+        VkExtent3D extent;
+        VkFormat format;
+        uint32_t mipLevels;
+    };
+
+    struct PushConstants {
+        uint32_t levelCount;
+        uint32_t srgb;
+    };
+
+    void initialize();
+    void flush();
+
+    Pipeline pass;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    DescriptorAllocator descriptorAllocator; ///< reset after every flush
+    bool initialized = false;
+
+    std::vector<Request> requests;
+    uint32_t batchDepth = 0;
+};
+
+} //namespace vkw
+
+} //namespace sublimation
@@ -2,6 +2,13 @@
 
 #include <volk.h>
 
+#include <graphics/vulkan/resource_pool.h>
+#include <graphics/vulkan/vertex_format.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
 namespace sublimation {
 
 namespace vkw {
@@ -36,6 +43,18 @@ struct BlendStateInfo {
     uint32_t attachmentCount = 0;
 };
 
+// attachment formats a pipeline is built against when it renders with dynamic rendering instead of a render pass
+struct RenderingFormats {
+    VkFormat colorFormats[8];
+    uint32_t colorAttachmentCount = 0;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+    bool operator==(const RenderingFormats& other) const {
+        return colorAttachmentCount == other.colorAttachmentCount && depthFormat == other.depthFormat
+                && std::equal(colorFormats, colorFormats + colorAttachmentCount, other.colorFormats);
+    }
+};
+
 struct Shader {
     VkPipelineShaderStageCreateInfo shaderStageCreateInfo[5];
     std::string name;
@@ -66,7 +85,11 @@ struct PipelineInfo {
     BlendStateInfo blendStateInfo;
 
     VkPipelineLayout pipelineLayout;
-    VkRenderPass renderPass;
+    VkRenderPass renderPass; ///< VK_NULL_HANDLE builds the pipeline for dynamic rendering with renderingFormats
+    uint32_t subpass = 0;
+    RenderingFormats renderingFormats;
+    VertexFormat vertexFormat = VertexFormat::Float; ///< selects the vertex input layout and specialises the vertex stage
+    bool positionOnly = false; ///< only binds the position vertex stream, for depth and shadow pipelines
 };
 
 struct RenderPass {
@@ -75,10 +98,12 @@ struct RenderPass {
 };
 
 struct Pipeline {
-    VkPipeline pipeline = VK_NULL_HANDLE;
-    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-    RenderPass renderPass;
-    Shader shader;
+    PipelineHandle pipeline;
+    PipelineLayoutHandle pipelineLayout;
+    RenderPassHandle renderPass;
+    uint32_t subpass = 0;
+    RenderingFormats renderingFormats;
+    ShaderHandle shader;
 
     std::vector<VkDescriptorSet> descriptors;
 
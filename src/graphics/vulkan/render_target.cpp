@@ -7,42 +7,34 @@ namespace sublimation {
 
 namespace vkw {
 
-void RenderTarget::addColorAttachment(AttachmentInfo& attachment) {
-    attachments.push_back(attachment);
-
-    VkAttachmentReference reference{
-        .attachment = numAttachments,
-        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-    };
-
-    colorReferences.push_back(reference);
-
+uint32_t RenderTarget::addColorAttachment(AttachmentInfo& attachment) {
     VkAttachmentDescription description{
         .loadOp = attachment.loadAction,
         .storeOp = attachment.storeAction,
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+        .initialLayout = attachment.initialLayout,
+        .finalLayout = attachment.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED ? attachment.finalLayout : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
     };
-    description.format = attachment.texture->getFormat();
-    description.samples = attachment.texture->getSamples();
-
-    descriptions.push_back(description);
-
-    numAttachments++;
-}
-
-void RenderTarget::addColorResolveAttachment(AttachmentInfo& attachment) {
-    attachments.push_back(attachment);
+    // swapchain images are never multisampled
+    description.format = attachment.format;
+    description.samples = attachment.isSwapchainResource ? VK_SAMPLE_COUNT_1_BIT : attachment.texture->getSamples();
 
     VkAttachmentReference reference{
-        .attachment = numAttachments,
+        .attachment = addAttachment(attachment, description),
         .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
     };
 
-    resolveReferences.push_back(reference);
+    if (attachment.layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        reference.layout = attachment.layout;
+    }
+
+    subpasses.back().colorReferences.push_back(reference);
 
+    return reference.attachment;
+}
+
+uint32_t RenderTarget::addColorResolveAttachment(AttachmentInfo& attachment) {
     VkAttachmentDescription description{
         .format = attachment.format,
         .samples = VK_SAMPLE_COUNT_1_BIT,
@@ -50,26 +42,25 @@ void RenderTarget::addColorResolveAttachment(AttachmentInfo& attachment) {
         .storeOp = attachment.storeAction,
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        .initialLayout = attachment.initialLayout,
+        .finalLayout = attachment.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED ? attachment.finalLayout : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
     };
 
-    descriptions.push_back(description);
-
-    hasResolveAttachments = true;
-    numAttachments++;
-}
-
-void RenderTarget::setDepthStencilAttachment(AttachmentInfo& attachment) {
-    attachments.push_back(attachment);
-
     VkAttachmentReference reference{
-        .attachment = numAttachments,
-        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        .attachment = addAttachment(attachment, description),
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
     };
 
-    depthStencilReference = reference;
+    if (attachment.layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        reference.layout = attachment.layout;
+    }
+
+    subpasses.back().resolveReferences.push_back(reference);
+
+    return reference.attachment;
+}
 
+uint32_t RenderTarget::setDepthStencilAttachment(AttachmentInfo& attachment) {
     VkAttachmentDescription description{
         .loadOp = attachment.loadAction,
         .storeOp = attachment.storeAction,
@@ -90,10 +81,119 @@ void RenderTarget::setDepthStencilAttachment(AttachmentInfo& attachment) {
         description.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
     }
 
+    // explicit layouts (set by the render graph) win over the guesses above
+    if (attachment.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        description.initialLayout = attachment.initialLayout;
+        description.finalLayout = attachment.finalLayout;
+    }
+
+    VkAttachmentReference reference{
+        .attachment = addAttachment(attachment, description),
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+    };
+
+    if (attachment.layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        reference.layout = attachment.layout;
+    }
+
+    subpasses.back().depthStencilReference = reference;
+    subpasses.back().hasDepthStencil = true;
+
+    return reference.attachment;
+}
+
+void RenderTarget::nextSubpass() {
+    subpasses.emplace_back();
+}
+
+uint32_t RenderTarget::addAttachment(const AttachmentInfo& attachment, const VkAttachmentDescription& description) {
+    for (uint32_t i = 0; i < numAttachments; i++) {
+        const bool same = attachment.isSwapchainResource ? attachments[i].isSwapchainResource : attachments[i].texture == attachment.texture;
+        if (same) {
+            descriptions[i].storeOp = description.storeOp;
+            descriptions[i].finalLayout = description.finalLayout;
+            return i;
+        }
+    }
+
+    attachments.push_back(attachment);
     descriptions.push_back(description);
 
-    hasDepthStencil = true;
-    numAttachments++;
+    return numAttachments++;
+}
+
+VkImageView RenderTarget::getImageView(uint32_t attachment, uint32_t swapchainImageIndex) const {
+    return attachments[attachment].isSwapchainResource ? attachments[attachment].swapchain->getImageView(swapchainImageIndex)
+                                                       : attachments[attachment].texture->getImageView();
+}
+
+void RenderTarget::beginRendering(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, uint32_t swapchainImageIndex,
+        const VkClearValue* clearValues, uint32_t subpass) const {
+    const Subpass& references = subpasses[subpass];
+
+    VkRenderingAttachmentInfoKHR colorAttachments[8];
+    for (uint32_t i = 0; i < references.colorReferences.size(); i++) {
+        const VkAttachmentReference& reference = references.colorReferences[i];
+        colorAttachments[i] = {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+            .imageView = getImageView(reference.attachment, swapchainImageIndex),
+            .imageLayout = reference.layout,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .loadOp = descriptions[reference.attachment].loadOp,
+            .storeOp = descriptions[reference.attachment].storeOp,
+            .clearValue = clearValues[reference.attachment]
+        };
+
+        if (!references.resolveReferences.empty()) {
+            const VkAttachmentReference& resolve = references.resolveReferences[i];
+            colorAttachments[i].resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+            colorAttachments[i].resolveImageView = getImageView(resolve.attachment, swapchainImageIndex);
+            colorAttachments[i].resolveImageLayout = resolve.layout;
+        }
+    }
+
+    VkRenderingAttachmentInfoKHR depthAttachment{};
+    if (references.hasDepthStencil) {
+        const VkAttachmentReference& reference = references.depthStencilReference;
+        depthAttachment = {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+            .imageView = getImageView(reference.attachment, swapchainImageIndex),
+            .imageLayout = reference.layout,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .loadOp = descriptions[reference.attachment].loadOp,
+            .storeOp = descriptions[reference.attachment].storeOp,
+            .clearValue = clearValues[reference.attachment]
+        };
+    }
+    const bool stencil = references.hasDepthStencil && Texture::hasStencil(descriptions[references.depthStencilReference.attachment].format);
+
+    VkRenderingInfoKHR renderingInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+        .renderArea = renderArea,
+        .layerCount = 1,
+        .colorAttachmentCount = static_cast<uint32_t>(references.colorReferences.size()),
+        .pColorAttachments = colorAttachments,
+        .pDepthAttachment = references.hasDepthStencil ? &depthAttachment : nullptr,
+        .pStencilAttachment = stencil ? &depthAttachment : nullptr
+    };
+
+    vkCmdBeginRenderingKHR(commandBuffer, &renderingInfo);
+}
+
+RenderingFormats RenderTarget::getRenderingFormats(uint32_t subpass) const {
+    const Subpass& references = subpasses[subpass];
+
+    RenderingFormats formats{
+        .colorAttachmentCount = static_cast<uint32_t>(references.colorReferences.size())
+    };
+    for (uint32_t i = 0; i < formats.colorAttachmentCount; i++) {
+        formats.colorFormats[i] = descriptions[references.colorReferences[i].attachment].format;
+    }
+    if (references.hasDepthStencil) {
+        formats.depthFormat = descriptions[references.depthStencilReference.attachment].format;
+    }
+
+    return formats;
 }
 
 void RenderTarget::setupFramebuffers(uint32_t count, VkExtent2D ext, VkRenderPass renderPass) {
@@ -128,16 +228,18 @@ void RenderTarget::setupFramebuffers(uint32_t count, VkExtent2D ext, VkRenderPas
 void RenderTarget::destroy() {
     attachments.clear();
 
-    colorReferences.clear();
-    resolveReferences.clear();
+    subpasses.assign(1, Subpass{});
     descriptions.clear();
 
-    hasResolveAttachments = false;
-    hasDepthStencil = false;
-
-    for (auto& framebuffer : framebuffers) {
-        vkDestroyFramebuffer(RenderingDevice::getSingleton()->getDevice(), framebuffer, nullptr);
-    }
+    // framebuffers may still be referenced by in-flight frames
+    RenderingDevice* rd = RenderingDevice::getSingleton();
+    VkDevice device = rd->getDevice();
+    rd->deferDestroy([device, retired = framebuffers]() {
+        for (const auto& framebuffer : retired) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+    });
+    framebuffers.clear();
     numAttachments = 0;
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <graphics/vulkan/pipeline.h>
 #include <graphics/vulkan/swapchain.h>
 #include <graphics/vulkan/texture.h>
 
@@ -15,7 +16,7 @@ struct AttachmentInfo {
             isSwapchainResource(false),
             texture(texture) {}
 
-    AttachmentInfo(Swapchain* swapchain) :
+    AttachmentInfo(const Swapchain* swapchain) :
             format(swapchain->getFormat()),
             swapchain(swapchain),
             isSwapchainResource(true) {}
@@ -24,29 +25,51 @@ struct AttachmentInfo {
     VkAttachmentLoadOp loadAction = VK_ATTACHMENT_LOAD_OP_CLEAR;
     VkAttachmentStoreOp storeAction = VK_ATTACHMENT_STORE_OP_STORE;
 
+    // layouts, UNDEFINED for layout/finalLayout picks the defaults of the attachment kind
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED; ///< layout during the subpass
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
     bool isSwapchainResource;
-    Texture* texture;
-    Swapchain* swapchain = nullptr;
+    Texture* texture = nullptr;
+    const Swapchain* swapchain = nullptr;
 };
 
+// Attachments of a render pass and the framebuffers built from them
+// add* functions reference the attachment from the current subpass, nextSubpass() starts a new one.
+// Adding an attachment that is already part of the target reuses it: load op and initial layout stay those of
+// the first use, store op and final layout are taken from the latest one
 class RenderTarget {
 public:
     RenderTarget() {}
 
-    void addColorAttachment(AttachmentInfo& attachment);
-    void addColorResolveAttachment(AttachmentInfo& attachment);
-    void setDepthStencilAttachment(AttachmentInfo& attachment);
+    // return the attachment index
+    uint32_t addColorAttachment(AttachmentInfo& attachment);
+    uint32_t addColorResolveAttachment(AttachmentInfo& attachment);
+    uint32_t setDepthStencilAttachment(AttachmentInfo& attachment);
+    void nextSubpass();
 
     void setupFramebuffers(uint32_t count, VkExtent2D extent, VkRenderPass renderPass);
     void destroy();
 
-    uint32_t getNumColorAttachments() const { return static_cast<uint32_t>(colorReferences.size()); }
-    bool getHasResolveAttachments() const { return hasResolveAttachments; }
-    bool getHasDepthStencil() const { return hasDepthStencil; }
-
-    const VkAttachmentReference* getColorAttachmentReferences() const { return colorReferences.data(); }
-    const VkAttachmentReference* getResolveAttachmentReferences() const { return hasResolveAttachments ? resolveReferences.data() : nullptr; }
-    const VkAttachmentReference* getDepthStencilReference() const { return hasDepthStencil ? &depthStencilReference : nullptr; }
+    // dynamic rendering backend, draws to the attachments of a subpass without render pass or framebuffers.
+    // Layout transitions are left to the caller, attachments have to be in their reference layouts already
+    void beginRendering(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, uint32_t swapchainImageIndex,
+            const VkClearValue* clearValues, uint32_t subpass = 0) const;
+    RenderingFormats getRenderingFormats(uint32_t subpass = 0) const;
+
+    uint32_t getNumSubpasses() const { return static_cast<uint32_t>(subpasses.size()); }
+    uint32_t getNumColorAttachments(uint32_t subpass = 0) const { return static_cast<uint32_t>(subpasses[subpass].colorReferences.size()); }
+    bool getHasResolveAttachments(uint32_t subpass = 0) const { return !subpasses[subpass].resolveReferences.empty(); }
+    bool getHasDepthStencil(uint32_t subpass = 0) const { return subpasses[subpass].hasDepthStencil; }
+
+    const VkAttachmentReference* getColorAttachmentReferences(uint32_t subpass = 0) const { return subpasses[subpass].colorReferences.data(); }
+    const VkAttachmentReference* getResolveAttachmentReferences(uint32_t subpass = 0) const {
+        return getHasResolveAttachments(subpass) ? subpasses[subpass].resolveReferences.data() : nullptr;
+    }
+    const VkAttachmentReference* getDepthStencilReference(uint32_t subpass = 0) const {
+        return subpasses[subpass].hasDepthStencil ? &subpasses[subpass].depthStencilReference : nullptr;
+    }
 
     uint32_t getNumAttachmentDescriptions() const { return static_cast<uint32_t>(descriptions.size()); }
     const VkAttachmentDescription* getAttachmentDescriptions() const { return descriptions.data(); }
@@ -54,16 +77,22 @@ public:
     const VkFramebuffer& getFramebuffer(int index) const { return framebuffers[index]; }
 
 private:
+    struct Subpass {
+        std::vector<VkAttachmentReference> colorReferences;
+        std::vector<VkAttachmentReference> resolveReferences;
+        VkAttachmentReference depthStencilReference;
+        bool hasDepthStencil = false;
+    };
+
+    uint32_t addAttachment(const AttachmentInfo& attachment, const VkAttachmentDescription& description);
+    VkImageView getImageView(uint32_t attachment, uint32_t swapchainImageIndex) const;
+
     std::vector<VkFramebuffer> framebuffers;
     VkExtent2D extent;
 
     uint32_t numAttachments = 0;
 
-    std::vector<VkAttachmentReference> colorReferences;
-    std::vector<VkAttachmentReference> resolveReferences;
-    VkAttachmentReference depthStencilReference;
-    bool hasResolveAttachments = false;
-    bool hasDepthStencil = false;
+    std::vector<Subpass> subpasses = std::vector<Subpass>(1);
 
     std::vector<VkAttachmentDescription> descriptions;
 
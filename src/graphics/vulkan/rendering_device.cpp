@@ -9,13 +9,14 @@
 #include <graphics/vulkan/texture.h>
 #include <graphics/vulkan/utils.h>
 
-#include <scene/model.h>
+#include <algorithm>
+#include <array>
 
 namespace sublimation {
 
 namespace vkw {
 
-void RenderingDevice::initialize() {
+void RenderingDevice::initialize(uint32_t framesInFlight) {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
@@ -26,13 +27,36 @@ void RenderingDevice::initialize() {
 
     vulkanContext.initialize(window);
 
+    // a small host visible window into a larger device local heap (pre ReBAR discrete GPUs) doesn't count
+    const VkPhysicalDeviceMemoryProperties* memoryProperties;
+    vmaGetMemoryProperties(vulkanContext.allocator, &memoryProperties);
+    uint32_t deviceHeap = UINT32_MAX;
+    for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+        if ((memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+                (deviceHeap == UINT32_MAX || memoryProperties->memoryHeaps[i].size > memoryProperties->memoryHeaps[deviceHeap].size)) {
+            deviceHeap = i;
+        }
+    }
+    const VkMemoryPropertyFlags unifiedFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+        if (memoryProperties->memoryTypes[i].heapIndex == deviceHeap && (memoryProperties->memoryTypes[i].propertyFlags & unifiedFlags) == unifiedFlags) {
+            unifiedMemory = true;
+        }
+    }
+
     ///< deleted stuff
 
-    commandBufferManager.initialize();
+    setMSAASamples(multisampling);
+
+    commandBufferManager.initialize(framesInFlight, vulkanContext.graphicsQueueFamilyIndex);
+    computeCommandBufferManager.initialize(framesInFlight, vulkanContext.computeQueueFamilyIndex);
+    frameTimeline = createTimelineSemaphore(0);
+    computeTimeline = createTimelineSemaphore(0);
 
     std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
         { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8 },
         { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4 },
         { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 64 }
     };
     descriptorAllocator.initialize(10, sizes);
@@ -45,6 +69,34 @@ void RenderingDevice::initialize() {
     textureObjects.reserve(512);
 }
 
+VkSampleCountFlagBits RenderingDevice::getMaxMSAASamples() const {
+    const VkPhysicalDeviceLimits& limits = vulkanContext.deviceProperties.limits;
+    const VkSampleCountFlags counts = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+
+    for (VkSampleCountFlagBits samples : { VK_SAMPLE_COUNT_64_BIT, VK_SAMPLE_COUNT_32_BIT, VK_SAMPLE_COUNT_16_BIT,
+                 VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT }) {
+        if (counts & samples) {
+            return samples;
+        }
+    }
+
+    return VK_SAMPLE_COUNT_1_BIT;
+}
+
+void RenderingDevice::setMSAASamples(VkSampleCountFlagBits samples) {
+    multisampling = std::min(samples, getMaxMSAASamples());
+}
+
+bool RenderingDevice::hasLazilyAllocatedMemory() const {
+    for (uint32_t i = 0; i < vulkanContext.memoryProperties.memoryTypeCount; i++) {
+        if (vulkanContext.memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 uint32_t RenderingDevice::getMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
     for (uint32_t i = 0; i < vulkanContext.memoryProperties.memoryTypeCount; i++) {
         if (typeFilter & (1 << i)) {
@@ -57,44 +109,32 @@ uint32_t RenderingDevice::getMemoryType(uint32_t typeFilter, VkMemoryPropertyFla
     throw std::runtime_error("ERROR::RenderingDevice:getMemoryType: failed to find suitable memory type!");
 }
 
-RenderPass RenderingDevice::createRenderPass(const RenderTarget& target, const VkSubpassDependency& dependency, const std::string& name) {
-    VkSubpassDescription subpass{
-        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = target.getNumColorAttachments(),
-        .pColorAttachments = target.getNumColorAttachments() ? target.getColorAttachmentReferences() : nullptr,
-        .pResolveAttachments = target.getResolveAttachmentReferences(),
-        .pDepthStencilAttachment = target.getDepthStencilReference()
-    };
+RenderPassHandle RenderingDevice::createRenderPass(const RenderTarget& target, std::span<const VkSubpassDependency> dependencies, const std::string& name) {
+    std::vector<VkSubpassDescription> subpasses(target.getNumSubpasses());
+    for (uint32_t i = 0; i < target.getNumSubpasses(); i++) {
+        subpasses[i] = {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = target.getNumColorAttachments(i),
+            .pColorAttachments = target.getNumColorAttachments(i) ? target.getColorAttachmentReferences(i) : nullptr,
+            .pResolveAttachments = target.getResolveAttachmentReferences(i),
+            .pDepthStencilAttachment = target.getDepthStencilReference(i)
+        };
+    }
 
     VkRenderPassCreateInfo renderPassCreateInfo{
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
         .attachmentCount = target.getNumAttachmentDescriptions(),
         .pAttachments = target.getAttachmentDescriptions(),
-        .subpassCount = 1,
-        .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency
+        .subpassCount = static_cast<uint32_t>(subpasses.size()),
+        .pSubpasses = subpasses.data(),
+        .dependencyCount = static_cast<uint32_t>(dependencies.size()),
+        .pDependencies = dependencies.data()
     };
 
     VkRenderPass renderPass;
     CHECK_VKRESULT(vkCreateRenderPass(vulkanContext.device, &renderPassCreateInfo, nullptr, &renderPass));
 
-    renderPasses.push_back({ renderPass, name });
-    return renderPasses.back();
-}
-
-bool RenderingDevice::destroyRenderPass(const std::string& name) {
-    uint32_t i;
-    for (i = 0; i < renderPasses.size(); i++) {
-        if (renderPasses[i].name == name) {
-            vkDestroyRenderPass(vulkanContext.device, renderPasses[i].renderPass, nullptr);
-            break;
-        }
-    }
-
-    renderPasses.erase(renderPasses.begin() + i);
-
-    return i < renderPasses.size();
+    return renderPasses.insert({ renderPass, name });
 }
 
 VkCommandBuffer RenderingDevice::getCommandBuffer(int frameIdx) {
@@ -105,6 +145,15 @@ VkCommandBuffer RenderingDevice::getCommandBufferOneTime(int frameIdx, bool begi
     return commandBufferManager.getCommandBufferOneTime(frameIdx, begin);
 }
 
+VkCommandBuffer RenderingDevice::getComputeCommandBuffer(int frameIdx, bool begin) {
+    return computeCommandBufferManager.getCommandBufferOneTime(frameIdx, begin);
+}
+
+void RenderingDevice::resetCommandPool(uint32_t frameIdx) {
+    commandBufferManager.resetPool(frameIdx);
+    computeCommandBufferManager.resetPool(frameIdx);
+}
+
 void RenderingDevice::commandBufferSubmitIdle(VkCommandBuffer* buffer, VkQueueFlagBits queueType) {
     CHECK_VKRESULT(vkEndCommandBuffer(*buffer));
 
@@ -119,6 +168,9 @@ void RenderingDevice::commandBufferSubmitIdle(VkCommandBuffer* buffer, VkQueueFl
         case VK_QUEUE_GRAPHICS_BIT:
             queue = vulkanContext.graphicsQueue;
             break;
+        case VK_QUEUE_COMPUTE_BIT:
+            queue = vulkanContext.computeQueue;
+            break;
         default:
             queue = VK_NULL_HANDLE;
             break;
@@ -128,7 +180,98 @@ void RenderingDevice::commandBufferSubmitIdle(VkCommandBuffer* buffer, VkQueueFl
     vkQueueWaitIdle(queue);
 }
 
-VkPipelineLayout RenderingDevice::createPipelineLayout(const Shader& shader) {
+void RenderingDevice::setFramesInFlight(uint32_t framesInFlight) {
+    commandBufferManager.destroy();
+    commandBufferManager.initialize(framesInFlight, vulkanContext.graphicsQueueFamilyIndex);
+    computeCommandBufferManager.destroy();
+    computeCommandBufferManager.initialize(framesInFlight, vulkanContext.computeQueueFamilyIndex);
+}
+
+VkSemaphore RenderingDevice::createTimelineSemaphore(uint64_t initialValue) {
+    VkSemaphoreTypeCreateInfo typeCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = initialValue
+    };
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &typeCreateInfo
+    };
+
+    VkSemaphore semaphore;
+    CHECK_VKRESULT(vkCreateSemaphore(vulkanContext.device, &semaphoreCreateInfo, nullptr, &semaphore));
+
+    return semaphore;
+}
+
+void RenderingDevice::submit(VkQueue queue, std::span<const VkCommandBuffer> commandBuffers,
+        std::span<const SemaphoreSubmitInfo> waits, std::span<const SemaphoreSubmitInfo> signals) {
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<uint64_t> waitValues;
+    std::vector<VkPipelineStageFlags> waitStages;
+    for (const auto& wait : waits) {
+        waitSemaphores.push_back(wait.semaphore);
+        waitValues.push_back(wait.value);
+        waitStages.push_back(wait.stageMask);
+    }
+
+    std::vector<VkSemaphore> signalSemaphores;
+    std::vector<uint64_t> signalValues;
+    for (const auto& signal : signals) {
+        signalSemaphores.push_back(signal.semaphore);
+        signalValues.push_back(signal.value);
+    }
+
+    // binary semaphores mixed in here simply ignore their value
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size()),
+        .pWaitSemaphoreValues = waitValues.data(),
+        .signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size()),
+        .pSignalSemaphoreValues = signalValues.data()
+    };
+
+    VkSubmitInfo submitInfo{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineSubmitInfo,
+        .waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+        .pWaitSemaphores = waitSemaphores.data(),
+        .pWaitDstStageMask = waitStages.data(),
+        .commandBufferCount = static_cast<uint32_t>(commandBuffers.size()),
+        .pCommandBuffers = commandBuffers.data(),
+        .signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size()),
+        .pSignalSemaphores = signalSemaphores.data()
+    };
+
+    CHECK_VKRESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+}
+
+uint64_t RenderingDevice::getCompletedFrame() const {
+    uint64_t value = 0;
+    CHECK_VKRESULT(vkGetSemaphoreCounterValue(vulkanContext.device, frameTimeline, &value));
+
+    return value;
+}
+
+void RenderingDevice::waitForFrame(uint64_t frame) const {
+    if (frame == 0) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &frameTimeline,
+        .pValues = &frame
+    };
+
+    CHECK_VKRESULT(vkWaitSemaphores(vulkanContext.device, &waitInfo, UINT64_MAX));
+}
+
+PipelineLayoutHandle RenderingDevice::createPipelineLayout(ShaderHandle shaderHandle) {
+    const Shader& shader = *shaders.get(shaderHandle);
+
     // TODO: set up shader reflection and get descriptor layouts from shader
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{ ///< good idea to separate this out
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -149,25 +292,45 @@ VkPipelineLayout RenderingDevice::createPipelineLayout(const Shader& shader) {
     VkPipelineLayout pipelineLayout;
     CHECK_VKRESULT(vkCreatePipelineLayout(vulkanContext.device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
 
-    pipelineLayouts.push_back(pipelineLayout);
-    return pipelineLayout;
+    return pipelineLayouts.insert(std::move(pipelineLayout));
 }
 
-VkPipeline RenderingDevice::createPipeline(const PipelineInfo& pipelineInfo, const Shader& shader) {
-    //Shader shader = createShaderFromSPIRV(pipelineInfo.shaders);
+PipelineHandle RenderingDevice::createPipeline(const PipelineInfo& pipelineInfo, ShaderHandle shaderHandle) {
+    const Shader& shader = *shaders.get(shaderHandle);
 
     VkPipeline pipeline;
 
     if (shader.isGraphicsPipeline) {
-        auto bindingDescription = Vertex::getBindingDescription(0);
-        auto attributeDescriptions = Vertex::getAttributeDescriptions(0);
+        const VertexInputDescription vertexInput = getVertexInput(pipelineInfo.vertexFormat, pipelineInfo.positionOnly);
+
+        // constant_id 0 of the vertex stage selects how the shader decodes its inputs
+        const VkBool32 packedVertices = vertexInput.packed ? VK_TRUE : VK_FALSE;
+        const VkSpecializationMapEntry specializationEntry{
+            .constantID = 0,
+            .offset = 0,
+            .size = sizeof(VkBool32)
+        };
+        const VkSpecializationInfo specializationInfo{
+            .mapEntryCount = 1,
+            .pMapEntries = &specializationEntry,
+            .dataSize = sizeof(VkBool32),
+            .pData = &packedVertices
+        };
+
+        std::array<VkPipelineShaderStageCreateInfo, 5> stages;
+        for (uint32_t i = 0; i < shader.activeShaders; i++) {
+            stages[i] = shader.shaderStageCreateInfo[i];
+            if (stages[i].stage == VK_SHADER_STAGE_VERTEX_BIT) {
+                stages[i].pSpecializationInfo = &specializationInfo;
+            }
+        }
 
         VkPipelineVertexInputStateCreateInfo vertexInputState{
             .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-            .vertexBindingDescriptionCount = 1,
-            .pVertexBindingDescriptions = &bindingDescription,
-            .vertexAttributeDescriptionCount = (uint32_t)attributeDescriptions.size(),
-            .pVertexAttributeDescriptions = attributeDescriptions.data()
+            .vertexBindingDescriptionCount = (uint32_t)vertexInput.bindings.size(),
+            .pVertexBindingDescriptions = vertexInput.bindings.data(),
+            .vertexAttributeDescriptionCount = (uint32_t)vertexInput.attributes.size(),
+            .pVertexAttributeDescriptions = vertexInput.attributes.data()
         };
 
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyState{
@@ -231,10 +394,20 @@ VkPipeline RenderingDevice::createPipeline(const PipelineInfo& pipelineInfo, con
             .pAttachments = pipelineInfo.blendStateInfo.blendStates
         };
 
+        // without a render pass only the attachment formats need to match at draw time
+        VkPipelineRenderingCreateInfoKHR renderingCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+            .colorAttachmentCount = pipelineInfo.renderingFormats.colorAttachmentCount,
+            .pColorAttachmentFormats = pipelineInfo.renderingFormats.colorFormats,
+            .depthAttachmentFormat = pipelineInfo.renderingFormats.depthFormat,
+            .stencilAttachmentFormat = Texture::hasStencil(pipelineInfo.renderingFormats.depthFormat) ? pipelineInfo.renderingFormats.depthFormat : VK_FORMAT_UNDEFINED
+        };
+
         VkGraphicsPipelineCreateInfo pipelineCreateInfo{
             .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = pipelineInfo.renderPass == VK_NULL_HANDLE ? &renderingCreateInfo : nullptr,
             .stageCount = shader.activeShaders,
-            .pStages = shader.shaderStageCreateInfo,
+            .pStages = stages.data(),
             .pVertexInputState = &vertexInputState,
             .pInputAssemblyState = &inputAssemblyState,
             .pViewportState = &viewportState,
@@ -245,7 +418,7 @@ VkPipeline RenderingDevice::createPipeline(const PipelineInfo& pipelineInfo, con
             .pDynamicState = &dynamicState,
             .layout = pipelineInfo.pipelineLayout,
             .renderPass = pipelineInfo.renderPass,
-            .subpass = 0,
+            .subpass = pipelineInfo.subpass,
             .basePipelineHandle = VK_NULL_HANDLE,
             .basePipelineIndex = -1
         };
@@ -261,48 +434,153 @@ VkPipeline RenderingDevice::createPipeline(const PipelineInfo& pipelineInfo, con
         CHECK_VKRESULT(vkCreateComputePipelines(vulkanContext.device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
     }
 
-    pipelines.push_back(pipeline);
-
-    return pipeline;
+    return pipelines.insert(std::move(pipeline));
 }
 
-Buffer* RenderingDevice::createBuffer(VkBufferUsageFlags usageFlags, VmaMemoryUsage properties, VkDeviceSize size, const void* data) {
+BufferHandle RenderingDevice::createBuffer(VkBufferUsageFlags usageFlags, VmaMemoryUsage properties, VkDeviceSize size, const void* data) {
     std::unique_ptr<Buffer> newBuffer = nullptr;
 
     // check usage flags and create appropriate buffers
     if (usageFlags & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
         newBuffer = std::make_unique<UniformBuffer>(size, data);
-    } else if (usageFlags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+    } else if ((usageFlags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) && properties == VMA_MEMORY_USAGE_CPU_TO_GPU) {
+        // host written storage, device local storage buffers (e.g. indirect arguments) keep their usage flags
         newBuffer = std::make_unique<StorageBuffer>(size, data);
     } else {
         newBuffer = std::make_unique<Buffer>(size, usageFlags, properties, data);
     }
 
-    bufferObjects.push_back(std::move(newBuffer));
-    return newBuffer.get();
+    return bufferObjects.insert(std::move(newBuffer));
 }
 
-Texture* RenderingDevice::createTexture(TextureType type, const glm::ivec2& extent, TextureInfo texInfo, VkDeviceSize size, const void* data) {
+TextureHandle RenderingDevice::createTexture(TextureType type, const glm::ivec2& extent, TextureInfo texInfo, VkDeviceSize size, const void* data) {
     std::unique_ptr<Texture> newTexture = nullptr;
 
     if (type == TEXTURE_DEPTH) {
         newTexture = std::make_unique<TextureDepth>(extent, texInfo.samples);
+    } else if (type == TEXTURE_ATTACHMENT) {
+        newTexture = std::make_unique<TextureAttachment>(glm::uvec2(extent), texInfo.format, texInfo.usage, texInfo.samples);
     } else { // default to 2D texture
         newTexture = std::make_unique<Texture2D>(extent, data, size, texInfo.format, texInfo.layout, texInfo.usage, texInfo.filter,
                 texInfo.addressMode, texInfo.samples, texInfo.aniso, texInfo.mipmap);
     }
 
-    textureObjects.push_back(std::move(newTexture));
-    return newTexture.get();
+    return textureObjects.insert(std::move(newTexture));
+}
+
+TextureHandle RenderingDevice::loadTextureFromFile(const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso, bool mipmap,
+        VkFormat format, uint32_t channel) {
+    std::unique_ptr<Texture> newTexture = std::make_unique<Texture2D>(filename, filter, addressMode, aniso, mipmap, format, channel);
+
+    return textureObjects.insert(std::move(newTexture));
+}
+
+TextureHandle RenderingDevice::createTextureFromContainer(TextureFile& file, const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso,
+        uint32_t channel) {
+    std::unique_ptr<Texture> newTexture = std::make_unique<Texture2D>(file, filename, filter, addressMode, aniso, channel);
+
+    return textureObjects.insert(std::move(newTexture));
+}
+
+TextureHandle RenderingDevice::addTexture(std::unique_ptr<Texture> texture) {
+    return textureObjects.insert(std::move(texture));
+}
+
+bool RenderingDevice::supportsHostImageCopy(VkFormat format, VkImageUsageFlags usage, VkImageCreateFlags flags, VkImageLayout layout) const {
+    const std::vector<VkImageLayout>& layouts = vulkanContext.hostCopyDstLayouts;
+    if (!vulkanContext.hostImageCopy || std::find(layouts.begin(), layouts.end(), layout) == layouts.end()) {
+        return false;
+    }
+
+    VkFormatProperties3KHR formatProperties3{
+        .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3_KHR
+    };
+    VkFormatProperties2 formatProperties{
+        .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+        .pNext = &formatProperties3
+    };
+    vkGetPhysicalDeviceFormatProperties2(vulkanContext.physicalDevice, format, &formatProperties);
+    if (!(formatProperties3.optimalTilingFeatures & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT)) {
+        return false;
+    }
+
+    VkHostImageCopyDevicePerformanceQueryEXT performance{
+        .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT
+    };
+    VkImageFormatProperties2 imageFormatProperties{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+        .pNext = &performance
+    };
+    const VkPhysicalDeviceImageFormatInfo2 imageFormatInfo{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+        .format = format,
+        .type = VK_IMAGE_TYPE_2D,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT,
+        .flags = flags
+    };
+    if (vkGetPhysicalDeviceImageFormatProperties2(vulkanContext.physicalDevice, &imageFormatInfo, &imageFormatProperties) != VK_SUCCESS) {
+        return false;
+    }
+
+    return performance.optimalDeviceAccess;
 }
 
-Texture* RenderingDevice::loadTextureFromFile(const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso, bool mipmap) {
-    textureObjects.push_back(std::make_unique<Texture2D>(filename, filter, addressMode, aniso, mipmap));
+VkSampler RenderingDevice::getSampler(const SamplerInfo& info) {
+    std::lock_guard<std::mutex> lock(samplerMutex);
 
-    return textureObjects.back().get();
+    auto it = samplers.find(info);
+    if (it != samplers.end()) {
+        return it->second;
+    }
+
+    const bool anisotropic = info.anisotropic && vulkanContext.deviceFeatures.samplerAnisotropy;
+
+    VkSamplerCreateInfo samplerCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = info.filter,
+        .minFilter = info.filter,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .addressModeU = info.addressMode,
+        .addressModeV = info.addressMode,
+        .addressModeW = info.addressMode,
+        .mipLodBias = 0.f,
+        .anisotropyEnable = anisotropic,
+        .maxAnisotropy = anisotropic ? vulkanContext.deviceProperties.limits.maxSamplerAnisotropy : 1.f,
+        .compareEnable = VK_FALSE,
+        .compareOp = VK_COMPARE_OP_ALWAYS,
+        .minLod = info.minLod,
+        .maxLod = info.maxLod,
+        .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK,
+        .unnormalizedCoordinates = VK_FALSE
+    };
+
+    VkSampler sampler;
+    CHECK_VKRESULT(vkCreateSampler(vulkanContext.device, &samplerCreateInfo, nullptr, &sampler));
+    samplers.emplace(info, sampler);
+
+    return sampler;
 }
 
-Shader RenderingDevice::createShaderFromSPIRV(const ShaderStageInfo& shaderInfo) {
+TextureHandle RenderingDevice::getPlaceholderTexture() {
+    if (!textureObjects.contains(placeholderTexture)) {
+        const uint32_t white = 0xffffffff;
+        placeholderTexture = createTexture(TEXTURE_2D, { 1, 1 },
+                {
+                        VK_FORMAT_R8G8B8A8_UNORM,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_IMAGE_USAGE_SAMPLED_BIT,
+                        VK_FILTER_LINEAR,
+                        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                        VK_SAMPLE_COUNT_1_BIT,
+                },
+                sizeof(white), &white);
+    }
+
+    return placeholderTexture;
+}
+
+ShaderHandle RenderingDevice::createShaderFromSPIRV(const ShaderStageInfo& shaderInfo) {
     Shader shader{
         .name = shaderInfo.name,
         .activeShaders = shaderInfo.stageCount,
@@ -326,9 +604,93 @@ Shader RenderingDevice::createShaderFromSPIRV(const ShaderStageInfo& shaderInfo)
         shader.shaderStageCreateInfo[i] = shaderStageInfo;
     }
 
-    shaders.push_back(shader);
+    return shaders.insert(std::move(shader));
+}
 
-    return shader;
+MemoryHandle RenderingDevice::allocateMemory(const VkMemoryRequirements& requirements, VmaMemoryUsage usage) {
+    VmaAllocationCreateInfo allocCreateInfo{
+        .usage = usage
+    };
+
+    VmaAllocation allocation;
+    CHECK_VKRESULT(vmaAllocateMemory(vulkanContext.allocator, &requirements, &allocCreateInfo, &allocation, nullptr));
+
+    return memoryBlocks.insert(std::move(allocation));
+}
+
+void RenderingDevice::destroyBuffer(BufferHandle handle) {
+    std::unique_ptr<Buffer> buffer;
+    if (bufferObjects.remove(handle, buffer)) {
+        Buffer* released = buffer.release();
+        deferDestroy([released]() { delete released; });
+    }
+}
+
+void RenderingDevice::destroyTexture(TextureHandle handle) {
+    std::unique_ptr<Texture> texture;
+    if (textureObjects.remove(handle, texture)) {
+        Texture* released = texture.release();
+        deferDestroy([released]() { delete released; });
+    }
+}
+
+void RenderingDevice::destroyShader(ShaderHandle handle) {
+    Shader shader;
+    if (shaders.remove(handle, shader)) {
+        deferDestroy([this, shader]() { releaseShader(shader); });
+    }
+}
+
+void RenderingDevice::destroyPipeline(PipelineHandle handle) {
+    VkPipeline pipeline;
+    if (pipelines.remove(handle, pipeline)) {
+        VkDevice device = vulkanContext.device;
+        deferDestroy([device, pipeline]() { vkDestroyPipeline(device, pipeline, nullptr); });
+    }
+}
+
+void RenderingDevice::destroyPipelineLayout(PipelineLayoutHandle handle) {
+    VkPipelineLayout pipelineLayout;
+    if (pipelineLayouts.remove(handle, pipelineLayout)) {
+        VkDevice device = vulkanContext.device;
+        deferDestroy([device, pipelineLayout]() { vkDestroyPipelineLayout(device, pipelineLayout, nullptr); });
+    }
+}
+
+void RenderingDevice::destroyRenderPass(RenderPassHandle handle) {
+    RenderPass renderPass;
+    if (renderPasses.remove(handle, renderPass)) {
+        VkDevice device = vulkanContext.device;
+        VkRenderPass pass = renderPass.renderPass;
+        deferDestroy([device, pass]() { vkDestroyRenderPass(device, pass, nullptr); });
+    }
+}
+
+void RenderingDevice::freeMemory(MemoryHandle handle) {
+    VmaAllocation allocation;
+    if (memoryBlocks.remove(handle, allocation)) {
+        VmaAllocator allocator = vulkanContext.allocator;
+        deferDestroy([allocator, allocation]() { vmaFreeMemory(allocator, allocation); });
+    }
+}
+
+void RenderingDevice::beginFrame(uint64_t frame) {
+    currentFrame = frame;
+    deletionQueue.flush(getCompletedFrame());
+}
+
+void RenderingDevice::deferDestroy(std::function<void()>&& deleter) {
+    // anything released now may still be referenced by the frame being recorded
+    deletionQueue.push(currentFrame, std::move(deleter));
+}
+
+void RenderingDevice::releaseShader(const Shader& shader) {
+    for (size_t i = 0; i < shader.activeShaders; i++) {
+        vkDestroyShaderModule(vulkanContext.device, shader.shaderStageCreateInfo[i].module, nullptr);
+    }
+    for (const auto& layout : shader.layouts) {
+        vkDestroyDescriptorSetLayout(vulkanContext.device, layout, nullptr);
+    }
 }
 
 void RenderingDevice::windowResizeCallback(GLFWwindow* window, int width, int height) {
@@ -338,11 +700,13 @@ void RenderingDevice::windowResizeCallback(GLFWwindow* window, int width, int he
 
 RenderingDevice::~RenderingDevice() {
     vkDeviceWaitIdle(vulkanContext.device);
+    deletionQueue.flushAll();
 
     //cleanupRenderArea();
-    for (const auto pass : renderPasses) {
+    renderPasses.forEach([this](const RenderPass& pass) {
         vkDestroyRenderPass(vulkanContext.device, pass.renderPass, nullptr);
-    }
+    });
+    renderPasses.clear();
 
     //vkDestroyDescriptorPool(vulkanContext.device, descriptorPool, nullptr);
     //for (size_t i = 0; i < descriptorSetLayouts.size(); i++) {
@@ -351,26 +715,42 @@ RenderingDevice::~RenderingDevice() {
     //vkDestroyDescriptorSetLayout(vulkanContext.device, depthPassDescriptorSetLayout, nullptr);
     descriptorAllocator.clearPools();
     descriptorAllocator.destroyPools();
+    mipGenerator.destroy();
 
-    for (const auto& shader : shaders) {
-        for (size_t i = 0; i < shader.activeShaders; i++) {
-            vkDestroyShaderModule(vulkanContext.device, shader.shaderStageCreateInfo[i].module, nullptr);
-        }
-    }
+    shaders.forEach([this](const Shader& shader) {
+        releaseShader(shader);
+    });
     shaders.clear();
 
     // should destroy objects
     bufferObjects.clear();
     textureObjects.clear();
 
+    for (const auto& [info, sampler] : samplers) {
+        vkDestroySampler(vulkanContext.device, sampler, nullptr);
+    }
+    samplers.clear();
+
+    // memory goes after the textures that may be bound to it
+    memoryBlocks.forEach([this](VmaAllocation allocation) {
+        vmaFreeMemory(vulkanContext.allocator, allocation);
+    });
+    memoryBlocks.clear();
+
     //vkDestroyCommandPool(vulkanContext.device, commandPool, nullptr);
     commandBufferManager.destroy();
-
-    ///< should have same number of pipeline and pipeline layouts (at this point)
-    for (size_t i = 0; i < pipelines.size(); i++) {
-        vkDestroyPipeline(vulkanContext.device, pipelines[i], nullptr);
-        vkDestroyPipelineLayout(vulkanContext.device, pipelineLayouts[i], nullptr);
-    }
+    computeCommandBufferManager.destroy();
+    vkDestroySemaphore(vulkanContext.device, frameTimeline, nullptr);
+    vkDestroySemaphore(vulkanContext.device, computeTimeline, nullptr);
+
+    pipelines.forEach([this](VkPipeline pipeline) {
+        vkDestroyPipeline(vulkanContext.device, pipeline, nullptr);
+    });
+    pipelines.clear();
+    pipelineLayouts.forEach([this](VkPipelineLayout pipelineLayout) {
+        vkDestroyPipelineLayout(vulkanContext.device, pipelineLayout, nullptr);
+    });
+    pipelineLayouts.clear();
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -382,7 +762,22 @@ RenderingDevice* RenderingDevice::getSingleton() {
 }
 
 void RenderingDevice::updateSwapchain(uint32_t* width, uint32_t* height) {
+    // the old swapchain is handed over to the new one and released after in-flight frames are done presenting from it
+    VkSwapchainKHR oldSwapchain = vulkanContext.swapChain.swapchain;
+    std::vector<VkImageView> oldImageViews = vulkanContext.swapChain.swapchainImageViews;
+
     vulkanContext.updateSwapchain(window);
+
+    if (oldSwapchain != VK_NULL_HANDLE) {
+        VkDevice device = vulkanContext.device;
+        deferDestroy([device, oldSwapchain, oldImageViews]() {
+            for (const auto& imageView : oldImageViews) {
+                vkDestroyImageView(device, imageView, nullptr);
+            }
+            vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+        });
+    }
+
     *width = vulkanContext.swapChain.width;
     *height = vulkanContext.swapChain.height;
 }
@@ -3,11 +3,17 @@
 #include <glfw/glfw3.h>
 #include <volk.h>
 #include <glm/glm.hpp>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <span>
 
 #include <graphics/vulkan/vulkan_context.h>
 #include <graphics/vulkan/command_buffer.h>
+#include <graphics/vulkan/deletion_queue.h>
+#include <graphics/vulkan/mip_generator.h>
 #include <graphics/vulkan/pipeline.h>
+#include <graphics/vulkan/resource_pool.h>
 
 namespace sublimation {
 
@@ -21,6 +27,24 @@ struct TextureInfo;
 struct PipelineInfo;
 class RenderTarget;
 
+// timeline semaphore wait/signal used by submit
+struct SemaphoreSubmitInfo {
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t value = 0; ///< ignored for binary semaphores
+    VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT; ///< only used for waits
+};
+
+// key of the sampler cache, the default lod range leaves clamping to the image view
+struct SamplerInfo {
+    VkFilter filter = VK_FILTER_LINEAR;
+    VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    bool anisotropic = false;
+    float minLod = 0.f;
+    float maxLod = VK_LOD_CLAMP_NONE;
+
+    auto operator<=>(const SamplerInfo&) const = default;
+};
+
 class RenderingDevice {
 protected:
     RenderingDevice() {}
@@ -29,7 +53,7 @@ public:
     ~RenderingDevice();
     static RenderingDevice* getSingleton();
 
-    void initialize();
+    void initialize(uint32_t framesInFlight = 2);
 
     GLFWwindow* getWindow() const { return window; }
     glm::uvec2 getWindowSize() const { return { width, height }; }
@@ -43,36 +67,111 @@ public:
 
     const VkQueue& getGraphicsQueue() const { return vulkanContext.graphicsQueue; }
     const VkQueue& getComputeQueue() const { return vulkanContext.computeQueue; }
+    const VkQueue& getPresentQueue() const { return vulkanContext.presentQueue; }
     const Swapchain& getSwapChain() const { return vulkanContext.swapChain; }
 
     uint32_t getGraphicsQueueFamily() const { return vulkanContext.graphicsQueueFamilyIndex; }
     uint32_t getPresentQueueFamily() const { return vulkanContext.presentQueueFamilyIndex; }
     uint32_t getComputeQueueFamily() const { return vulkanContext.computeQueueFamilyIndex; }
+    // true when compute submissions can run alongside graphics instead of queueing behind it
+    bool hasAsyncCompute() const { return vulkanContext.asyncCompute; }
+    // VK_KHR_dynamic_rendering, render targets can be drawn to without render pass and framebuffer objects
+    bool hasDynamicRendering() const { return vulkanContext.dynamicRendering; }
+    bool hasHostImageCopy() const { return vulkanContext.hostImageCopy; }
+    // the largest device local heap is host visible, as on integrated and software devices or with resizable BAR
+    bool hasUnifiedMemory() const { return unifiedMemory; }
+    // whether images of format and usage can be written from the host while in layout, only where that doesn't make them
+    // slower to access on the device, which rules out most discrete GPUs
+    bool supportsHostImageCopy(VkFormat format, VkImageUsageFlags usage, VkImageCreateFlags flags, VkImageLayout layout) const;
 
     DescriptorAllocator& getDescriptorAllocator() { return descriptorAllocator; }
+    MipGenerator& getMipGenerator() { return mipGenerator; }
 
     const VkCommandPool& getCommandPool(uint32_t frameIndex) { return commandBufferManager.getCommandPool(frameIndex); }
     VkSampleCountFlagBits getMSAASamples() const { return multisampling; }
+    // highest count usable for both color and depth attachments
+    VkSampleCountFlagBits getMaxMSAASamples() const;
+    // clamped to getMaxMSAASamples(), pipelines and attachments created afterwards pick it up
+    void setMSAASamples(VkSampleCountFlagBits samples);
+    // tile based GPUs can back transient attachments with memory that is never committed
+    bool hasLazilyAllocatedMemory() const;
     VkCommandBuffer getCommandBuffer(int frameIdx);
     VkCommandBuffer getCommandBufferOneTime(int frameIdx, bool begin = true);
+    VkCommandBuffer getComputeCommandBuffer(int frameIdx, bool begin = true);
     void commandBufferSubmitIdle(VkCommandBuffer* buffer, VkQueueFlagBits queueType);
+    void resetCommandPool(uint32_t frameIdx);
+    uint32_t getFramesInFlight() const { return commandBufferManager.getNumPools(); }
+    // recreates the per-frame command pools, caller must make sure none of them are still in use
+    void setFramesInFlight(uint32_t framesInFlight);
+
+    VkSemaphore createTimelineSemaphore(uint64_t initialValue = 0);
+    void submit(VkQueue queue, std::span<const VkCommandBuffer> commandBuffers,
+            std::span<const SemaphoreSubmitInfo> waits, std::span<const SemaphoreSubmitInfo> signals);
     uint32_t getMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
-    RenderPass createRenderPass(const RenderTarget& target, const VkSubpassDependency& dependency, const std::string& name);
-    bool destroyRenderPass(const std::string& name);
-    VkPipelineLayout createPipelineLayout(const Shader& shader);
-    VkPipeline createPipeline(const PipelineInfo& pipelineInfo, const Shader& shader);
-
-    Buffer* createBuffer(VkBufferUsageFlags usageFlags, VmaMemoryUsage properties, VkDeviceSize size, const void* data = nullptr);
-    Texture* createTexture(TextureType type, const glm::ivec2& extent, TextureInfo texInfo, VkDeviceSize size, const void* data = nullptr);
-    Texture* loadTextureFromFile(const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso, bool mipmap);
-
-    Shader createShaderFromSPIRV(const ShaderStageInfo& shaderInfo);
+    // one subpass per subpass of the target
+    RenderPassHandle createRenderPass(const RenderTarget& target, std::span<const VkSubpassDependency> dependencies, const std::string& name);
+    PipelineLayoutHandle createPipelineLayout(ShaderHandle shader);
+    PipelineHandle createPipeline(const PipelineInfo& pipelineInfo, ShaderHandle shader);
+
+    BufferHandle createBuffer(VkBufferUsageFlags usageFlags, VmaMemoryUsage properties, VkDeviceSize size, const void* data = nullptr);
+    TextureHandle createTexture(TextureType type, const glm::ivec2& extent, TextureInfo texInfo, VkDeviceSize size, const void* data = nullptr);
+    // format and channel pick the storage of decoded images, see Texture2D
+    TextureHandle loadTextureFromFile(const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso, bool mipmap,
+            VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, uint32_t channel = 0);
+    // uploads a container read earlier, e.g. on a worker thread, see TextureStreamer
+    TextureHandle createTextureFromContainer(TextureFile& file, const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso,
+            uint32_t channel = 0);
+    // textures built on other threads, which is only safe when they were written with host image copy
+    TextureHandle addTexture(std::unique_ptr<Texture> texture);
+
+    // samplers are shared by everything created with the same info and live as long as the device, safe to call from any thread
+    VkSampler getSampler(const SamplerInfo& info);
+
+    // one white 1x1 texture for descriptors of slots that have nothing to sample, created on first use
+    TextureHandle getPlaceholderTexture();
+
+    ShaderHandle createShaderFromSPIRV(const ShaderStageInfo& shaderInfo);
+
+    // raw device memory for placing resources manually (e.g. aliased render graph attachments)
+    MemoryHandle allocateMemory(const VkMemoryRequirements& requirements, VmaMemoryUsage usage = VMA_MEMORY_USAGE_GPU_ONLY);
+
+    // Resource lookup, returns nullptr (or VK_NULL_HANDLE) for stale handles
+    Buffer* getBuffer(BufferHandle handle) { return bufferObjects.contains(handle) ? bufferObjects.get(handle)->get() : nullptr; }
+    Texture* getTexture(TextureHandle handle) { return textureObjects.contains(handle) ? textureObjects.get(handle)->get() : nullptr; }
+    Shader* getShader(ShaderHandle handle) { return shaders.get(handle); }
+    VkPipeline getPipeline(PipelineHandle handle) { return pipelines.contains(handle) ? *pipelines.get(handle) : VK_NULL_HANDLE; }
+    VkPipelineLayout getPipelineLayout(PipelineLayoutHandle handle) { return pipelineLayouts.contains(handle) ? *pipelineLayouts.get(handle) : VK_NULL_HANDLE; }
+    VkRenderPass getRenderPass(RenderPassHandle handle) { return renderPasses.contains(handle) ? renderPasses.get(handle)->renderPass : VK_NULL_HANDLE; }
+    VmaAllocation getMemory(MemoryHandle handle) { return memoryBlocks.contains(handle) ? *memoryBlocks.get(handle) : VK_NULL_HANDLE; }
+
+    // Resource destruction, slots are returned to their pool for reuse right away
+    // while the Vulkan objects are only released once in-flight frames that may use them have retired
+    void destroyBuffer(BufferHandle handle);
+    void destroyTexture(TextureHandle handle);
+    void destroyShader(ShaderHandle handle);
+    void destroyPipeline(PipelineHandle handle);
+    void destroyPipelineLayout(PipelineLayoutHandle handle);
+    void destroyRenderPass(RenderPassHandle handle);
+    void freeMemory(MemoryHandle handle);
+
+    // Frame timeline, value N is signalled once all GPU work of frame N has completed
+    // other queues can wait on (or signal) the same values to stay in step with the frame loop
+    VkSemaphore getFrameTimeline() const { return frameTimeline; }
+    // value N is signalled once the async compute work of frame N has completed
+    VkSemaphore getComputeTimeline() const { return computeTimeline; }
+    uint64_t getCompletedFrame() const;
+    void waitForFrame(uint64_t frame) const;
+
+    // starts recording of the given frame, releases everything queued by frames that have retired
+    void beginFrame(uint64_t frame);
+    void deferDestroy(std::function<void()>&& deleter);
 
     void deviceWaitIdle() const { vkDeviceWaitIdle(vulkanContext.device); }
     void updateSwapchain(uint32_t* width, uint32_t* height);
 
 private:
+    void releaseShader(const Shader& shader);
 
     static void windowResizeCallback(GLFWwindow* window, int width, int height);
 
@@ -84,7 +183,20 @@ private:
     GLFWwindow* window;
     VulkanContext vulkanContext;
     CommandBufferManager commandBufferManager;
+    CommandBufferManager computeCommandBufferManager; ///< pools on the compute queue family
     DescriptorAllocator descriptorAllocator;
+    MipGenerator mipGenerator;
+    DeletionQueue deletionQueue;
+
+    VkSemaphore frameTimeline = VK_NULL_HANDLE;
+    VkSemaphore computeTimeline = VK_NULL_HANDLE;
+    uint64_t currentFrame = 0;
+
+    bool unifiedMemory = false;
+
+    TextureHandle placeholderTexture;
+    std::map<SamplerInfo, VkSampler> samplers;
+    std::mutex samplerMutex;
 
     ////< Main render pass (obsolete)
     //std::vector<VkDescriptorSetLayout> descriptorSetLayouts; // scene buffers + material images
@@ -105,12 +217,13 @@ private:
     //uint32_t frameIndex = 0;
 
     // Resources to manage
-    std::vector<VkPipeline> pipelines;
-    std::vector<VkPipelineLayout> pipelineLayouts;
-    std::vector<RenderPass> renderPasses;
-    std::vector<Shader> shaders;
-    std::vector<std::unique_ptr<Buffer>> bufferObjects;
-    std::vector<std::unique_ptr<Texture>> textureObjects;
+    ResourcePool<VkPipeline, VkPipeline> pipelines;
+    ResourcePool<VkPipelineLayout, VkPipelineLayout> pipelineLayouts;
+    ResourcePool<RenderPass, RenderPass> renderPasses;
+    ResourcePool<Shader, Shader> shaders;
+    ResourcePool<std::unique_ptr<Buffer>, Buffer> bufferObjects;
+    ResourcePool<std::unique_ptr<Texture>, Texture> textureObjects;
+    ResourcePool<VmaAllocation, VmaAllocation> memoryBlocks;
 
     VkSampleCountFlagBits multisampling = VK_SAMPLE_COUNT_8_BIT;
 };
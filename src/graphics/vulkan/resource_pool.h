@@ -0,0 +1,127 @@
+#pragma once
+
+#include <volk.h>
+#include <vk_mem_alloc.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sublimation {
+
+namespace vkw {
+
+class Buffer;
+class Texture;
+struct Shader;
+struct RenderPass;
+
+template <typename T>
+struct Handle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool isValid() const { return index != UINT32_MAX; }
+    bool operator==(const Handle& other) const = default;
+};
+
+using BufferHandle = Handle<Buffer>;
+using TextureHandle = Handle<Texture>;
+using ShaderHandle = Handle<Shader>;
+using RenderPassHandle = Handle<RenderPass>;
+using PipelineHandle = Handle<VkPipeline>;
+using PipelineLayoutHandle = Handle<VkPipelineLayout>;
+using MemoryHandle = Handle<VmaAllocation>;
+
+// Slot pool addressed by generational handles
+// freed slots go on a free list and get their generation bumped, so stale handles never resolve to a new resource
+template <typename T, typename H>
+class ResourcePool {
+public:
+    void reserve(size_t count) { slots.reserve(count); }
+
+    Handle<H> insert(T&& resource) {
+        uint32_t index;
+        if (!freeList.empty()) {
+            index = freeList.back();
+            freeList.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+
+        Slot& slot = slots[index];
+        slot.resource = std::move(resource);
+        slot.alive = true;
+        aliveCount++;
+
+        return { index, slot.generation };
+    }
+
+    bool contains(Handle<H> handle) const {
+        return handle.index < slots.size() && slots[handle.index].alive && slots[handle.index].generation == handle.generation;
+    }
+
+    T* get(Handle<H> handle) {
+        return contains(handle) ? &slots[handle.index].resource : nullptr;
+    }
+
+    // moves the resource out of its slot, caller is responsible for destroying it
+    bool remove(Handle<H> handle, T& resource) {
+        if (!contains(handle)) {
+            return false;
+        }
+
+        Slot& slot = slots[handle.index];
+        resource = std::move(slot.resource);
+        slot.resource = T{};
+        slot.alive = false;
+        slot.generation++;
+        freeList.push_back(handle.index);
+        aliveCount--;
+
+        return true;
+    }
+
+    template <typename F>
+    void forEach(F&& func) {
+        for (auto& slot : slots) {
+            if (slot.alive) {
+                func(slot.resource);
+            }
+        }
+    }
+
+    // slots are kept with their generations bumped, so handles from before the clear stay stale
+    void clear() {
+        freeList.clear();
+        for (uint32_t i = static_cast<uint32_t>(slots.size()); i-- > 0;) {
+            Slot& slot = slots[i];
+            if (slot.alive) {
+                slot.resource = T{};
+                slot.alive = false;
+                slot.generation++;
+            }
+            freeList.push_back(i);
+        }
+        aliveCount = 0;
+    }
+
+    uint32_t size() const { return aliveCount; }
+    uint32_t capacity() const { return static_cast<uint32_t>(slots.size()); }
+
+private:
+    struct Slot {
+        T resource{};
+        uint32_t generation = 0;
+        bool alive = false;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeList;
+    uint32_t aliveCount = 0;
+};
+
+} // namespace vkw
+
+} // namespace sublimation
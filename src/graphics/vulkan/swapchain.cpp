@@ -79,7 +79,7 @@ void Swapchain::update(GLFWwindow* window) {
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR, ///< may need changing
         .presentMode = swapchainPresentMode,
         .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE
+        .oldSwapchain = swapchain
     };
 
     VkResult err = vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &swapchain);
@@ -115,10 +115,23 @@ void Swapchain::update(GLFWwindow* window) {
     }
 }
 
-VkResult Swapchain::acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex) {
+VkResult Swapchain::acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex) const {
     return vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, imageIndex);
 }
 
+VkResult Swapchain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore) const {
+    VkPresentInfoKHR presentInfo{
+        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        .waitSemaphoreCount = waitSemaphore != VK_NULL_HANDLE ? 1u : 0u,
+        .pWaitSemaphores = &waitSemaphore,
+        .swapchainCount = 1,
+        .pSwapchains = &swapchain,
+        .pImageIndices = &imageIndex
+    };
+
+    return vkQueuePresentKHR(queue, &presentInfo);
+}
+
 void Swapchain::cleanup() {
     for (auto& imageView : swapchainImageViews) {
         vkDestroyImageView(device, imageView, nullptr);
@@ -16,12 +16,14 @@ public:
     void initialize(VkInstance instance, GLFWwindow* window);
     void update(GLFWwindow* window);
 
-    VkResult acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex);
+    VkResult acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex) const;
+    VkResult queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore) const;
     void cleanup();
 
     uint32_t getImageCount() const { return imageCount; }
     VkFormat getFormat() const { return colorFormat; }
     const VkImageView& getImageView(int index) const { return swapchainImageViews[index]; }
+    VkImage getImage(int index) const { return swapchainImages[index]; }
 
 private:
     friend VulkanContext;
@@ -2,10 +2,13 @@
 
 #include <graphics/vulkan/buffer.h>
 #include <graphics/vulkan/rendering_device.h>
+#include <graphics/vulkan/texture_file.h>
 #include <graphics/vulkan/utils.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#include <algorithm>
+
 #include <graphics/render_system.h> // TODO: ???
 
 namespace sublimation {
@@ -13,12 +16,14 @@ namespace sublimation {
 namespace vkw {
 
 void Texture::createImage(VkImage& image, VmaAllocation& allocation, VmaAllocationInfo& allocInfo, const VkExtent3D& extent, VkFormat format, VkSampleCountFlagBits samples,
-        VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, uint32_t mipLevels, uint32_t arrayLayers, VkImageType imageType) {
+        VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, uint32_t mipLevels, uint32_t arrayLayers, VkImageType imageType,
+        VkImageCreateFlags flags) {
     RenderingDevice* rd = RenderingDevice::getSingleton();
     VkDevice device = rd->getDevice();
 
     VkImageCreateInfo imageCreateInfo{
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .flags = flags,
         .imageType = imageType,
         .format = format,
         .extent = extent,
@@ -40,12 +45,14 @@ void Texture::createImage(VkImage& image, VmaAllocation& allocation, VmaAllocati
 }
 
 void Texture::createImageView(VkImageView& imageView, VkImage const& image, VkImageViewType viewType, VkFormat format,
-        VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer) {
+        VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer,
+        const VkComponentMapping& components) {
     VkImageViewCreateInfo imageViewCreateInfo{
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
         .image = image,
         .viewType = viewType,
         .format = format,
+        .components = components,
         .subresourceRange = {
                 .aspectMask = imageAspect,
                 .baseMipLevel = baseMipLevel,
@@ -58,33 +65,9 @@ void Texture::createImageView(VkImageView& imageView, VkImage const& image, VkIm
     CHECK_VKRESULT(vkCreateImageView(device, &imageViewCreateInfo, nullptr, &imageView));
 }
 
-void Texture::createImageSampler(VkSampler& sampler, VkFilter filter, VkSamplerAddressMode addressMode, bool anisotropic, uint32_t mipLevels) {
-    RenderingDevice* rd = RenderingDevice::getSingleton();
-
-    float maxAniso = (anisotropic && rd->getPhysicalDeviceFeatures().samplerAnisotropy)
-            ? rd->getPhysicalDeviceProperties().limits.maxSamplerAnisotropy
-            : 1.f;
-
-    VkSamplerCreateInfo samplerCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-        .magFilter = filter,
-        .minFilter = filter,
-        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-        .addressModeU = addressMode,
-        .addressModeV = addressMode,
-        .addressModeW = addressMode,
-        .mipLodBias = 0.f,
-        .anisotropyEnable = anisotropic,
-        .maxAnisotropy = maxAniso,
-        .compareEnable = VK_FALSE,
-        .compareOp = VK_COMPARE_OP_ALWAYS,
-        .minLod = 0.f,
-        .maxLod = 0.f,
-        .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK,
-        .unnormalizedCoordinates = VK_FALSE
-    };
-
-    CHECK_VKRESULT(vkCreateSampler(rd->getDevice(), &samplerCreateInfo, nullptr, &sampler));
+VkSampler Texture::getImageSampler(VkFilter filter, VkSamplerAddressMode addressMode, bool anisotropic) {
+    // the view already limits sampling to the image's levels, so every mip count shares one sampler
+    return RenderingDevice::getSingleton()->getSampler({ .filter = filter, .addressMode = addressMode, .anisotropic = anisotropic });
 }
 
 void Texture::generateMipmaps(VkImage const& image, const VkExtent3D& extent, VkFormat format, VkImageLayout dstLayout,
@@ -96,7 +79,7 @@ void Texture::generateMipmaps(VkImage const& image, const VkExtent3D& extent, Vk
 
     assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
 
-    VkCommandBuffer commandBuffer = rd->getCommandBuffer(RenderSystem::getSingleton()->getFrameIndex());
+    VkCommandBuffer commandBuffer = rd->getCommandBufferOneTime(RenderSystem::getSingleton()->getFrameIndex());
 
     VkImageMemoryBarrier barrier{
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
@@ -157,9 +140,10 @@ void Texture::generateMipmaps(VkImage const& image, const VkExtent3D& extent, Vk
 }
 
 void Texture::transitionImageLayout(const VkImage& img, VkFormat format, VkImageLayout srcLayout, VkImageLayout dstLayout,
-        VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer) {
+        VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer,
+        VkCommandBuffer recordBuffer) {
     RenderingDevice* rd = RenderingDevice::getSingleton();
-    VkCommandBuffer commandBuffer = rd->getCommandBuffer(RenderSystem::getSingleton()->getFrameIndex());
+    VkCommandBuffer commandBuffer = recordBuffer != VK_NULL_HANDLE ? recordBuffer : rd->getCommandBufferOneTime(RenderSystem::getSingleton()->getFrameIndex());
 
     VkImageMemoryBarrier barrier{
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
@@ -208,12 +192,14 @@ void Texture::transitionImageLayout(const VkImage& img, VkFormat format, VkImage
 
     vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-    rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
+    if (recordBuffer == VK_NULL_HANDLE) {
+        rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
+    }
 }
 
 void Texture::copyBufferToImage(const VkBuffer& buffer, const VkImage& img, const VkExtent3D& extent, uint32_t layerCount, uint32_t baseArrayLayer) {
     RenderingDevice* rd = RenderingDevice::getSingleton();
-    VkCommandBuffer commandBuffer = rd->getCommandBuffer(RenderSystem::getSingleton()->getFrameIndex());
+    VkCommandBuffer commandBuffer = rd->getCommandBufferOneTime(RenderSystem::getSingleton()->getFrameIndex());
 
     VkBufferImageCopy copyRegion{
         .bufferOffset = 0,
@@ -233,6 +219,80 @@ void Texture::copyBufferToImage(const VkBuffer& buffer, const VkImage& img, cons
     rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
 }
 
+void Texture::copyBufferToImage(const VkBuffer& buffer, const VkImage& img, const VkExtent3D& extent, const std::vector<VkDeviceSize>& levelOffsets,
+        VkCommandBuffer recordBuffer) {
+    RenderingDevice* rd = RenderingDevice::getSingleton();
+    VkCommandBuffer commandBuffer = recordBuffer != VK_NULL_HANDLE ? recordBuffer : rd->getCommandBufferOneTime(RenderSystem::getSingleton()->getFrameIndex());
+
+    std::vector<VkBufferImageCopy> copyRegions(levelOffsets.size());
+    for (uint32_t level = 0; level < levelOffsets.size(); level++) {
+        copyRegions[level] = {
+            .bufferOffset = levelOffsets[level],
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1 },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u), 1 }
+        };
+    }
+
+    vkCmdCopyBufferToImage(commandBuffer, buffer, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+    if (recordBuffer == VK_NULL_HANDLE) {
+        rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
+    }
+}
+
+void Texture::copyMemoryToImage(const void* data, const VkImage& img, const VkExtent3D& extent, const std::vector<VkDeviceSize>& levelOffsets,
+        VkImageLayout layout, uint32_t mipLevels) {
+    VkDevice device = RenderingDevice::getSingleton()->getDevice();
+
+    const VkHostImageLayoutTransitionInfoEXT transition{
+        .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+        .image = img,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = layout,
+        .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = mipLevels,
+                .baseArrayLayer = 0,
+                .layerCount = 1 }
+    };
+    CHECK_VKRESULT(vkTransitionImageLayoutEXT(device, 1, &transition));
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    std::vector<VkMemoryToImageCopyEXT> copyRegions(levelOffsets.size());
+    for (uint32_t level = 0; level < levelOffsets.size(); level++) {
+        copyRegions[level] = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT,
+            .pHostPointer = bytes + levelOffsets[level],
+            .memoryRowLength = 0,
+            .memoryImageHeight = 0,
+            .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1 },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u), 1 }
+        };
+    }
+
+    const VkCopyMemoryToImageInfoEXT copyInfo{
+        .sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT,
+        .dstImage = img,
+        .dstImageLayout = layout,
+        .regionCount = static_cast<uint32_t>(copyRegions.size()),
+        .pRegions = copyRegions.data()
+    };
+    CHECK_VKRESULT(vkCopyMemoryToImageEXT(device, &copyInfo));
+}
+
 uint32_t Texture::getMipLevels(const VkExtent3D& extent) {
     return (uint32_t)std::floor(std::log2(std::max(extent.width, std::max(extent.height, extent.depth)))) + 1;
 }
@@ -278,7 +338,6 @@ Texture::Texture(VkFormat format, VkImageLayout layout, VkImageUsageFlags usage,
 Texture::~Texture() {
     VkDevice device = RenderingDevice::getSingleton()->getDevice();
 
-    vkDestroySampler(device, sampler, nullptr);
     vkDestroyImageView(device, imageView, nullptr);
     vmaDestroyImage(RenderingDevice::getSingleton()->getAllocator(), image, allocation);
 }
@@ -298,12 +357,20 @@ bool Texture::hasStencil(VkFormat format) {
     return std::find(STENCIL_FORMATS.begin(), STENCIL_FORMATS.end(), format) != std::end(STENCIL_FORMATS);
 }
 
-Texture2D::Texture2D(const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso, bool mipmap) :
-        Texture(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+// containers are uploaded as they are when the device can sample their format, decoded otherwise
+static bool isContainerFormatSupported(VkFormat format) {
+    const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    return Texture::findSupportedFormat({ format }, VK_IMAGE_TILING_OPTIMAL, features) != VK_FORMAT_UNDEFINED;
+}
+
+Texture2D::Texture2D(const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso, bool mipmap,
+        VkFormat format, uint32_t channel) :
+        Texture(format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                 filter, addressMode, VK_SAMPLE_COUNT_1_BIT, 1, 1),
         anisotropic(aniso),
-        mipmap(mipmap) {
+        mipmap(mipmap),
+        channel(channel) {
     loadFromFile(filename);
 }
 
@@ -315,26 +382,20 @@ Texture2D::Texture2D(const glm::ivec2& extent, const void* pixels, VkDeviceSize
         anisotropic(aniso),
         mipmap(mipmap) {
     this->extent = { (uint32_t)extent.x, (uint32_t)extent.y, 1 };
-    initialize();
+    initialize(pixels != nullptr);
     if (pixels) {
-        Buffer stagingBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, pixels);
-
-        initialize();
-
-        transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0);
-        copyBufferToImage(stagingBuffer.getBuffer(), image, this->extent, 1, 0);
-
-        if (mipmap) {
-            generateMipmaps(image, this->extent, format, layout, mipLevels, 0, arrayCount);
-        } else {
-            transitionImageLayout(image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layout, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0);
-        }
+        upload(pixels, bufferSize, { 0 });
     } else {
         transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED, layout, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0);
     }
 }
 
 void Texture2D::loadFromFile(const std::string& filename) {
+    if (TextureFile::isContainer(filename)) {
+        loadFromContainer(filename);
+        return;
+    }
+
     int width, height, channels;
     unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
     if (!pixels) {
@@ -345,31 +406,144 @@ void Texture2D::loadFromFile(const std::string& filename) {
         return;
     }
 
-    VkDeviceSize textureSize = width * height * 4;
+    // narrower formats keep the components from channel on, grey images are already spread over r, g and b
+    const uint32_t componentCount = getComponentCount(format);
+    const uint32_t firstChannel = std::min(channel, 4 - componentCount);
+    const size_t texelCount = static_cast<size_t>(width) * height;
+    if (componentCount < 4) {
+        for (size_t i = 0; i < texelCount; i++) {
+            for (uint32_t c = 0; c < componentCount; c++) {
+                pixels[i * componentCount + c] = pixels[i * 4 + firstChannel + c];
+            }
+        }
+    }
+
+    VkDeviceSize textureSize = texelCount * componentCount;
     extent = { (uint32_t)width, (uint32_t)height, 1 };
 
-    Buffer stagingBuffer(textureSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, pixels);
+    initialize();
+    upload(pixels, textureSize, { 0 });
     stbi_image_free(pixels);
+}
+
+Texture2D::Texture2D(TextureFile& file, const std::string& filename, VkFilter filter, VkSamplerAddressMode addressMode, bool aniso, uint32_t channel,
+        VkCommandBuffer commandBuffer) :
+        Texture(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                filter, addressMode, VK_SAMPLE_COUNT_1_BIT, 1, 1),
+        anisotropic(aniso),
+        mipmap(false),
+        channel(channel),
+        uploadCommandBuffer(commandBuffer) {
+    loadFromContainer(file, filename);
+}
+
+void Texture2D::loadFromContainer(const std::string& filename) {
+    TextureFile file;
+    if (!file.load(filename)) {
+        return;
+    }
+
+    loadFromContainer(file, filename);
+}
+
+void Texture2D::loadFromContainer(TextureFile& file, const std::string& filename) {
+    // containers come as they were written, a scalar slot reading a channel past red of a wider one gets it swizzled into red
+    if (channel > 0 && channel < getComponentCount(file.format)) {
+        components.r = static_cast<VkComponentSwizzle>(VK_COMPONENT_SWIZZLE_R + channel);
+    }
+
+    // devices that can't sample the block format get it decoded, BC is missing on most mobile GPUs
+    if (!isContainerFormatSupported(file.format)) {
+        std::cout << "INFO::Texture2D:loadFromContainer: format " << file.format << " of " << filename << " is not supported, decoding it\n";
+        if (!file.decompress()) {
+            std::cerr << "ERROR::Texture2D:loadFromContainer: no decoder for format " << file.format << " of " << filename << '\n';
+            return;
+        }
+    }
+
+    format = file.format;
+    extent = file.extent;
+    // the chain is prebuilt, block compressed images couldn't be blitted into anyway
+    mipmap = false;
+    mipLevels = static_cast<uint32_t>(file.levels.size());
+
+    std::vector<VkDeviceSize> levelOffsets;
+    for (const TextureFile::Level& level : file.levels) {
+        levelOffsets.push_back(level.offset);
+    }
 
     initialize();
+    upload(file.data.data(), file.data.size(), levelOffsets);
+}
 
-    transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0);
-    copyBufferToImage(stagingBuffer.getBuffer(), image, extent, 1, 0);
+bool Texture2D::canUploadFromHost(const TextureFile& file) {
+    return isContainerFormatSupported(file.format) && RenderingDevice::getSingleton()->supportsHostImageCopy(file.format,
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
 
-    if (mipmap) {
-        generateMipmaps(image, extent, format, layout, mipLevels, 0, arrayCount);
+void Texture2D::upload(const void* data, VkDeviceSize size, const std::vector<VkDeviceSize>& levelOffsets) {
+    // a chain built on the device starts from its first level in TRANSFER_DST_OPTIMAL
+    const VkImageLayout uploadLayout = mipmap ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : layout;
+
+    if (hostCopy) {
+        copyMemoryToImage(data, image, extent, levelOffsets, uploadLayout, mipLevels);
     } else {
-        transitionImageLayout(image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layout, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0);
+        std::unique_ptr<Buffer> stagingBuffer = std::make_unique<Buffer>(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, data);
+
+        transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0,
+                uploadCommandBuffer);
+        copyBufferToImage(stagingBuffer->getBuffer(), image, extent, levelOffsets, uploadCommandBuffer);
+        if (uploadLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+            transitionImageLayout(image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layout, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0,
+                    uploadCommandBuffer);
+        }
+
+        // a recorded copy reads the staging buffer once its frame executes, so it goes through the deletion queue
+        if (uploadCommandBuffer != VK_NULL_HANDLE) {
+            Buffer* released = stagingBuffer.release();
+            RenderingDevice::getSingleton()->deferDestroy([released]() { delete released; });
+        }
+    }
+
+    if (mipmap) {
+        generateMipChain();
     }
 }
 
-void Texture2D::initialize() {
-    mipLevels = mipmap ? getMipLevels(extent) : 1;
+void Texture2D::initialize(bool upload) {
+    // containers set their own level count
+    VkImageCreateFlags flags = 0;
+    if (mipmap) {
+        mipLevels = getMipLevels(extent);
+
+        computeMips = layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && arrayCount == 1 && MipGenerator::isSupported(format);
+        if (computeMips) {
+            usage |= MipGenerator::getImageUsage();
+            flags = MipGenerator::getImageFlags(format);
+        }
+    }
+
+    // on UMA and software devices pixels are written straight into the image
+    hostCopy = upload && RenderingDevice::getSingleton()->supportsHostImageCopy(format, usage, flags,
+            mipmap ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : layout);
+    if (hostCopy) {
+        usage |= VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+    }
 
     createImage(image, allocation, allocInfo, extent, format, samples, VK_IMAGE_TILING_OPTIMAL, usage,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mipLevels, arrayCount, VK_IMAGE_TYPE_2D);
-    createImageSampler(sampler, filter, addressMode, anisotropic, mipLevels);
-    createImageView(imageView, image, VK_IMAGE_VIEW_TYPE_2D, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0);
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mipLevels, arrayCount, VK_IMAGE_TYPE_2D, flags);
+    sampler = getImageSampler(filter, addressMode, anisotropic);
+    createImageView(imageView, image, VK_IMAGE_VIEW_TYPE_2D, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, 0, arrayCount, 0, components);
+}
+
+void Texture2D::generateMipChain() {
+    if (computeMips) {
+        // batched with the other textures of a load when one is open, see MipGenerator::beginBatch
+        RenderingDevice::getSingleton()->getMipGenerator().add(image, extent, format, mipLevels);
+    } else {
+        generateMipmaps(image, extent, format, layout, mipLevels, 0, arrayCount);
+    }
 }
 
 // depth formats in order of importance
@@ -378,8 +552,12 @@ static const std::vector<VkFormat> DEPTH_FORMATS = {
     VK_FORMAT_D16_UNORM
 };
 
+VkFormat Texture::findDepthFormat() {
+    return findSupportedFormat(DEPTH_FORMATS, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
 TextureDepth::TextureDepth(const glm::ivec2& extent, VkSampleCountFlagBits samples) :
-        Texture(findSupportedFormat(DEPTH_FORMATS, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        Texture(findDepthFormat(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
                 VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, samples,
                 1, 1) {
     this->extent = { (uint32_t)extent.x, (uint32_t)extent.y, 1 };
@@ -395,11 +573,63 @@ TextureDepth::TextureDepth(const glm::ivec2& extent, VkSampleCountFlagBits sampl
 
     createImage(image, allocation, allocInfo, this->extent, format, samples, VK_IMAGE_TILING_OPTIMAL, usage,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, 1, VK_IMAGE_TYPE_2D);
-    createImageSampler(sampler, filter, addressMode, false, mipLevels);
+    sampler = getImageSampler(filter, addressMode, false);
     createImageView(imageView, image, VK_IMAGE_VIEW_TYPE_2D, format, VK_IMAGE_ASPECT_DEPTH_BIT, 1, 0, 1, 0);
     transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED, layout, aspectMask, 1, 0, 1, 0);
 }
 
+TextureAttachment::TextureAttachment(const glm::uvec2& extent, VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples) :
+        Texture(format, VK_IMAGE_LAYOUT_UNDEFINED, usage, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, samples, 1, 1) {
+    this->extent = { extent.x, extent.y, 1 };
+
+    // layout the texture is left in for shader access, attachment layouts are tracked by the render graph
+    if (usage & VK_IMAGE_USAGE_STORAGE_BIT) {
+        layout = VK_IMAGE_LAYOUT_GENERAL;
+    } else if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+        layout = hasDepth(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    } else {
+        layout = hasDepth(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
+    VkImageCreateInfo imageCreateInfo{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = this->extent,
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = samples,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+
+    CHECK_VKRESULT(vkCreateImage(RenderingDevice::getSingleton()->getDevice(), &imageCreateInfo, nullptr, &image));
+
+    // no allocation of our own, the destructor then only destroys the image
+    allocation = VK_NULL_HANDLE;
+}
+
+VkMemoryRequirements TextureAttachment::getMemoryRequirements() const {
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(RenderingDevice::getSingleton()->getDevice(), image, &requirements);
+
+    return requirements;
+}
+
+void TextureAttachment::bindMemory(VmaAllocation memory, VkDeviceSize offset) {
+    RenderingDevice* rd = RenderingDevice::getSingleton();
+    CHECK_VKRESULT(vmaBindImageMemory2(rd->getAllocator(), memory, offset, image, nullptr));
+
+    VkImageAspectFlags aspectMask = hasDepth(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    createImageView(imageView, image, VK_IMAGE_VIEW_TYPE_2D, format, aspectMask, 1, 0, 1, 0);
+
+    if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+        sampler = getImageSampler(filter, addressMode, false);
+    }
+}
+
 } // namespace vkw
 
 } //namespace sublimation
\ No newline at end of file
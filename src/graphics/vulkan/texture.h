@@ -11,9 +11,12 @@ namespace sublimation {
 
 namespace vkw {
 
+struct TextureFile;
+
 typedef enum TextureType {
     TEXTURE_2D = 0,
-    TEXTURE_DEPTH = 1
+    TEXTURE_DEPTH = 1,
+    TEXTURE_ATTACHMENT = 2 ///< no memory bound, see TextureAttachment
 } TextureType;
 
 struct TextureInfo {
@@ -38,6 +41,9 @@ public:
 
     VkFormat getFormat() const { return format; }
     VkSampleCountFlagBits getSamples() const { return samples; }
+    const VkExtent3D& getExtent() const { return extent; }
+    // device memory bound to the image, 0 for attachments that don't own theirs
+    VkDeviceSize getMemorySize() const { return allocation != VK_NULL_HANDLE ? allocInfo.size : 0; }
 
     static bool hasDepth(VkFormat format);
     static bool hasStencil(VkFormat format);
@@ -46,19 +52,32 @@ public:
     VkWriteDescriptorSet getWriteDescriptor(uint32_t binding, VkDescriptorType descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
     static void createImage(VkImage& image, VmaAllocation& allocation, VmaAllocationInfo& allocInfo, const VkExtent3D& extent, VkFormat format, VkSampleCountFlagBits samples,
-            VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, uint32_t mipLevels, uint32_t arrayLayers, VkImageType imageType);
+            VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, uint32_t mipLevels, uint32_t arrayLayers, VkImageType imageType,
+            VkImageCreateFlags flags = 0);
     static void createImageView(VkImageView& imageView, const VkImage& image, VkImageViewType type, VkFormat format,
-            VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer);
-    static void createImageSampler(VkSampler& sampler, VkFilter filter, VkSamplerAddressMode addressMode, bool anisotropic, uint32_t mipLevels);
+            VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer,
+            const VkComponentMapping& components = {});
+    // from the device's sampler cache, not owned by the texture
+    static VkSampler getImageSampler(VkFilter filter, VkSamplerAddressMode addressMode, bool anisotropic);
 
     static void generateMipmaps(const VkImage& image, const VkExtent3D& extent, VkFormat format, VkImageLayout dstLayout,
             uint32_t mipLevels, uint32_t baseArrayLayer, uint32_t layerCount);
+    // transitions and copies are submitted and waited on, unless a command buffer is given to record them into
     static void transitionImageLayout(const VkImage& image, VkFormat format, VkImageLayout srcLayout, VkImageLayout dstLayout,
-            VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer);
+            VkImageAspectFlags imageAspect, uint32_t mipLevels, uint32_t baseMipLevel, uint32_t layerCount, uint32_t baseArrayLayer,
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE);
     static void copyBufferToImage(const VkBuffer& buffer, const VkImage& image, const VkExtent3D& extent, uint32_t layerCount, uint32_t baseArrayLayer);
+    // one region per mip level, levelOffsets index into the buffer largest level first
+    static void copyBufferToImage(const VkBuffer& buffer, const VkImage& image, const VkExtent3D& extent, const std::vector<VkDeviceSize>& levelOffsets,
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE);
+    // VK_EXT_host_image_copy, moves mipLevels levels to layout and writes the ones at levelOffsets into data without touching a queue
+    // the image needs VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT, see RenderingDevice::supportsHostImageCopy
+    static void copyMemoryToImage(const void* data, const VkImage& image, const VkExtent3D& extent, const std::vector<VkDeviceSize>& levelOffsets,
+            VkImageLayout layout, uint32_t mipLevels);
 
     static uint32_t getMipLevels(const VkExtent3D& extent);
     static VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+    static VkFormat findDepthFormat();
 
 protected:
     Texture(VkFormat format, VkImageLayout layout, VkImageUsageFlags usage, VkFilter filter, VkSamplerAddressMode addressMode, VkSampleCountFlagBits samples, uint32_t mipLevels, uint32_t arrayCount);
@@ -67,7 +86,7 @@ protected:
     VkImageView imageView = VK_NULL_HANDLE;
     VkSampler sampler = VK_NULL_HANDLE;
 
-    VmaAllocation allocation;
+    VmaAllocation allocation = VK_NULL_HANDLE;
     VmaAllocationInfo allocInfo;
 
     VkFilter filter;
@@ -82,10 +101,12 @@ protected:
     uint32_t arrayCount;
 };
 
+// loads .ktx2 and .dds containers as they are, any other image is decoded and uploaded in format
+// R8 and R8G8 formats keep the decoded channels from channel on, so scalar material maps only store what the shader reads
 class Texture2D : public Texture {
 public:
     Texture2D(const std::string& filename, VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-            bool aniso = true, bool mipmap = true);
+            bool aniso = true, bool mipmap = true, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, uint32_t channel = 0);
 
     Texture2D(const glm::ivec2& extent, const void* pixels = nullptr, VkDeviceSize bufferSize = 0,
             VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
@@ -93,12 +114,33 @@ public:
             VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
             VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT, bool aniso = false, bool mipmap = false);
 
+    // uploads the levels of an already loaded container, file is decoded in place if the device can't sample its format
+    // a staged upload is recorded into commandBuffer when one is given, the texture can be sampled once it has executed
+    Texture2D(TextureFile& file, const std::string& filename, VkFilter filter = VK_FILTER_LINEAR,
+            VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, bool aniso = true, uint32_t channel = 0,
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE);
+
+    // the container constructor would write file with host image copy, so it can run off the render thread
+    static bool canUploadFromHost(const TextureFile& file);
+
 private:
-    void initialize();
+    // upload says whether pixels follow, only then host image copy is considered
+    void initialize(bool upload = true);
+    // writes levels from data and leaves the image in layout, building the chain when mipmap is set
+    void upload(const void* data, VkDeviceSize size, const std::vector<VkDeviceSize>& levelOffsets);
+    // levels past the first one of a mipmapped image, on the MipGenerator when the format allows it, blitted otherwise
+    void generateMipChain();
     void loadFromFile(const std::string& filename);
+    void loadFromContainer(const std::string& filename);
+    void loadFromContainer(TextureFile& file, const std::string& filename);
 
     bool anisotropic;
     bool mipmap;
+    bool computeMips = false; ///< created for the MipGenerator, decided in initialize
+    bool hostCopy = false; ///< uploads skip the staging buffer and the queue, decided in initialize
+    uint32_t channel = 0; ///< source channel of single channel slots
+    VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE; ///< staged uploads are recorded here instead of submitted
+    VkComponentMapping components{}; ///< identity unless a wider container has to serve channel as red
 };
 
 class TextureDepth : public Texture {
@@ -106,6 +148,16 @@ public:
     TextureDepth(const glm::ivec2& extent, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
 };
 
+// Render graph attachment, the image is created without memory so the graph can alias several attachments in one allocation
+class TextureAttachment : public Texture {
+public:
+    TextureAttachment(const glm::uvec2& extent, VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+
+    VkMemoryRequirements getMemoryRequirements() const;
+    // memory stays owned by the caller, only the image, view and sampler are released with the texture
+    void bindMemory(VmaAllocation memory, VkDeviceSize offset);
+};
+
 } // namespace vkw
 
 } // namespace sublimation
\ No newline at end of file
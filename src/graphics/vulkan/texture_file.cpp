@@ -0,0 +1,489 @@
+#include <graphics/vulkan/texture_file.h>
+
+#include <graphics/block_compression.h>
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace sublimation {
+
+namespace vkw {
+
+namespace {
+
+constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+struct Ktx2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80);
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+constexpr uint32_t DDS_MAGIC = 0x20534444; ///< "DDS "
+constexpr uint32_t DDS_FOURCC = 0x4;
+
+struct DdsPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct DdsHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+static_assert(sizeof(DdsHeader) == 124);
+
+struct DdsHeaderDx10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+    return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+}
+
+VkFormat getFormatFromFourCC(uint32_t fourCC) {
+    switch (fourCC) {
+        case makeFourCC('D', 'X', 'T', '1'):
+            return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case makeFourCC('D', 'X', 'T', '5'):
+            return VK_FORMAT_BC3_UNORM_BLOCK;
+        case makeFourCC('A', 'T', 'I', '1'):
+        case makeFourCC('B', 'C', '4', 'U'):
+            return VK_FORMAT_BC4_UNORM_BLOCK;
+        case makeFourCC('A', 'T', 'I', '2'):
+        case makeFourCC('B', 'C', '5', 'U'):
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        default:
+            return VK_FORMAT_UNDEFINED;
+    }
+}
+
+VkFormat getFormatFromDxgi(uint32_t dxgiFormat) {
+    switch (dxgiFormat) {
+        case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+        case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+        case 49: return VK_FORMAT_R8G8_UNORM;
+        case 61: return VK_FORMAT_R8_UNORM;
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+// bytes per texel, or per 4x4 block for block compressed formats, 0 if the format isn't supported in containers
+uint32_t getFormatBlockSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return 4;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            return 8;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+bool isSrgb(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+            format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+// basic data format descriptor (Khronos Data Format Specification 1.3), KTX2 requires one even though the
+// loader goes by vkFormat alone
+std::vector<uint32_t> getDataFormatDescriptor(VkFormat format) {
+    struct Sample {
+        uint32_t bitOffset;
+        uint32_t bitLength;
+        uint32_t channel;
+        uint32_t upper;
+    };
+
+    uint32_t colorModel = 1; ///< KHR_DF_MODEL_RGBSDA
+    uint32_t blockDimension = 0; ///< texel block size minus one in each byte
+    std::vector<Sample> samples;
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+            samples = { { 0, 7, 0, 255 } };
+            break;
+        case VK_FORMAT_R8G8_UNORM:
+            samples = { { 0, 7, 0, 255 }, { 8, 7, 1, 255 } };
+            break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            samples = { { 0, 7, 0, 255 }, { 8, 7, 1, 255 }, { 16, 7, 2, 255 }, { 24, 7, 15u | (isSrgb(format) ? 0x10u : 0u), 255 } };
+            break;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            colorModel = 128;
+            samples = { { 0, 63, 0, ~0u } };
+            break;
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            colorModel = 128;
+            samples = { { 0, 63, 1, ~0u } };
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            colorModel = 130;
+            samples = { { 0, 63, 15, ~0u }, { 64, 63, 0, ~0u } };
+            break;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            colorModel = 131;
+            samples = { { 0, 63, 0, ~0u } };
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            colorModel = 132;
+            samples = { { 0, 63, 0, ~0u }, { 64, 63, 1, ~0u } };
+            break;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            colorModel = 134;
+            samples = { { 0, 127, 0, ~0u } };
+            break;
+        default:
+            return {};
+    }
+    if (isBlockCompressed(format)) {
+        blockDimension = 3 | (3 << 8);
+    }
+
+    const uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+    std::vector<uint32_t> descriptor{
+        4 + blockSize, ///< dfdTotalSize
+        0, ///< vendor KHR, descriptor type basic
+        2 | (blockSize << 16), ///< version 1.3
+        colorModel | (1 << 8) | ((isSrgb(format) ? 2u : 1u) << 16), ///< BT.709 primaries, sRGB or linear transfer
+        blockDimension,
+        getFormatBlockSize(format), ///< bytesPlane0
+        0
+    };
+    for (const Sample& sample : samples) {
+        descriptor.push_back(sample.bitOffset | (sample.bitLength << 16) | (sample.channel << 24));
+        descriptor.push_back(0);
+        descriptor.push_back(0);
+        descriptor.push_back(sample.upper);
+    }
+
+    return descriptor;
+}
+
+// levels of a full chain down to 1x1
+uint32_t getMaxLevelCount(const VkExtent3D& extent) {
+    return static_cast<uint32_t>(std::bit_width(std::max(extent.width, extent.height)));
+}
+
+bool readAt(std::ifstream& file, uint64_t offset, void* dst, size_t size) {
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(size));
+
+    return static_cast<bool>(file);
+}
+
+} //namespace
+
+bool isBlockCompressed(VkFormat format) {
+    return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+uint32_t getComponentCount(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            return 2;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+VkDeviceSize getLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+    if (isBlockCompressed(format)) {
+        return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * getFormatBlockSize(format);
+    }
+
+    return static_cast<VkDeviceSize>(width) * height * getFormatBlockSize(format);
+}
+
+bool TextureFile::isContainer(const std::string& filename) {
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    return extension == "ktx2" || extension == "dds";
+}
+
+bool TextureFile::load(const std::string& filename, uint32_t maxExtent) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::TextureFile:load: could not read " << filename << '\n';
+        return false;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+
+    levels.clear();
+    data.clear();
+    baseLevel = 0;
+
+    // offset and size of every stored level, only the ones that fit maxExtent are read
+    std::vector<Ktx2Level> index;
+    uint8_t identifier[sizeof(KTX2_IDENTIFIER)] = {};
+    if (fileSize >= sizeof(Ktx2Header) && readAt(file, 0, identifier, sizeof(identifier)) &&
+            std::memcmp(identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+        Ktx2Header header;
+        readAt(file, 0, &header, sizeof(Ktx2Header));
+
+        format = static_cast<VkFormat>(header.vkFormat);
+        extent = { header.pixelWidth, header.pixelHeight, 1 };
+        const uint32_t levelCount = std::max(header.levelCount, 1u);
+        if (header.supercompressionScheme != 0 || header.faceCount != 1 || header.layerCount > 1 || header.pixelDepth > 1 ||
+                extent.width == 0 || extent.height == 0 || levelCount > getMaxLevelCount(extent) ||
+                getFormatBlockSize(format) == 0 || fileSize < sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level)) {
+            std::cerr << "ERROR::TextureFile:load: unsupported KTX2 texture " << filename << '\n';
+            return false;
+        }
+
+        index.resize(levelCount);
+        readAt(file, sizeof(Ktx2Header), index.data(), levelCount * sizeof(Ktx2Level));
+    } else {
+        uint32_t magic = 0;
+        if (fileSize >= sizeof(uint32_t) + sizeof(DdsHeader)) {
+            readAt(file, 0, &magic, sizeof(uint32_t));
+        }
+        if (magic != DDS_MAGIC) {
+            std::cerr << "ERROR::TextureFile:load: " << filename << " is neither KTX2 nor DDS\n";
+            return false;
+        }
+
+        DdsHeader header;
+        readAt(file, sizeof(uint32_t), &header, sizeof(DdsHeader));
+        uint64_t offset = sizeof(uint32_t) + sizeof(DdsHeader);
+
+        format = VK_FORMAT_UNDEFINED;
+        if (header.pixelFormat.flags & DDS_FOURCC) {
+            if (header.pixelFormat.fourCC == makeFourCC('D', 'X', '1', '0') && fileSize >= offset + sizeof(DdsHeaderDx10)) {
+                DdsHeaderDx10 dx10;
+                readAt(file, offset, &dx10, sizeof(DdsHeaderDx10));
+                offset += sizeof(DdsHeaderDx10);
+                if (dx10.arraySize <= 1) {
+                    format = getFormatFromDxgi(dx10.dxgiFormat);
+                }
+            } else {
+                format = getFormatFromFourCC(header.pixelFormat.fourCC);
+            }
+        }
+
+        // cube maps and volumes are left to a later loader
+        if (format == VK_FORMAT_UNDEFINED || header.caps2 != 0) {
+            std::cerr << "ERROR::TextureFile:load: unsupported DDS texture " << filename << '\n';
+            return false;
+        }
+
+        // levels follow each other largest first
+        extent = { header.width, header.height, 1 };
+        const uint32_t levelCount = std::max(header.mipMapCount, 1u);
+        if (extent.width == 0 || extent.height == 0 || levelCount > getMaxLevelCount(extent)) {
+            std::cerr << "ERROR::TextureFile:load: unsupported DDS texture " << filename << '\n';
+            return false;
+        }
+
+        for (uint32_t level = 0; level < levelCount; level++) {
+            const VkDeviceSize size = getLevelSize(format, std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u));
+            index.push_back({ .byteOffset = offset, .byteLength = size, .uncompressedByteLength = size });
+            offset += size;
+        }
+    }
+
+    // the smallest level is always kept
+    while (baseLevel + 1 < index.size() && std::max(extent.width >> baseLevel, extent.height >> baseLevel) > maxExtent) {
+        baseLevel++;
+    }
+    storedExtent = extent;
+    extent = { std::max(extent.width >> baseLevel, 1u), std::max(extent.height >> baseLevel, 1u), 1 };
+
+    // every level has to hold exactly its texels and lie within the file, uploads and the decoder read a full level from it
+    for (uint32_t level = baseLevel; level < index.size(); level++) {
+        const VkDeviceSize levelSize = getLevelSize(format, std::max(storedExtent.width >> level, 1u), std::max(storedExtent.height >> level, 1u));
+        if (index[level].byteLength != levelSize) {
+            std::cerr << "ERROR::TextureFile:load: level " << level << " of " << filename << " has the wrong size\n";
+            return false;
+        }
+        if (index[level].byteLength > fileSize || index[level].byteOffset > fileSize - index[level].byteLength) {
+            std::cerr << "ERROR::TextureFile:load: truncated texture " << filename << '\n';
+            return false;
+        }
+
+        levels.push_back({ .offset = data.size(), .size = index[level].byteLength });
+        data.resize(data.size() + index[level].byteLength);
+        if (!readAt(file, index[level].byteOffset, data.data() + levels.back().offset, levels.back().size)) {
+            std::cerr << "ERROR::TextureFile:load: could not read " << filename << '\n';
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TextureFile::saveKtx2(const std::string& filename) const {
+    const std::vector<uint32_t> descriptor = getDataFormatDescriptor(format);
+    if (descriptor.empty() || levels.empty()) {
+        std::cerr << "ERROR::TextureFile:saveKtx2: nothing to write for " << filename << '\n';
+        return false;
+    }
+
+    Ktx2Header header{
+        .vkFormat = static_cast<uint32_t>(format),
+        .typeSize = 1, ///< every supported format is made of bytes
+        .pixelWidth = extent.width,
+        .pixelHeight = extent.height,
+        .pixelDepth = 0,
+        .layerCount = 0,
+        .faceCount = 1,
+        .levelCount = static_cast<uint32_t>(levels.size()),
+        .supercompressionScheme = 0,
+        .dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2Level)),
+        .dfdByteLength = static_cast<uint32_t>(descriptor.size() * sizeof(uint32_t))
+    };
+    std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+
+    // level data goes smallest first, each level aligned to the least common multiple of the block size and 4
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(getFormatBlockSize(format), 4);
+    std::vector<Ktx2Level> index(levels.size());
+    VkDeviceSize offset = header.dfdByteOffset + header.dfdByteLength;
+    for (size_t level = levels.size(); level-- > 0;) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        index[level] = { .byteOffset = offset, .byteLength = levels[level].size, .uncompressedByteLength = levels[level].size };
+        offset += levels[level].size;
+    }
+
+    std::vector<uint8_t> bytes(offset, 0);
+    std::memcpy(bytes.data(), &header, sizeof(Ktx2Header));
+    std::memcpy(bytes.data() + sizeof(Ktx2Header), index.data(), index.size() * sizeof(Ktx2Level));
+    std::memcpy(bytes.data() + header.dfdByteOffset, descriptor.data(), header.dfdByteLength);
+    for (size_t level = 0; level < levels.size(); level++) {
+        std::memcpy(bytes.data() + index[level].byteOffset, data.data() + levels[level].offset, levels[level].size);
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    if (!file) {
+        std::cerr << "ERROR::TextureFile:saveKtx2: could not write " << filename << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+bool TextureFile::decompress() {
+    block_compression::BlockFormat blockFormat;
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            blockFormat = block_compression::BlockFormat::BC1;
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            blockFormat = block_compression::BlockFormat::BC3;
+            break;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            blockFormat = block_compression::BlockFormat::BC4;
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            blockFormat = block_compression::BlockFormat::BC5;
+            break;
+        default:
+            return false;
+    }
+
+    const VkFormat decodedFormat = isSrgb(format) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    std::vector<uint8_t> decoded;
+    std::vector<Level> decodedLevels;
+    for (size_t level = 0; level < levels.size(); level++) {
+        const uint32_t width = std::max(extent.width >> level, 1u);
+        const uint32_t height = std::max(extent.height >> level, 1u);
+        decodedLevels.push_back({ .offset = decoded.size(), .size = getLevelSize(decodedFormat, width, height) });
+        decoded.resize(decoded.size() + decodedLevels.back().size);
+        block_compression::decode(blockFormat, data.data() + levels[level].offset, width, height, decoded.data() + decodedLevels.back().offset);
+    }
+
+    format = decodedFormat;
+    data = std::move(decoded);
+    levels = std::move(decodedLevels);
+
+    return true;
+}
+
+} //namespace vkw
+
+} //namespace sublimation
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <volk.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sublimation {
+
+namespace vkw {
+
+// A prebuilt mip chain as stored in a KTX2 or DDS container, in a format the GPU samples directly
+// only 2D textures without supercompression are supported, levels are kept largest first
+struct TextureFile {
+    struct Level {
+        VkDeviceSize offset; ///< into data
+        VkDeviceSize size;
+    };
+
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent3D extent{ 0, 0, 1 };
+    std::vector<uint8_t> data;
+    std::vector<Level> levels;
+    uint32_t baseLevel = 0; ///< stored levels skipped by load, extent is that of the first level kept
+    VkExtent3D storedExtent{ 0, 0, 1 }; ///< largest level in the file
+
+    // by extension, .ktx2 or .dds
+    static bool isContainer(const std::string& filename);
+
+    // levels larger than maxExtent on either side are skipped without being read, the smallest one is always kept
+    bool load(const std::string& filename, uint32_t maxExtent = UINT32_MAX);
+    bool saveKtx2(const std::string& filename) const;
+
+    // decodes to RGBA8 for devices that can't sample the format, false if there is no decoder for it
+    bool decompress();
+};
+
+bool isBlockCompressed(VkFormat format);
+// channels the format stores, from red on
+uint32_t getComponentCount(VkFormat format);
+// bytes of one mip level, block formats round up to whole 4x4 blocks
+VkDeviceSize getLevelSize(VkFormat format, uint32_t width, uint32_t height);
+
+} //namespace vkw
+
+} //namespace sublimation
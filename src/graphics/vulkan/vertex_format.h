@@ -0,0 +1,148 @@
+#pragma once
+
+#include <volk.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <tuple>
+
+namespace sublimation {
+
+namespace vkw {
+
+// how a model's vertex streams are stored on the GPU, chosen at import
+enum class VertexFormat : uint32_t {
+    Float, ///< 12 + 32 bytes per vertex
+    Packed ///< 8 + 12 bytes per vertex, quantised positions and octahedral normals, see PackedVertexAttributes
+};
+
+constexpr uint32_t getFormatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UINT:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+// one vertex buffer binding, attributes are tightly packed in the order given
+template <VkFormat... Formats>
+struct VertexStream {
+    static constexpr uint32_t attributeCount = sizeof...(Formats);
+    static constexpr std::array<VkFormat, attributeCount> formats{ Formats... };
+    static constexpr uint32_t stride = (getFormatSize(Formats) + ... + 0);
+
+    static constexpr std::array<uint32_t, attributeCount> offsets = []() {
+        std::array<uint32_t, attributeCount> result{};
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < attributeCount; i++) {
+            result[i] = offset;
+            offset += getFormatSize(formats[i]);
+        }
+        return result;
+    }();
+
+    static_assert(((getFormatSize(Formats) != 0) && ...), "vertex attribute format without a known size");
+};
+
+// streams take consecutive bindings from 0, their attributes consecutive shader locations from 0
+// positions always come first so the position only variant is the first binding on its own
+template <typename... Streams>
+struct VertexLayout {
+    static constexpr uint32_t bindingCount = sizeof...(Streams);
+    static constexpr uint32_t attributeCount = (Streams::attributeCount + ... + 0);
+
+    static constexpr std::array<VkVertexInputBindingDescription, bindingCount> bindings = []() {
+        std::array<VkVertexInputBindingDescription, bindingCount> result{};
+        const std::array<uint32_t, bindingCount> strides{ Streams::stride... };
+        for (uint32_t i = 0; i < bindingCount; i++) {
+            result[i] = {
+                .binding = i,
+                .stride = strides[i],
+                .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+            };
+        }
+        return result;
+    }();
+
+    static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> attributes = []() {
+        std::array<VkVertexInputAttributeDescription, attributeCount> result{};
+        uint32_t binding = 0;
+        uint32_t location = 0;
+        auto addStream = [&](auto stream) {
+            using Stream = decltype(stream);
+            for (uint32_t i = 0; i < Stream::attributeCount; i++, location++) {
+                result[location] = {
+                    .location = location,
+                    .binding = binding,
+                    .format = Stream::formats[i],
+                    .offset = Stream::offsets[i]
+                };
+            }
+            binding++;
+        };
+        (addStream(Streams{}), ...);
+        return result;
+    }();
+
+    // attributes of the first binding, they lead the attribute list
+    static constexpr uint32_t positionAttributeCount = std::tuple_element_t<0, std::tuple<Streams...>>::attributeCount;
+};
+
+namespace vertex_layouts {
+
+using FloatPositions = VertexStream<VK_FORMAT_R32G32B32_SFLOAT>;
+using FloatAttributes = VertexStream<VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT>; ///< normal, uv, tangent
+using PackedPositions = VertexStream<VK_FORMAT_R16G16B16A16_UNORM>; ///< w holds the bitangent sign
+using PackedAttributes = VertexStream<VK_FORMAT_R16G16_SNORM, VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R16G16_SNORM>; ///< octahedral normal, uv, octahedral tangent
+using SkinningAttributes = VertexStream<VK_FORMAT_R8G8B8A8_UINT, VK_FORMAT_R8G8B8A8_UNORM>; ///< joint indices, joint weights
+
+using Float = VertexLayout<FloatPositions, FloatAttributes>;
+using Packed = VertexLayout<PackedPositions, PackedAttributes>;
+// not selectable as a VertexFormat until models import joints and a shader reads them
+using Skinned = VertexLayout<FloatPositions, FloatAttributes, SkinningAttributes>;
+
+} //namespace vertex_layouts
+
+// the vertex input state of a pipeline, views into the constexpr tables above
+struct VertexInputDescription {
+    std::span<const VkVertexInputBindingDescription> bindings;
+    std::span<const VkVertexInputAttributeDescription> attributes;
+    bool packed = false; ///< the packedVertices specialisation constant
+};
+
+template <typename Layout>
+constexpr VertexInputDescription getVertexInput(bool positionOnly, bool packed) {
+    return {
+        .bindings = std::span<const VkVertexInputBindingDescription>(Layout::bindings.data(), positionOnly ? 1 : Layout::bindingCount),
+        .attributes = std::span<const VkVertexInputAttributeDescription>(Layout::attributes.data(), positionOnly ? Layout::positionAttributeCount : Layout::attributeCount),
+        .packed = packed
+    };
+}
+
+// positionOnly keeps just the position stream, for depth and shadow pipelines
+constexpr VertexInputDescription getVertexInput(VertexFormat format, bool positionOnly = false) {
+    switch (format) {
+        case VertexFormat::Packed:
+            return getVertexInput<vertex_layouts::Packed>(positionOnly, true);
+        case VertexFormat::Float:
+        default:
+            return getVertexInput<vertex_layouts::Float>(positionOnly, false);
+    }
+}
+
+} //namespace vkw
+
+} //namespace sublimation
@@ -7,6 +7,7 @@
 #include <glfw/glfw3.h>
 #include <graphics/vulkan/utils.h>
 
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <sstream>
@@ -30,7 +31,7 @@ void VulkanContext::createInstance() {
         .applicationVersion = VK_MAKE_VERSION(1, 1, 0),
         .pEngineName = "Sublimation Engine",
         .engineVersion = VK_MAKE_VERSION(1, 1, 0),
-        .apiVersion = VK_API_VERSION_1_1
+        .apiVersion = VK_API_VERSION_1_2
     };
 
     VkInstanceCreateInfo instanceCreateInfo{
@@ -178,10 +179,78 @@ void VulkanContext::createPhysicalDevice() {
     vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
 
+    supportedFeatures12 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+    };
+    VkPhysicalDeviceFeatures2 deviceFeatures2{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &supportedFeatures12
+    };
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &deviceFeatures2);
+
+    // frame pacing is built on timeline semaphores
+    if (!supportedFeatures12.timelineSemaphore) {
+        throw std::runtime_error("ERROR::VulkanContext:createPhysicalDevice: selected physical device does not support timeline semaphores!");
+    }
+    enabledFeatures12 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .timelineSemaphore = VK_TRUE
+    };
+
     if (!checkDeviceExtensionSupport(physicalDevice)) {
         throw std::runtime_error("ERROR::VulkanContext:createPhysicalDevice: selected physical device does not support requested extensions!");
     }
 
+    if (isDeviceExtensionEnabled(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR supportedDynamicRendering{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR
+        };
+        deviceFeatures2.pNext = &supportedDynamicRendering;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &deviceFeatures2);
+
+        dynamicRendering = supportedDynamicRendering.dynamicRendering;
+    }
+    enabledDynamicRenderingFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+        .dynamicRendering = dynamicRendering ? VK_TRUE : VK_FALSE
+    };
+    if (dynamicRendering) {
+        enabledFeatures12.pNext = &enabledDynamicRenderingFeatures;
+    }
+
+    if (isDeviceExtensionEnabled(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME)) {
+        VkPhysicalDeviceHostImageCopyFeaturesEXT supportedHostImageCopy{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT
+        };
+        deviceFeatures2.pNext = &supportedHostImageCopy;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &deviceFeatures2);
+
+        hostImageCopy = supportedHostImageCopy.hostImageCopy;
+    }
+    enabledHostImageCopyFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT,
+        .pNext = enabledFeatures12.pNext,
+        .hostImageCopy = hostImageCopy ? VK_TRUE : VK_FALSE
+    };
+    if (hostImageCopy) {
+        enabledFeatures12.pNext = &enabledHostImageCopyFeatures;
+
+        // first call for the count, second for the layouts
+        VkPhysicalDeviceHostImageCopyPropertiesEXT hostImageCopyProperties{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT
+        };
+        VkPhysicalDeviceProperties2 deviceProperties2{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &hostImageCopyProperties
+        };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
+
+        hostCopyDstLayouts.resize(hostImageCopyProperties.copyDstLayoutCount);
+        hostImageCopyProperties.copySrcLayoutCount = 0;
+        hostImageCopyProperties.pCopyDstLayouts = hostCopyDstLayouts.data();
+        vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
+    }
+
     uint32_t queueFamilyCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
     queueFamilyProperties.resize(queueFamilyCount);
@@ -207,21 +276,25 @@ void VulkanContext::createDevice() {
                 graphicsQueueFamilyIdx = i;
             }
 
-            if (computeQueueFamilyIdx == UINT32_MAX && queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-                computeQueueFamilyIdx = i;
-            }
-
             if (supportsPresent[i] == VK_TRUE) {
                 graphicsQueueFamilyIdx = i;
                 presentQueueFamilyIdx = i;
-                if (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-                    computeQueueFamilyIdx = i;
-                }
                 break;
             }
         }
     }
 
+    // The early occlusion cull and other async compute passes are submitted to the compute queue ahead of the frame,
+    // a dedicated compute family lets them overlap the previous frame's graphics work, then a second queue of
+    // the graphics family does. Sharing the graphics queue is the last resort, the submissions then just run in order
+    for (int i = 0; i < queueFamilyProperties.size(); i++) {
+        if ((queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            computeQueueFamilyIdx = i;
+            computeQueueIndex = 0;
+            break;
+        }
+    }
+
     if (presentQueueFamilyIdx == UINT32_MAX) {
         for (int i = 0; i < queueFamilyProperties.size(); i++) {
             if (supportsPresent[i] == VK_TRUE) {
@@ -231,28 +304,39 @@ void VulkanContext::createDevice() {
         }
     }
 
-    if (computeQueueFamilyIdx == UINT32_MAX) {
-        for (int i = 0; i < queueFamilyProperties.size(); i++) {
-            if (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-                computeQueueFamilyIdx = i;
-                break;
-            }
-        }
+    if (computeQueueFamilyIdx == UINT32_MAX && graphicsQueueFamilyIdx != UINT32_MAX) {
+        // graphics families always support compute
+        computeQueueFamilyIdx = graphicsQueueFamilyIdx;
+        computeQueueIndex = queueFamilyProperties[graphicsQueueFamilyIdx].queueCount > 1 ? 1 : 0;
     }
 
     graphicsQueueFamilyIndex = graphicsQueueFamilyIdx;
     presentQueueFamilyIndex = presentQueueFamilyIdx;
     separatePresentQueue = graphicsQueueFamilyIdx != presentQueueFamilyIdx;
     computeQueueFamilyIndex = computeQueueFamilyIdx;
+    asyncCompute = computeQueueFamilyIdx != graphicsQueueFamilyIdx || computeQueueIndex != 0;
+
+    const float defaultQueuePriorities[2] = { 0.f, 0.f };
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    auto addQueues = [&](uint32_t familyIndex, uint32_t count) {
+        for (auto& info : queueCreateInfos) {
+            if (info.queueFamilyIndex == familyIndex) {
+                info.queueCount = std::max(info.queueCount, count);
+                return;
+            }
+        }
+
+        queueCreateInfos.push_back({
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = familyIndex,
+            .queueCount = count,
+            .pQueuePriorities = defaultQueuePriorities
+        });
+    };
 
-    const float defaultQueuePriority = 0.f;
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos(2);
-    queueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfos[0].pNext = nullptr;
-    queueCreateInfos[0].queueFamilyIndex = graphicsQueueFamilyIndex;
-    queueCreateInfos[0].queueCount = 1;
-    queueCreateInfos[0].pQueuePriorities = &defaultQueuePriority;
-    queueCreateInfos[0].flags = 0;
+    addQueues(graphicsQueueFamilyIndex, 1);
+    addQueues(presentQueueFamilyIndex, 1);
+    addQueues(computeQueueFamilyIndex, computeQueueIndex + 1);
 
     uint32_t enabledExtensionCount = 0;
     std::vector<const char*> enabledExtensionNames(enabledDeviceExtensions.size());
@@ -262,9 +346,9 @@ void VulkanContext::createDevice() {
 
     VkDeviceCreateInfo deviceCreateInfo{
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = nullptr,
+        .pNext = &enabledFeatures12,
         .flags = 0,
-        .queueCreateInfoCount = 1,
+        .queueCreateInfoCount = (uint32_t)queueCreateInfos.size(),
         .pQueueCreateInfos = queueCreateInfos.data(),
         .enabledLayerCount = 0, ///< ignored in new Vulkan implementations anyways
         .ppEnabledLayerNames = nullptr,
@@ -272,15 +356,6 @@ void VulkanContext::createDevice() {
         .ppEnabledExtensionNames = enabledExtensionNames.data(),
         .pEnabledFeatures = &deviceFeatures
     };
-    if (separatePresentQueue) {
-        queueCreateInfos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfos[1].pNext = nullptr;
-        queueCreateInfos[1].queueFamilyIndex = presentQueueFamilyIndex;
-        queueCreateInfos[1].queueCount = 1;
-        queueCreateInfos[1].pQueuePriorities = &defaultQueuePriority;
-        queueCreateInfos[1].flags = 0;
-        deviceCreateInfo.queueCreateInfoCount = 2;
-    }
 
     CHECK_VKRESULT(vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device));
 }
@@ -292,7 +367,7 @@ void VulkanContext::initializeQueues() {
     } else {
         vkGetDeviceQueue(device, presentQueueFamilyIndex, 0, &presentQueue);
     }
-    vkGetDeviceQueue(device, computeQueueFamilyIndex, 0, &computeQueue);
+    vkGetDeviceQueue(device, computeQueueFamilyIndex, computeQueueIndex, &computeQueue);
 
     uint32_t formatCount;
     vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, swapChain.surface, &formatCount, nullptr);
@@ -333,10 +408,7 @@ void VulkanContext::updateSwapchain(GLFWwindow* window) {
         glfwWaitEvents();
     }
 
-    if (swapChain.swapchain) {
-        cleanupSwapchain();
-    }
-
+    // previous swapchain is retired by the new one, the caller releases it once no frame uses it
     swapChain.update(window);
 }
 
@@ -351,6 +423,15 @@ bool VulkanContext::checkDeviceExtensionSupport(VkPhysicalDevice physDevice) {
     std::vector<std::string> requestedExtensions;
     requestedExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+    // enabled when present, the renderer falls back to other paths without them
+    std::vector<std::string> optionalExtensions;
+    optionalExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    // host image copy and the extensions it depends on below Vulkan 1.3
+    optionalExtensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+    optionalExtensions.push_back(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME);
+    optionalExtensions.push_back(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME);
+    size_t enabledRequested = 0;
+
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(physDevice, nullptr, &extensionCount, nullptr);
     std::vector<VkExtensionProperties> availableExtensions(extensionCount);
@@ -360,10 +441,22 @@ bool VulkanContext::checkDeviceExtensionSupport(VkPhysicalDevice physDevice) {
         std::string extensionName(extension.extensionName);
         if (std::find(requestedExtensions.begin(), requestedExtensions.end(), extensionName) != requestedExtensions.end()) {
             enabledDeviceExtensions.push_back(extensionName);
+            enabledRequested++;
+        } else if (std::find(optionalExtensions.begin(), optionalExtensions.end(), extensionName) != optionalExtensions.end()) {
+            enabledDeviceExtensions.push_back(extensionName);
         }
     }
 
-    return enabledDeviceExtensions.size() == requestedExtensions.size();
+    // the instance targets 1.2, so host image copy is only valid alongside both of its dependencies
+    if (!isDeviceExtensionEnabled(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME) || !isDeviceExtensionEnabled(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME)) {
+        std::erase(enabledDeviceExtensions, std::string(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME));
+    }
+
+    return enabledRequested == requestedExtensions.size();
+}
+
+bool VulkanContext::isDeviceExtensionEnabled(const char* name) const {
+    return std::find(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(), std::string(name)) != enabledDeviceExtensions.end();
 }
 
 VkBool32 VulkanContext::debugMessengerCallback(
@@ -420,7 +513,7 @@ void VulkanContext::initialize(GLFWwindow* window) {
         .device = device,
         .pVulkanFunctions = &vmaVulkanFunc,
         .instance = instance,
-        .vulkanApiVersion = VK_API_VERSION_1_1
+        .vulkanApiVersion = VK_API_VERSION_1_2
     };
 
     CHECK_VKRESULT(vmaCreateAllocator(&vmaAllocatorCreateInfo, &allocator));
@@ -30,6 +30,7 @@ private:
     void initializeQueues();
 
     bool checkDeviceExtensionSupport(VkPhysicalDevice physDevice);
+    bool isDeviceExtensionEnabled(const char* name) const;
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugMessengerCallback(
             VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -48,12 +49,21 @@ private:
 
     VkPhysicalDeviceProperties deviceProperties;
     VkPhysicalDeviceFeatures deviceFeatures;
+    VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+    VkPhysicalDeviceVulkan12Features enabledFeatures12{};
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR enabledDynamicRenderingFeatures{};
+    VkPhysicalDeviceHostImageCopyFeaturesEXT enabledHostImageCopyFeatures{};
     VkPhysicalDeviceMemoryProperties memoryProperties;
     std::vector<VkQueueFamilyProperties> queueFamilyProperties;
     uint32_t graphicsQueueFamilyIndex = UINT32_MAX;
     uint32_t presentQueueFamilyIndex = UINT32_MAX;
     uint32_t computeQueueFamilyIndex = UINT32_MAX;
+    uint32_t computeQueueIndex = 0;
     bool separatePresentQueue = false;
+    bool asyncCompute = false; ///< compute queue is distinct from the graphics queue
+    bool dynamicRendering = false; ///< VK_KHR_dynamic_rendering is enabled
+    bool hostImageCopy = false; ///< VK_EXT_host_image_copy is enabled
+    std::vector<VkImageLayout> hostCopyDstLayouts; ///< layouts images can be in when written from the host
 
     bool instanceInitialized = false;
     bool deviceInitialized = false;
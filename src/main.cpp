@@ -1,6 +1,17 @@
 #include <core/engine.h>
+#include <scene/texture_baker.h>
+
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char** argv) {
+    // offline mode, bakes a model's textures to block compressed KTX2 without bringing up the renderer
+    if (argc == 3 && std::strcmp(argv[1], "--bake-textures") == 0) {
+        const uint32_t bakedCount = sublimation::texture_baker::bakeModelTextures(argv[2]);
+        std::cout << "INFO::main: baked " << bakedCount << " textures of " << argv[2] << '\n';
+        return 0;
+    }
 
-int main() {
     sublimation::Engine* engine = sublimation::Engine::getSingleton();
     return 0;
 }
@@ -5,56 +5,51 @@
 
 namespace sublimation {
 
-Material::Material() :
-        auxUbo(sizeof(MaterialAux)) {
+Material::Material() {
+    auxUbo = vkw::RenderingDevice::getSingleton()->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, sizeof(MaterialAux));
 }
 
-void Material::apply() {
-    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+Material::~Material() {
+    // file textures are shared and owned by the model
+    vkw::RenderingDevice::getSingleton()->destroyBuffer(auxUbo);
+}
 
-    // Fill in missing textures with constant values (1x1 textures)
-    const std::array<glm::vec4, 5> values{ albedo, glm::vec4{ metallicRoughnessOcclusionFactor.x },
-        glm::vec4{ metallicRoughnessOcclusionFactor.y }, glm::vec4{ metallicRoughnessOcclusionFactor.z }, glm::vec4{ 0 } };
-
-    for (size_t i = 0; i < 5; i++) {
-        if (!textures[i].isActive()) {
-            textures[i].constant = values[i];
-
-            textures[i].texture = rd->createTexture(vkw::TEXTURE_2D, { 1, 1 },
-                    {
-                            VK_FORMAT_R32G32B32A32_SFLOAT,
-                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                            VK_FILTER_NEAREST,
-                            VK_SAMPLER_ADDRESS_MODE_REPEAT,
-                            VK_SAMPLE_COUNT_1_BIT,
-                    },
-                    4 * sizeof(float), glm::value_ptr(textures[i].constant));
-        }
-    }
+void Material::apply() {
+    aux.albedoFactor = albedo;
+    aux.ormFactor = glm::vec4(metallicRoughnessOcclusionFactor.z, metallicRoughnessOcclusionFactor.y, metallicRoughnessOcclusionFactor.x, 0.f);
+    aux.textureMask = (textures[0].isActive() ? AlbedoTexture : 0) | (textures[1].isActive() ? OrmTexture : 0);
 
-    auxUbo.update(&aux);
+    ((vkw::UniformBuffer*)vkw::RenderingDevice::getSingleton()->getBuffer(auxUbo))->update(&aux);
 }
 
-void Material::updateDescriptorSets(const VkDescriptorSetLayout& layout) {
+void Material::updateDescriptorSet(const VkDescriptorSetLayout& layout, uint32_t frameIndex) {
     vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
 
-    // if descriptor not allocated, do that first
-    if (descriptorSet == VK_NULL_HANDLE) {
-        vkw::DescriptorAllocator allocator = rd->getDescriptorAllocator();
+    // if descriptor not allocated, do that first, sets can't be handed back so a lower frame count keeps them
+    if (frameIndex >= descriptorSets.size()) {
+        vkw::DescriptorAllocator& allocator = rd->getDescriptorAllocator();
 
-        descriptorSet = allocator.allocate(layout);
+        while (descriptorSets.size() <= frameIndex) {
+            descriptorSets.push_back(allocator.allocate(layout));
+            writtenVersions.push_back(version - 1);
+        }
     }
-    
+
+    if (writtenVersions[frameIndex] == version) {
+        return;
+    }
+    writtenVersions[frameIndex] = version;
+
     // write descriptors
     {
         vkw::DescriptorWriter writer;
 
-        writer.bindBuffer(0, &auxUbo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        writer.bindBuffer(0, rd->getBuffer(auxUbo), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
         for (uint32_t i = 0; i < textures.size(); i++) {
-            writer.bindImage(i + 1, textures[i].texture, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+            const vkw::TextureHandle texture = textures[i].isActive() ? textures[i].texture : rd->getPlaceholderTexture();
+            writer.bindImage(i + 1, rd->getTexture(texture), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
         }
-        writer.writeSet(descriptorSet);
+        writer.writeSet(descriptorSets[frameIndex]);
     }
 }
 
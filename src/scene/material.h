@@ -3,45 +3,69 @@
 #include <graphics/vulkan/buffer.h>
 #include <graphics/vulkan/texture.h>
 #include <graphics/vulkan/descriptor.h>
+#include <graphics/vulkan/resource_pool.h>
 
 #include <glm/gtc/type_ptr.hpp>
 #include <memory>
 #include <array>
+#include <vector>
 
 namespace sublimation {
 
 struct Texture {
-    vkw::Texture* texture = nullptr;
+    vkw::TextureHandle texture;
 
     std::string filepath;
-    glm::vec4 constant{0, 0, 0, -1};
+    int32_t stream = -1; ///< index in the model's TextureStreamer, -1 if the texture is loaded whole
+    VkFormat format = VK_FORMAT_UNDEFINED; ///< storage of decoded file images, R8 keeps only channel
+    uint32_t channel = 0;
 
-    bool isActive() const { return texture != nullptr; }
-    bool isConstantValue() const { return constant.w < 0.f; }
+    bool isActive() const { return texture.isValid(); }
+};
+
+// bits of MaterialAux::textureMask, slots without their bit take the constant factor and skip the fetch
+enum MaterialTexture {
+    AlbedoTexture = 0x1,
+    OrmTexture = 0x2
 };
 
 struct MaterialAux {
+    glm::vec4 albedoFactor;
+    glm::vec4 ormFactor; // occlusion, roughness, metallic
     uint32_t normalMapMode = 0; // 0 = use vertex normals, 1 = use normal map, 2 = use bump map
     uint32_t roughnessGlossyMode = 0; // 0 = roughness, 1 = glossy (value inverted  in shader)
+    uint32_t textureMask = 0;
+    uint32_t pad0 = 0;
 };
 
 class Material {
 public:
     Material();
-    ~Material() = default;
+    ~Material();
 
     glm::vec4 albedo{ 0.8f, 0.8f, 0.8f , 1.f};
-    glm::vec4 metallicRoughnessOcclusionFactor;
+    glm::vec4 metallicRoughnessOcclusionFactor{ 0.f, 1.f, 1.f, 0.f };
 
-    std::array<Texture, 5> textures;    //< in order: [0]albedo, [1]metallic, [2]roughness, [3]ao, [4]normal
+    // in order: [0]albedo, [1]occlusion/roughness/metallic packed in r/g/b, [2]normal
+    std::array<Texture, 3> textures;
 
     MaterialAux aux;
-    vkw::UniformBuffer auxUbo;
+    vkw::BufferHandle auxUbo;
 
+    // fills aux from the factors and the textures present, missing slots are bound to the device's shared placeholder
     void apply();
 
-    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-    void updateDescriptorSets(const VkDescriptorSetLayout& layout);
+    // call when textures change, every frame slot's set is rewritten the next time the slot is free
+    void markDirty() { version++; }
+    // writes the set of frameIndex if it's missing or behind, frames that used it before have to be retired
+    void updateDescriptorSet(const VkDescriptorSetLayout& layout, uint32_t frameIndex);
+    VkDescriptorSet getDescriptorSet(uint32_t frameIndex) const { return descriptorSets[frameIndex]; }
+
+private:
+    // one set per frame in flight, so a texture swap never rewrites a set a queued frame still reads
+    std::vector<VkDescriptorSet> descriptorSets;
+    std::vector<uint32_t> writtenVersions;
+    uint32_t version = 0;
 };
 
 } //namespace sublimation
@@ -0,0 +1,204 @@
+#include <scene/mesh_cache.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace sublimation {
+
+namespace {
+
+// ranges of a damaged entry could point anywhere, they're checked once here instead of wherever they're used
+bool isEntryValid(const MeshCache::Entry& entry) {
+    const auto inIndices = [&entry](uint32_t firstIndex, uint32_t indexCount) {
+        return static_cast<uint64_t>(firstIndex) + indexCount <= entry.indices.size();
+    };
+
+    for (const PrimitiveLod& lod : entry.lods) {
+        if (!inIndices(lod.firstIndex, lod.indexCount)) {
+            return false;
+        }
+    }
+    for (const mesh_optimizer::Meshlet& meshlet : entry.meshlets) {
+        if (!inIndices(meshlet.firstIndex, meshlet.indexCount)) {
+            return false;
+        }
+    }
+
+    return std::all_of(entry.indices.begin(), entry.indices.end(), [&entry](uint32_t index) { return index < entry.vertices.size(); });
+}
+
+} //namespace
+
+bool MeshCache::getSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = std::filesystem::file_size(sourcePath, error);
+    if (error) {
+        return false;
+    }
+
+    const auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+    if (error) {
+        return false;
+    }
+    time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+
+    return true;
+}
+
+bool MeshCache::load(const std::string& sourcePath, uint32_t importFlags) {
+    entries.clear();
+    dirty = false;
+
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!getSourceStamp(sourcePath, sourceSize, sourceTime)) {
+        return false;
+    }
+
+    const std::string cachePath = getCachePath(sourcePath);
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(cachePath, error);
+    if (error) {
+        return false;
+    }
+
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    Header header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(Header));
+    if (!file || header.magic != magic || header.version != version || header.vertexSize != sizeof(Vertex) ||
+            header.importFlags != importFlags || header.sourceSize != sourceSize || header.sourceTime != sourceTime) {
+        std::cout << "INFO::MeshCache:load: cache of " << sourcePath << " is out of date, rebaking\n";
+        return false;
+    }
+
+    // counts are checked against the bytes left in the file before anything is allocated, a damaged cache is rebaked
+    uint64_t remaining = fileSize - sizeof(Header);
+    bool damaged = static_cast<uint64_t>(header.entryCount) * 6 * sizeof(uint32_t) > remaining;
+
+    entries.resize(damaged ? 0 : header.entryCount);
+    for (Entry& entry : entries) {
+        uint32_t counts[6];
+        file.read(reinterpret_cast<char*>(counts), sizeof(counts));
+        if (!file) {
+            break;
+        }
+        remaining -= sizeof(counts);
+
+        const uint64_t entrySize = static_cast<uint64_t>(counts[2]) * sizeof(Vertex) + static_cast<uint64_t>(counts[3]) * sizeof(uint32_t) +
+                static_cast<uint64_t>(counts[4]) * sizeof(PrimitiveLod) + static_cast<uint64_t>(counts[5]) * sizeof(mesh_optimizer::Meshlet);
+        if (entrySize > remaining) {
+            damaged = true;
+            break;
+        }
+        remaining -= entrySize;
+
+        entry.sourceVertexCount = counts[0];
+        entry.sourceFaceCount = counts[1];
+        entry.vertices.resize(counts[2]);
+        entry.indices.resize(counts[3]);
+        entry.lods.resize(counts[4]);
+        entry.meshlets.resize(counts[5]);
+        file.read(reinterpret_cast<char*>(entry.vertices.data()), entry.vertices.size() * sizeof(Vertex));
+        file.read(reinterpret_cast<char*>(entry.indices.data()), entry.indices.size() * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(entry.lods.data()), entry.lods.size() * sizeof(PrimitiveLod));
+        file.read(reinterpret_cast<char*>(entry.meshlets.data()), entry.meshlets.size() * sizeof(mesh_optimizer::Meshlet));
+        if (file && !isEntryValid(entry)) {
+            damaged = true;
+            break;
+        }
+    }
+
+    if (damaged || !file) {
+        std::cout << "INFO::MeshCache:load: cache of " << sourcePath << " is truncated or damaged, rebaking\n";
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCache::save(const std::string& sourcePath, uint32_t importFlags) const {
+    Header header{
+        .magic = magic,
+        .version = version,
+        .vertexSize = sizeof(Vertex),
+        .importFlags = importFlags,
+        .entryCount = static_cast<uint32_t>(entries.size())
+    };
+    if (!getSourceStamp(sourcePath, header.sourceSize, header.sourceTime)) {
+        return false;
+    }
+
+    // written to a temporary first so an interrupted bake never leaves a cache that passes the header check
+    const std::string cachePath = getCachePath(sourcePath);
+    const std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "INFO::MeshCache:save: could not write " << tempPath << "\n";
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        for (const Entry& entry : entries) {
+            const uint32_t counts[6] = {
+                entry.sourceVertexCount,
+                entry.sourceFaceCount,
+                static_cast<uint32_t>(entry.vertices.size()),
+                static_cast<uint32_t>(entry.indices.size()),
+                static_cast<uint32_t>(entry.lods.size()),
+                static_cast<uint32_t>(entry.meshlets.size())
+            };
+            file.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+            file.write(reinterpret_cast<const char*>(entry.vertices.data()), entry.vertices.size() * sizeof(Vertex));
+            file.write(reinterpret_cast<const char*>(entry.indices.data()), entry.indices.size() * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char*>(entry.lods.data()), entry.lods.size() * sizeof(PrimitiveLod));
+            file.write(reinterpret_cast<const char*>(entry.meshlets.data()), entry.meshlets.size() * sizeof(mesh_optimizer::Meshlet));
+        }
+
+        if (!file) {
+            std::cout << "INFO::MeshCache:save: could not write " << tempPath << "\n";
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error) {
+        std::cout << "INFO::MeshCache:save: could not replace " << cachePath << "\n";
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+const MeshCache::Entry* MeshCache::find(uint32_t meshIndex, uint32_t sourceVertexCount, uint32_t sourceFaceCount) const {
+    if (meshIndex >= entries.size()) {
+        return nullptr;
+    }
+
+    const Entry& entry = entries[meshIndex];
+    if (entry.sourceVertexCount != sourceVertexCount || entry.sourceFaceCount != sourceFaceCount) {
+        return nullptr;
+    }
+
+    return &entry;
+}
+
+void MeshCache::store(uint32_t meshIndex, Entry&& entry) {
+    if (meshIndex >= entries.size()) {
+        entries.resize(meshIndex + 1);
+    }
+
+    entries[meshIndex] = std::move(entry);
+    dirty = true;
+}
+
+} //namespace sublimation
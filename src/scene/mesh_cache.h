@@ -0,0 +1,60 @@
+#pragma once
+
+#include <scene/model.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sublimation {
+
+// Baked vertex and index data of a model's meshes, written next to the source file after the import time
+// optimisation so later loads of an unchanged file read the optimised order instead of recomputing it
+// entries are in the order the importer visits the meshes and only stand in for the mesh they were made from
+class MeshCache {
+public:
+    static constexpr uint32_t version = 3; ///< bump whenever the baked data or the optimisation changes
+
+    struct Entry {
+        uint32_t sourceVertexCount = 0;
+        uint32_t sourceFaceCount = 0;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices; ///< all detail levels
+        std::vector<PrimitiveLod> lods;
+        std::vector<mesh_optimizer::Meshlet> meshlets; ///< of the full detail level
+    };
+
+    static std::string getCachePath(const std::string& sourcePath) { return sourcePath + ".meshcache"; }
+
+    // false if there is no cache for the current source file, import flags and version
+    bool load(const std::string& sourcePath, uint32_t importFlags);
+    bool save(const std::string& sourcePath, uint32_t importFlags) const;
+
+    // nullptr when the entry is missing or was baked from a different mesh
+    const Entry* find(uint32_t meshIndex, uint32_t sourceVertexCount, uint32_t sourceFaceCount) const;
+    void store(uint32_t meshIndex, Entry&& entry);
+
+    bool isDirty() const { return dirty; }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t importFlags;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint32_t entryCount;
+        uint32_t pad0;
+    };
+
+    static constexpr uint32_t magic = 0x434d4253; ///< "SBMC"
+
+    // identifies the source file revision the cache was baked from
+    static bool getSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time);
+
+    std::vector<Entry> entries;
+    bool dirty = false;
+};
+
+} //namespace sublimation
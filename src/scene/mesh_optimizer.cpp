@@ -0,0 +1,654 @@
+#include <scene/mesh_optimizer.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+namespace sublimation {
+
+namespace mesh_optimizer {
+
+namespace {
+
+constexpr uint32_t simulatedCacheSize = 32; ///< LRU size the vertex cache scores are tuned for
+constexpr uint32_t maxValence = 64; ///< valence scores are tabulated up to this many remaining triangles
+
+// cache position scores favour the last triangle's vertices a little less than the rest of the cache
+// so the order does not strip along one edge, valence scores favour finishing vertices with few triangles left
+struct VertexScoreTable {
+    float cache[simulatedCacheSize + 1];
+    float valence[maxValence + 1];
+
+    VertexScoreTable() {
+        for (uint32_t i = 0; i < simulatedCacheSize; i++) {
+            if (i < 3) {
+                cache[i] = 0.75f;
+            } else {
+                const float scaler = 1.f / static_cast<float>(simulatedCacheSize - 3);
+                cache[i] = std::pow(1.f - static_cast<float>(i - 3) * scaler, 1.5f);
+            }
+        }
+        cache[simulatedCacheSize] = 0.f; ///< not in the cache
+
+        valence[0] = 0.f;
+        for (uint32_t i = 1; i <= maxValence; i++) {
+            valence[i] = 2.f / std::sqrt(static_cast<float>(i));
+        }
+    }
+
+    float score(uint32_t cachePosition, uint32_t remainingTriangles) const {
+        if (remainingTriangles == 0) {
+            return -1.f;
+        }
+        return cache[cachePosition] + valence[std::min(remainingTriangles, maxValence)];
+    }
+};
+
+const VertexScoreTable& getScoreTable() {
+    static const VertexScoreTable table;
+    return table;
+}
+
+// area weighted sum of squared plane distances, divided by the weight it is the mean squared distance
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    static Quadric fromPlane(const glm::vec3& normal, float d, float weight) {
+        const double a = normal.x, b = normal.y, c = normal.z, w = weight;
+        return { a * a * w, a * b * w, a * c * w, a * d * w, b * b * w, b * c * w, b * d * w, c * c * w, c * d * w, double(d) * d * w, w };
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+        return *this;
+    }
+
+    float error(const glm::vec3& p) const {
+        const double x = p.x, y = p.y, z = p.z;
+        const double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                + a22 * z * z + 2 * a23 * z
+                + a33;
+        return weight > 0 ? static_cast<float>(std::max(e, 0.0) / weight) : 0.f;
+    }
+};
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    float error; ///< squared distance
+};
+
+} //namespace
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2 || vertexCount == 0) {
+        return;
+    }
+
+    const VertexScoreTable& table = getScoreTable();
+
+    // adjacency: the triangles of every vertex, remaining ones kept at the front of each list
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        triangleOffsets[indices[i] + 1]++;
+    }
+    std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+
+    std::vector<uint32_t> remaining(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        remaining[v] = triangleOffsets[v + 1] - triangleOffsets[v];
+    }
+
+    std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                vertexTriangles[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+    }
+
+    std::vector<uint32_t> cachePosition(vertexCount, simulatedCacheSize);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScore[v] = table.score(simulatedCacheSize, remaining[v]);
+    }
+
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> output(triangleCount * 3);
+    size_t outputTriangles = 0;
+    size_t scanStart = 0; ///< every triangle before it is emitted, restarts the search when the cache runs dry
+
+    uint32_t cache[simulatedCacheSize + 3];
+    uint32_t cacheCount = 0;
+
+    int64_t bestTriangle = -1;
+    while (outputTriangles < triangleCount) {
+        if (bestTriangle < 0) {
+            float bestScore = -1.f;
+            for (size_t t = scanStart; t < triangleCount; t++) {
+                if (!emitted[t] && triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    bestTriangle = static_cast<int64_t>(t);
+                }
+            }
+            while (scanStart < triangleCount && emitted[scanStart]) {
+                scanStart++;
+            }
+        }
+
+        const uint32_t triangle = static_cast<uint32_t>(bestTriangle);
+        const uint32_t* corners = &indices[triangle * 3];
+        emitted[triangle] = 1;
+        output[outputTriangles * 3] = corners[0];
+        output[outputTriangles * 3 + 1] = corners[1];
+        output[outputTriangles * 3 + 2] = corners[2];
+        outputTriangles++;
+
+        // move the triangle's vertices to the front of the cache, the rest shifts back
+        uint32_t newCache[simulatedCacheSize + 3];
+        uint32_t newCount = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            newCache[newCount++] = corners[k];
+        }
+        for (uint32_t i = 0; i < cacheCount; i++) {
+            const uint32_t v = cache[i];
+            if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                newCache[newCount++] = v;
+            }
+        }
+
+        // drop the emitted triangle from its vertices' remaining lists
+        for (uint32_t k = 0; k < 3; k++) {
+            const uint32_t v = corners[k];
+            uint32_t* list = &vertexTriangles[triangleOffsets[v]];
+            for (uint32_t i = 0; i < remaining[v]; i++) {
+                if (list[i] == triangle) {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // rescore everything that moved, vertices pushed out of the cache get their uncached score back
+        for (uint32_t i = 0; i < newCount; i++) {
+            const uint32_t v = newCache[i];
+            cachePosition[v] = i < simulatedCacheSize ? i : simulatedCacheSize;
+        }
+
+        bestTriangle = -1;
+        float bestScore = -1.f;
+        for (uint32_t i = 0; i < newCount; i++) {
+            const uint32_t v = newCache[i];
+            const float newScore = table.score(cachePosition[v], remaining[v]);
+            const float delta = newScore - vertexScore[v];
+            vertexScore[v] = newScore;
+
+            const uint32_t* list = &vertexTriangles[triangleOffsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                triangleScore[list[j]] += delta;
+            }
+        }
+
+        // the next triangle is the best one touching the cache, a full scan only happens when none is left
+        for (uint32_t i = 0; i < std::min(newCount, simulatedCacheSize); i++) {
+            const uint32_t v = newCache[i];
+            const uint32_t* list = &vertexTriangles[triangleOffsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                if (triangleScore[list[j]] > bestScore) {
+                    bestScore = triangleScore[list[j]];
+                    bestTriangle = list[j];
+                }
+            }
+        }
+
+        cacheCount = std::min(newCount, simulatedCacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const glm::vec3* positions, size_t vertexCount, float threshold) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2 || vertexCount == 0) {
+        return;
+    }
+
+    // FIFO cache simulation, flushing it is a jump of the timestamp
+    constexpr uint32_t fifoSize = 16;
+    std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+    uint32_t timestamp = fifoSize + 1;
+    auto triangleMisses = [&](size_t triangle) {
+        uint32_t misses = 0;
+        for (size_t k = 0; k < 3; k++) {
+            const uint32_t v = indices[triangle * 3 + k];
+            if (timestamp - cacheTimestamps[v] > fifoSize) {
+                cacheTimestamps[v] = timestamp++;
+                misses++;
+            }
+        }
+        return misses;
+    };
+
+    // a cluster can start wherever the miss ratio so far stays within threshold of the whole mesh's,
+    // the next one then starts with a cold cache without costing more than that overall
+    uint32_t totalMisses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        totalMisses += triangleMisses(t);
+    }
+    const float thresholdRatio = static_cast<float>(totalMisses) / static_cast<float>(triangleCount) * threshold;
+
+    std::vector<uint32_t> clusterStarts{ 0 };
+    timestamp += fifoSize + 1;
+    uint32_t clusterMisses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        clusterMisses += triangleMisses(t);
+
+        const size_t clusterSize = t + 1 - clusterStarts.back();
+        if (t + 1 < triangleCount && static_cast<float>(clusterMisses) <= thresholdRatio * static_cast<float>(clusterSize)) {
+            clusterStarts.push_back(static_cast<uint32_t>(t + 1));
+            timestamp += fifoSize + 1;
+            clusterMisses = 0;
+        }
+    }
+    clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+    const size_t clusterCount = clusterStarts.size() - 1;
+    if (clusterCount < 2) {
+        return;
+    }
+
+    // area weighted centroid of the whole mesh and of every cluster, plus the cluster's average normal
+    glm::vec3 meshCentroid(0.f);
+    float meshArea = 0.f;
+    std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.f));
+    std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.f));
+
+    for (size_t c = 0; c < clusterCount; c++) {
+        float clusterArea = 0.f;
+        for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& p = positions[indices[t * 3 + 2]];
+
+            const glm::vec3 normal = glm::cross(b - a, p - a);
+            const float area = glm::length(normal);
+            const glm::vec3 centroid = (a + b + p) / 3.f;
+
+            clusterCentroids[c] += centroid * area;
+            clusterNormals[c] += normal;
+            clusterArea += area;
+        }
+
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterArea;
+        clusterCentroids[c] = clusterArea > 0.f ? clusterCentroids[c] / clusterArea : clusterCentroids[c];
+    }
+    meshCentroid = meshArea > 0.f ? meshCentroid / meshArea : meshCentroid;
+
+    // clusters facing away from the centre are the ones most likely in front from any direction
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        const float normalLength = glm::length(clusterNormals[c]);
+        const glm::vec3 normal = normalLength > 0.f ? clusterNormals[c] / normalLength : glm::vec3(0.f);
+        sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, normal);
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    for (uint32_t c : order) {
+        output.insert(output.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimizeVertexFetchRemap(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& remap) {
+    remap.assign(vertexCount, ~0u);
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t& index = indices[i];
+        if (remap[index] == ~0u) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    return next;
+}
+
+size_t simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount, const glm::vec3* positions, size_t vertexCount,
+        size_t targetIndexCount, float targetError, float* resultError) {
+    std::vector<uint32_t> current(indices, indices + indexCount - indexCount % 3);
+    float maxError = 0.f;
+
+    // open edges are used by a single triangle, sorting both directions of every edge finds them
+    std::vector<uint8_t> locked(vertexCount, 0);
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(current.size());
+        for (size_t i = 0; i < current.size(); i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                const uint64_t a = current[i + k];
+                const uint64_t b = current[i + (k + 1) % 3];
+                edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();) {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i]) {
+                j++;
+            }
+            if (j - i == 1) {
+                locked[edges[i] >> 32] = 1;
+                locked[edges[i] & 0xffffffff] = 1;
+            }
+            i = j;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < current.size(); i += 3) {
+        const glm::vec3& a = positions[current[i]];
+        const glm::vec3& b = positions[current[i + 1]];
+        const glm::vec3& c = positions[current[i + 2]];
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        const float area = glm::length(normal);
+        if (area == 0.f) {
+            continue;
+        }
+        normal /= area;
+
+        const Quadric quadric = Quadric::fromPlane(normal, -glm::dot(normal, a), area);
+        quadrics[current[i]] += quadric;
+        quadrics[current[i + 1]] += quadric;
+        quadrics[current[i + 2]] += quadric;
+    }
+
+    const float maxSquaredError = targetError * targetError;
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexTriangles;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint8_t> touched(vertexCount);
+    std::vector<Collapse> collapses;
+
+    // every pass collapses a set of edges that do not share vertices, cheapest first
+    while (current.size() > targetIndexCount) {
+        const size_t triangleCount = current.size() / 3;
+
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (uint32_t index : current) {
+            triangleOffsets[index + 1]++;
+        }
+        std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+        vertexTriangles.resize(current.size());
+        {
+            std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (size_t k = 0; k < 3; k++) {
+                    vertexTriangles[fill[current[t * 3 + k]]++] = static_cast<uint32_t>(t);
+                }
+            }
+        }
+
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                const uint32_t a = current[t * 3 + k];
+                const uint32_t b = current[t * 3 + (k + 1) % 3];
+                if (a > b) {
+                    continue; ///< the other direction of interior edges is seen from the neighbour
+                }
+
+                Quadric quadric = quadrics[a];
+                quadric += quadrics[b];
+                const float errorAB = locked[a] ? FLT_MAX : quadric.error(positions[b]);
+                const float errorBA = locked[b] ? FLT_MAX : quadric.error(positions[a]);
+                if (errorAB == FLT_MAX && errorBA == FLT_MAX) {
+                    continue;
+                }
+
+                collapses.push_back(errorAB <= errorBA ? Collapse{ a, b, errorAB } : Collapse{ b, a, errorBA });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::fill(touched.begin(), touched.end(), 0);
+
+        // every collapse removes the two triangles of its edge
+        size_t remainingTriangles = triangleCount;
+        const size_t targetTriangles = targetIndexCount / 3;
+        size_t collapsed = 0;
+        for (const Collapse& collapse : collapses) {
+            if (collapse.error > maxSquaredError || remainingTriangles <= targetTriangles) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            // moving from onto to must not turn any of its other triangles over
+            bool flips = false;
+            for (uint32_t i = triangleOffsets[collapse.from]; i < triangleOffsets[collapse.from + 1] && !flips; i++) {
+                const uint32_t* triangle = &current[vertexTriangles[i] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                    continue;
+                }
+
+                const uint32_t k = triangle[0] == collapse.from ? 0 : triangle[1] == collapse.from ? 1 : 2;
+                const glm::vec3& b = positions[triangle[(k + 1) % 3]];
+                const glm::vec3& c = positions[triangle[(k + 2) % 3]];
+                const glm::vec3 before = glm::cross(b - positions[collapse.from], c - positions[collapse.from]);
+                const glm::vec3 after = glm::cross(b - positions[collapse.to], c - positions[collapse.to]);
+                flips = glm::dot(before, after) <= 0.f;
+            }
+            if (flips) {
+                continue;
+            }
+
+            // the neighbourhood changed shape, its vertices wait for the next pass
+            for (uint32_t i = triangleOffsets[collapse.from]; i < triangleOffsets[collapse.from + 1]; i++) {
+                const uint32_t* triangle = &current[vertexTriangles[i] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            maxError = std::max(maxError, collapse.error);
+            remainingTriangles -= std::min<size_t>(remainingTriangles, 2);
+            collapsed++;
+        }
+
+        if (collapsed == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const uint32_t a = remap[current[t * 3]];
+            const uint32_t b = remap[current[t * 3 + 1]];
+            const uint32_t c = remap[current[t * 3 + 2]];
+            if (a != b && b != c && a != c) {
+                current[write++] = a;
+                current[write++] = b;
+                current[write++] = c;
+            }
+        }
+        current.resize(write);
+    }
+
+    std::copy(current.begin(), current.end(), destination);
+    if (resultError) {
+        *resultError = std::sqrt(maxError);
+    }
+
+    return current.size();
+}
+
+namespace {
+
+void computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const glm::vec3* positions) {
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+        const glm::vec3& p = positions[indices[meshlet.firstIndex + i]];
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+
+    meshlet.center = 0.5f * (boundsMin + boundsMax);
+    meshlet.radius = 0.f;
+    for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[meshlet.firstIndex + i]] - meshlet.center));
+    }
+
+    // the cone axis is the average facing, its spread is set by the normal furthest from it
+    const uint32_t triangleCount = meshlet.indexCount / 3;
+    std::vector<glm::vec3> normals(triangleCount, glm::vec3(0.f));
+    glm::vec3 axis(0.f);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        const uint32_t* triangle = &indices[meshlet.firstIndex + t * 3];
+        const glm::vec3 normal = glm::cross(positions[triangle[1]] - positions[triangle[0]], positions[triangle[2]] - positions[triangle[0]]);
+        const float length = glm::length(normal);
+        if (length > 0.f) {
+            normals[t] = normal / length;
+            axis += normals[t];
+        }
+    }
+
+    meshlet.coneApex = meshlet.center;
+    meshlet.coneAxis = glm::vec3(0.f, 0.f, 1.f);
+    meshlet.coneCutoff = 1.f;
+
+    const float axisLength = glm::length(axis);
+    if (axisLength == 0.f) {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.f;
+    for (const glm::vec3& normal : normals) {
+        if (normal != glm::vec3(0.f)) {
+            minDot = std::min(minDot, glm::dot(normal, axis));
+        }
+    }
+
+    // nearly a half space or wider, the cone could never reject anything
+    if (minDot <= 0.1f) {
+        return;
+    }
+
+    // move the apex back along the axis until every triangle's plane lies in front of it
+    float maxT = 0.f;
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        if (normals[t] == glm::vec3(0.f)) {
+            continue;
+        }
+        const glm::vec3& p = positions[indices[meshlet.firstIndex + t * 3]];
+        const float t0 = glm::dot(meshlet.center - p, normals[t]) / glm::dot(axis, normals[t]);
+        maxT = std::max(maxT, t0);
+    }
+
+    meshlet.coneApex = meshlet.center - axis * maxT;
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+}
+
+} //namespace
+
+void buildMeshlets(std::vector<Meshlet>& meshlets, const uint32_t* indices, size_t indexCount, const glm::vec3* positions, size_t vertexCount,
+        uint32_t maxVertices, uint32_t maxTriangles) {
+    meshlets.clear();
+    const size_t triangleCount = indexCount / 3;
+
+    // stamp of the meshlet a vertex was last counted for
+    std::vector<uint32_t> lastMeshlet(vertexCount, ~0u);
+    Meshlet current{};
+    uint32_t currentVertices = 0;
+
+    for (size_t t = 0; t < triangleCount; t++) {
+        const uint32_t* triangle = &indices[t * 3];
+        const uint32_t id = static_cast<uint32_t>(meshlets.size());
+
+        uint32_t newVertices = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            newVertices += lastMeshlet[triangle[k]] != id && (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1]);
+        }
+
+        if (current.indexCount > 0 && (currentVertices + newVertices > maxVertices || current.indexCount / 3 >= maxTriangles)) {
+            meshlets.push_back(current);
+            current = { .firstIndex = static_cast<uint32_t>(t * 3), .indexCount = 0 };
+            currentVertices = 0;
+            t--;
+            continue;
+        }
+
+        for (uint32_t k = 0; k < 3; k++) {
+            if (lastMeshlet[triangle[k]] != id) {
+                lastMeshlet[triangle[k]] = id;
+                currentVertices++;
+            }
+        }
+        current.indexCount += 3;
+    }
+
+    if (current.indexCount > 0) {
+        meshlets.push_back(current);
+    }
+
+    for (Meshlet& meshlet : meshlets) {
+        computeMeshletBounds(meshlet, indices, positions);
+    }
+}
+
+float getAverageCacheMissRatio(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return 0.f;
+    }
+
+    std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+    uint32_t timestamp = cacheSize + 1;
+    size_t misses = 0;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        const uint32_t v = indices[i];
+        if (timestamp - cacheTimestamps[v] > cacheSize) {
+            cacheTimestamps[v] = timestamp++;
+            misses++;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+} //namespace mesh_optimizer
+
+} //namespace sublimation
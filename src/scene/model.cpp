@@ -1,8 +1,13 @@
 #include <scene/model.h>
 
+#include <graphics/render_system.h>
 #include <graphics/vulkan/rendering_device.h>
 #include <graphics/vulkan/utils.h>
+#include <scene/mesh_cache.h>
+#include <scene/mesh_optimizer.h>
+#include <scene/texture_baker.h>
 
+#include <algorithm>
 #include <array>
 #include <assimp/Importer.hpp>
 #include <iostream>
@@ -14,12 +19,53 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #endif
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_access.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
 
 namespace sublimation {
 
+namespace {
+
+// maps a unit vector onto the [-1, 1] square, decoded by octahedralDecode in the vertex shaders
+glm::vec2 octahedralEncode(const glm::vec3& v) {
+    const float length = glm::abs(v.x) + glm::abs(v.y) + glm::abs(v.z);
+    if (length == 0.f) {
+        return glm::vec2(0.f);
+    }
+
+    const glm::vec3 n = v / length;
+    if (n.z >= 0.f) {
+        return glm::vec2(n);
+    }
+
+    // fold the lower hemisphere over the diagonals
+    return glm::vec2((1.f - glm::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f), (1.f - glm::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
+}
+
+} //namespace
+
+void AABB::expand(const glm::vec3& point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+AABB AABB::transform(const glm::mat4& matrix) const {
+    // every column contributes its smallest and largest extent to the new box
+    AABB result;
+    result.min = result.max = glm::vec3(matrix[3]);
+    for (int i = 0; i < 3; i++) {
+        const glm::vec3 a = glm::vec3(matrix[i]) * min[i];
+        const glm::vec3 b = glm::vec3(matrix[i]) * max[i];
+        result.min += glm::min(a, b);
+        result.max += glm::max(a, b);
+    }
+
+    return result;
+}
+
 Mesh::Mesh(glm::mat4 matrix) {
 }
 
@@ -54,41 +100,7 @@ void Node::update() {
 Node::~Node() {
 }
 
-VkVertexInputBindingDescription Vertex::getBindingDescription(uint32_t binding) {
-    return VkVertexInputBindingDescription{
-        .binding = binding,
-        .stride = sizeof(Vertex),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-    };
-}
-
-std::array<VkVertexInputAttributeDescription, 4> Vertex::getAttributeDescriptions(uint32_t binding) {
-    std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
-
-    attributeDescriptions[0].binding = binding;
-    attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[0].offset = offsetof(Vertex, position);
-
-    attributeDescriptions[1].binding = binding;
-    attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[1].offset = offsetof(Vertex, normal);
-
-    attributeDescriptions[2].binding = binding;
-    attributeDescriptions[2].location = 2;
-    attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[2].offset = offsetof(Vertex, uv);
-
-    attributeDescriptions[3].binding = binding;
-    attributeDescriptions[3].location = 3;
-    attributeDescriptions[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[3].offset = offsetof(Vertex, tangent);
-
-    return attributeDescriptions;
-}
-
-void Model::loadFromFile(const std::string& filepath, uint32_t postProcessFlags) {
+void Model::loadFromFile(const std::string& filepath, uint32_t postProcessFlags, vkw::VertexFormat format) {
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(filepath, postProcessFlags);
 
@@ -97,65 +109,51 @@ void Model::loadFromFile(const std::string& filepath, uint32_t postProcessFlags)
         return;
     }
 
-    loadFromAiScene(scene, filepath);
+    loadFromAiScene(scene, filepath, format, postProcessFlags);
 }
 
-void Model::loadFromAiScene(const aiScene* scene, const std::string& filepath) {
+void Model::loadFromAiScene(const aiScene* scene, const std::string& filepath, vkw::VertexFormat format, uint32_t postProcessFlags) {
     path = filepath.substr(0, filepath.find_last_of('/'));
+    vertexFormat = format;
+    multiDrawIndirect = vkw::RenderingDevice::getSingleton()->getPhysicalDeviceFeatures().multiDrawIndirect;
 
     loadMaterials(scene);
 
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    MeshCache cache;
+    cache.load(filepath, postProcessFlags);
+    meshCache = &cache;
+    processedMeshCount = 0;
+
     processNode(scene->mRootNode, scene, nullptr, vertices, indices);
 
+    if (cache.isDirty()) {
+        cache.save(filepath, postProcessFlags);
+    }
+    meshCache = nullptr;
+
     for (auto& node : linearNodes) {
         if (node->mesh) {
             node->update();
         }
     }
 
-    uint32_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-    uint32_t indexBufferSize = indices.size() * sizeof(uint32_t);
-    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-
-    // Vertex data
-    {
-        vkw::Buffer vertexStagingBuffer(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VMA_MEMORY_USAGE_CPU_TO_GPU, vertices.data());
-
-        vertexBuffer = rd->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, vertexBufferSize);
-        VkCommandBuffer commandBuffer = rd->getCommandBufferOneTime(0 /*TODO: change to current command pool index */);
-
-        VkBufferCopy copyRegion{
-            .size = vertexBufferSize
-        };
-        vkCmdCopyBuffer(commandBuffer, vertexStagingBuffer.getBuffer(), vertexBuffer->getBuffer(), 1, &copyRegion);
-
-        rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
-    }
-
-    // Index data
-    {
-        vkw::Buffer indexStagingBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VMA_MEMORY_USAGE_CPU_TO_GPU, indices.data());
-
-        indexBuffer = rd->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, indexBufferSize);
-
-        VkCommandBuffer commandBuffer = rd->getCommandBufferOneTime(0 /*TODO: change to current command pool index */);
-
-        VkBufferCopy copyRegion{
-            .size = indexBufferSize
-        };
-        vkCmdCopyBuffer(commandBuffer, indexStagingBuffer.getBuffer(), indexBuffer->getBuffer(), 1, &copyRegion);
-
-        rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
+    if (vertexFormat == vkw::VertexFormat::Packed) {
+        uploadPackedVertices(vertices);
+    } else {
+        uploadVertices(vertices);
     }
+    indexBuffer = uploadBuffer(indices.data(), indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 
     //updateModelBounds();
 }
 
 void Model::loadMaterials(const aiScene* scene) {
+    // the mip chains of every decoded texture are built together once the materials are loaded
+    vkw::MipGenerator& mipGenerator = vkw::RenderingDevice::getSingleton()->getMipGenerator();
+    mipGenerator.beginBatch();
+
     for (size_t i = 0; i < scene->mNumMaterials; i++) {
         const aiMaterial* aimaterial = scene->mMaterials[i];
 
@@ -169,32 +167,30 @@ void Model::loadMaterials(const aiScene* scene) {
             newMaterial->albedo = glm::vec4(color.r, color.g, color.b, 1);
         }
 
-        if (aimaterial->Get(AI_MATKEY_METALLIC_FACTOR, newMaterial->metallicRoughnessOcclusionFactor.x) != AI_SUCCESS) {
-            aimaterial->Get(AI_MATKEY_SPECULAR_FACTOR, newMaterial->metallicRoughnessOcclusionFactor.x);
-        }
-        if (aimaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, newMaterial->metallicRoughnessOcclusionFactor.y) != AI_SUCCESS) {
-            if (aimaterial->Get(AI_MATKEY_GLOSSINESS_FACTOR, newMaterial->metallicRoughnessOcclusionFactor.y) == AI_SUCCESS) {
-                newMaterial->aux.roughnessGlossyMode = 1;
-            }
+        const glm::vec3 ormConstant = texture_baker::getOrmConstant(aimaterial);
+        newMaterial->metallicRoughnessOcclusionFactor = glm::vec4(ormConstant.z, ormConstant.y, ormConstant.x, 0.f);
+        float roughness;
+        if (aimaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, roughness) != AI_SUCCESS && aimaterial->Get(AI_MATKEY_GLOSSINESS_FACTOR, roughness) == AI_SUCCESS) {
+            newMaterial->aux.roughnessGlossyMode = 1;
         }
 
         // Load material textures, nullptr if not
-        newMaterial->textures[0] = loadTexture(aimaterial, aiTextureType_DIFFUSE);
-        newMaterial->textures[1] = loadTexture(aimaterial, aiTextureType_METALNESS);
-        if (!newMaterial->textures[1].isActive()) {
-            newMaterial->textures[1] = loadTexture(aimaterial, aiTextureType_SPECULAR);
+        newMaterial->textures[0] = loadTexture(aimaterial, aiTextureType_DIFFUSE, texture_baker::TextureUsage::Color);
+
+        // occlusion, roughness and metallic are fetched at once from a texture packed at import and cached next to the model
+        const std::string packedName = texture_baker::packOcclusionRoughnessMetallic(path, texture_baker::getOrmSources(aimaterial, path, ormConstant));
+        if (!packedName.empty()) {
+            newMaterial->textures[1] = loadTextureFile(packedName, texture_baker::TextureUsage::Mask);
         }
-        newMaterial->textures[2] = loadTexture(aimaterial, aiTextureType_DIFFUSE_ROUGHNESS);
-        newMaterial->textures[3] = loadTexture(aimaterial, aiTextureType_AMBIENT_OCCLUSION);
 
-        newMaterial->textures[4] = loadTexture(aimaterial, aiTextureType_NORMALS);
+        newMaterial->textures[2] = loadTexture(aimaterial, aiTextureType_NORMALS, texture_baker::TextureUsage::Normal);
 
-        if (newMaterial->textures[4].isActive()) {
+        if (newMaterial->textures[2].isActive()) {
             newMaterial->aux.normalMapMode = 1;
         } else {
             // no normal map found, try loading the bump map instead
-            newMaterial->textures[4] = loadTexture(aimaterial, aiTextureType_HEIGHT);
-            if (newMaterial->textures[4].isActive()) {
+            newMaterial->textures[2] = loadTexture(aimaterial, aiTextureType_HEIGHT, texture_baker::TextureUsage::Scalar, 0);
+            if (newMaterial->textures[2].isActive()) {
                 newMaterial->aux.normalMapMode = 2;
             }
         }
@@ -203,9 +199,11 @@ void Model::loadMaterials(const aiScene* scene) {
 
         materials.push_back(std::move(newMaterial));
     }
+
+    mipGenerator.endBatch();
 }
 
-Texture Model::loadTexture(const aiMaterial* mat, aiTextureType type) {
+Texture Model::loadTexture(const aiMaterial* mat, aiTextureType type, texture_baker::TextureUsage usage, uint32_t channel) {
     Texture texture;
     uint32_t typeCount = mat->GetTextureCount(type);
     if (typeCount == 0) {
@@ -219,9 +217,28 @@ Texture Model::loadTexture(const aiMaterial* mat, aiTextureType type) {
 
     aiString filepath;
     mat->GetTexture(type, 0, &filepath);
+
+    return loadTextureFile(filepath.C_Str(), usage, channel);
+}
+
+Texture Model::loadTextureFile(const std::string& filepath, texture_baker::TextureUsage usage, uint32_t channel) {
+    // colour is stored as sRGB so it is filtered and lit in linear space, normals keep x and y for the shader to rebuild z
+    VkFormat format = VK_FORMAT_R8_UNORM;
+    if (usage == texture_baker::TextureUsage::Color) {
+        format = VK_FORMAT_R8G8B8A8_SRGB;
+        channel = 0;
+    } else if (usage == texture_baker::TextureUsage::Mask) {
+        format = VK_FORMAT_R8G8B8A8_UNORM;
+        channel = 0;
+    } else if (usage == texture_baker::TextureUsage::Normal) {
+        format = VK_FORMAT_R8G8_UNORM;
+        channel = 0;
+    }
+
+    Texture texture;
     bool foundLoaded = false;
     for (unsigned int i = 0; i < textures.size(); i++) {
-        if (std::strcmp(textures[i].filepath.c_str(), filepath.C_Str()) == 0) {
+        if (textures[i].filepath == filepath && textures[i].format == format && textures[i].channel == channel) {
             texture = textures[i];
             foundLoaded = true;
             break;
@@ -229,9 +246,24 @@ Texture Model::loadTexture(const aiMaterial* mat, aiTextureType type) {
     }
 
     if (!foundLoaded) {
-        texture.filepath = filepath.C_Str();
-        texture.texture = vkw::RenderingDevice::getSingleton()->loadTextureFromFile(path + '/' + filepath.C_Str(),
-            VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, false, false);
+        texture.filepath = filepath;
+        texture.format = format;
+        texture.channel = channel;
+        // block compressed bakes from texture_baker replace the source image when present, their mips are streamed
+        const std::string resolvedPath = texture_baker::resolve(path + '/' + filepath, usage, channel);
+        if (vkw::TextureFile::isContainer(resolvedPath)) {
+            if (!textureStreamer) {
+                textureStreamer = std::make_unique<TextureStreamer>();
+            }
+            texture.stream = textureStreamer->add(resolvedPath, channel);
+        }
+
+        if (texture.stream >= 0) {
+            texture.texture = textureStreamer->getTexture(texture.stream);
+        } else {
+            texture.texture = vkw::RenderingDevice::getSingleton()->loadTextureFromFile(resolvedPath,
+                VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, false, true, format, channel);
+        }
         textures.push_back(texture);
     }
 
@@ -280,6 +312,97 @@ std::unique_ptr<Mesh> Model::processMesh(aiMesh* mesh, const aiScene* scene, glm
     std::unique_ptr<Mesh> newMesh = std::make_unique<Mesh>(transform);
     newMesh->name = mesh->mName.C_Str();
 
+    // indices stay relative to the mesh, the draw offsets them by the mesh's first vertex
+    const int32_t vertexOffset = static_cast<int32_t>(vertices.size());
+    const uint32_t firstIndex = static_cast<uint32_t>(indices.size());
+
+    std::vector<Vertex> meshVertices;
+    std::vector<uint32_t> meshIndices;
+    std::vector<PrimitiveLod> lods;
+    std::vector<mesh_optimizer::Meshlet> meshlets;
+    loadMeshData(mesh, meshVertices, meshIndices, lods, meshlets);
+
+    AABB bounds;
+    for (const Vertex& vertex : meshVertices) {
+        bounds.expand(vertex.position);
+    }
+
+    // ratio of the full detail surface's area in texture space to its area in mesh space
+    float meshArea = 0.f;
+    float uvArea = 0.f;
+    for (uint32_t i = lods[0].firstIndex; i + 2 < lods[0].firstIndex + lods[0].indexCount; i += 3) {
+        const Vertex& v0 = meshVertices[meshIndices[i]];
+        const Vertex& v1 = meshVertices[meshIndices[i + 1]];
+        const Vertex& v2 = meshVertices[meshIndices[i + 2]];
+        meshArea += glm::length(glm::cross(v1.position - v0.position, v2.position - v0.position));
+        const glm::vec2 e1 = v1.uv - v0.uv;
+        const glm::vec2 e2 = v2.uv - v0.uv;
+        uvArea += glm::abs(e1.x * e2.y - e1.y * e2.x);
+    }
+
+    const uint32_t meshVertexCount = static_cast<uint32_t>(meshVertices.size());
+    vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+    indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+
+    // one primitive per mesh, it is the unit that gets culled and drawn
+    std::shared_ptr<Primitive> primitive = std::make_shared<Primitive>();
+    primitive->firstIndex = firstIndex;
+    primitive->indexCount = lods[0].indexCount;
+    primitive->vertexOffset = vertexOffset;
+    primitive->vertexCount = meshVertexCount;
+    primitive->drawIndex = primitiveCount++;
+    primitive->material = mesh->mMaterialIndex > -1 ? materials[mesh->mMaterialIndex].get() : materials.back().get();
+    primitive->bounds = bounds;
+    primitive->uvDensity = meshArea > 0.f ? glm::sqrt(uvArea / meshArea) : 0.f;
+    primitive->lods = std::move(lods);
+    for (PrimitiveLod& lod : primitive->lods) {
+        lod.firstIndex += firstIndex;
+    }
+    primitive->meshlets = std::move(meshlets);
+    for (mesh_optimizer::Meshlet& meshlet : primitive->meshlets) {
+        meshlet.firstIndex += firstIndex;
+    }
+    primitive->firstCluster = clusterCount;
+    primitive->clusterCount = std::max<uint32_t>(1, static_cast<uint32_t>(primitive->meshlets.size()));
+    clusterCount += primitive->clusterCount;
+
+    if (primitive->indexCount <= 3 * maxOccluderTriangles) {
+        const uint32_t occluderVertexOffset = static_cast<uint32_t>(occluderVertices.size());
+        for (uint32_t i = 0; i < meshVertexCount; i++) {
+            occluderVertices.push_back(vertices[vertexOffset + i].position);
+        }
+
+        primitive->occluderFirstIndex = static_cast<uint32_t>(occluderIndices.size());
+        primitive->occluderIndexCount = primitive->indexCount;
+        for (uint32_t i = 0; i < primitive->indexCount; i++) {
+            occluderIndices.push_back(occluderVertexOffset + indices[firstIndex + i]);
+        }
+    }
+
+    // packed positions are stored relative to the mesh bounds, flat axes keep a unit extent so quantising never divides by zero
+    if (vertexFormat == vkw::VertexFormat::Packed && meshVertexCount > 0) {
+        const glm::vec3 extent = bounds.max - bounds.min;
+        newMesh->pushConstants.positionOffset = glm::vec4(bounds.min, 0.f);
+        newMesh->pushConstants.positionScale = glm::vec4(glm::mix(extent, glm::vec3(1.f), glm::lessThanEqual(extent, glm::vec3(0.f))), 0.f);
+    }
+
+    newMesh->primitives.push_back(primitive);
+
+    return newMesh;
+}
+
+void Model::loadMeshData(aiMesh* mesh, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<PrimitiveLod>& lods,
+        std::vector<mesh_optimizer::Meshlet>& meshlets) {
+    const uint32_t meshIndex = processedMeshCount++;
+    if (const MeshCache::Entry* cached = meshCache ? meshCache->find(meshIndex, mesh->mNumVertices, mesh->mNumFaces) : nullptr) {
+        vertices = cached->vertices;
+        indices = cached->indices;
+        lods = cached->lods;
+        meshlets = cached->meshlets;
+        return;
+    }
+
+    vertices.reserve(mesh->mNumVertices);
     for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
         Vertex vertex{
             .position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z),
@@ -291,6 +414,11 @@ std::unique_ptr<Mesh> Model::processMesh(aiMesh* mesh, const aiScene* scene, glm
             vertex.tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
         }
 
+        if (mesh->mTangents && mesh->mBitangents) {
+            const glm::vec3 bitangent(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+            vertex.bitangentSign = glm::dot(glm::cross(vertex.normal, vertex.tangent), bitangent) < 0.f ? -1.f : 1.f;
+        }
+
         if (mesh->mTextureCoords[0]) {
             vertex.uv = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
         }
@@ -299,27 +427,136 @@ std::unique_ptr<Mesh> Model::processMesh(aiMesh* mesh, const aiScene* scene, glm
     }
 
     for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
-        uint32_t firstIndex = indices.size();
-        uint32_t indexCount = face.mNumIndices;
-
-        glm::vec3 pmin{ FLT_MAX }, pmax{ -FLT_MAX };
-        //AABB aabb{};
+        const aiFace& face = mesh->mFaces[i];
         for (uint32_t j = 0; j < face.mNumIndices; j++) {
             indices.push_back(face.mIndices[j]);
+        }
+    }
+
+    lods = { { .firstIndex = 0, .indexCount = static_cast<uint32_t>(indices.size()), .error = 0.f } };
+
+    // triangle order for the post-transform cache, then clusters against overdraw, then vertices in order of use
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+        mesh_optimizer::optimizeVertexCache(indices.data(), indices.size(), vertices.size());
+
+        std::vector<glm::vec3> positions(vertices.size());
+        AABB bounds;
+        for (size_t i = 0; i < vertices.size(); i++) {
+            positions[i] = vertices[i].position;
+            bounds.expand(positions[i]);
+        }
+        mesh_optimizer::optimizeOverdraw(indices.data(), indices.size(), positions.data(), positions.size());
+
+        // each level halves the last one until it stops shrinking or deviates by more than a tenth of the mesh size
+        const float maxError = 0.1f * glm::length(bounds.max - bounds.min);
+        std::vector<uint32_t> lodIndices(indices.size());
+        while (lods.size() < maxLods && lods.back().indexCount / 3 >= minLodTriangles) {
+            const PrimitiveLod& previous = lods.back();
+            float error = 0.f;
+            const size_t lodIndexCount = mesh_optimizer::simplify(lodIndices.data(), &indices[previous.firstIndex], previous.indexCount,
+                    positions.data(), positions.size(), previous.indexCount / 2, maxError, &error);
+            if (lodIndexCount == 0 || lodIndexCount > previous.indexCount * 3 / 4) {
+                break;
+            }
 
-            glm::vec3 pos = vertices[face.mIndices[j]].position;
+            mesh_optimizer::optimizeVertexCache(lodIndices.data(), lodIndexCount, vertices.size());
+            lods.push_back({
+                .firstIndex = static_cast<uint32_t>(indices.size()),
+                .indexCount = static_cast<uint32_t>(lodIndexCount),
+                .error = std::max(error, previous.error)
+            });
+            indices.insert(indices.end(), lodIndices.begin(), lodIndices.begin() + lodIndexCount);
         }
 
-        std::shared_ptr<Triangle> triangle = std::make_shared<Triangle>();
-        triangle->firstIndex = firstIndex;
-        triangle->indexCount = indexCount;
-        triangle->material = mesh->mMaterialIndex > -1 ? materials[mesh->mMaterialIndex].get() : materials.back().get();
-        //triangle->bounds = aabb;
-        newMesh->primitives.push_back(triangle);
+        // full detail decides the vertex order, coarser levels only use a subset of its vertices
+        mesh_optimizer::optimizeVertexFetch(vertices, indices.data(), indices.size());
+
+        // meshlets follow the final triangle order, so they need the positions after the fetch reorder
+        positions.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            positions[i] = vertices[i].position;
+        }
+        mesh_optimizer::buildMeshlets(meshlets, indices.data(), lods[0].indexCount, positions.data(), positions.size());
     }
 
-    return newMesh;
+    if (meshCache) {
+        meshCache->store(meshIndex, {
+            .sourceVertexCount = mesh->mNumVertices,
+            .sourceFaceCount = mesh->mNumFaces,
+            .vertices = vertices,
+            .indices = indices,
+            .lods = lods,
+            .meshlets = meshlets
+        });
+    }
+}
+
+vkw::BufferHandle Model::uploadBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    // unified memory takes the data right away, otherwise it's copied over from a staging buffer
+    vkw::BufferHandle buffer = rd->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VMA_MEMORY_USAGE_GPU_ONLY, size, data);
+    if (rd->getBuffer(buffer)->isMapped()) {
+        return buffer;
+    }
+
+    vkw::Buffer stagingBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, data);
+    VkCommandBuffer commandBuffer = rd->getCommandBufferOneTime(0 /*TODO: change to current command pool index */);
+
+    VkBufferCopy copyRegion{
+        .size = size
+    };
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer.getBuffer(), rd->getBuffer(buffer)->getBuffer(), 1, &copyRegion);
+
+    rd->commandBufferSubmitIdle(&commandBuffer, VK_QUEUE_GRAPHICS_BIT);
+
+    return buffer;
+}
+
+void Model::uploadVertices(const std::vector<Vertex>& vertices) {
+    std::vector<glm::vec3> positions(vertices.size());
+    std::vector<VertexAttributes> attributes(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        positions[i] = vertices[i].position;
+        attributes[i] = { vertices[i].normal, vertices[i].uv, vertices[i].tangent };
+    }
+
+    positionBuffer = uploadBuffer(positions.data(), positions.size() * sizeof(glm::vec3), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    attributeBuffer = uploadBuffer(attributes.data(), attributes.size() * sizeof(VertexAttributes), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+}
+
+void Model::uploadPackedVertices(const std::vector<Vertex>& vertices) {
+    std::vector<uint64_t> positions(vertices.size());
+    std::vector<PackedVertexAttributes> attributes(vertices.size());
+
+    // positions are quantised against the bounds of the mesh they belong to
+    for (Node* node : linearNodes) {
+        if (!node->mesh) {
+            continue;
+        }
+
+        const MeshPushConstants& constants = node->mesh->pushConstants;
+        const glm::vec3 offset(constants.positionOffset);
+        const glm::vec3 scale(constants.positionScale);
+
+        for (const auto& primitive : node->mesh->primitives) {
+            for (uint32_t i = 0; i < primitive->vertexCount; i++) {
+                const uint32_t index = primitive->vertexOffset + i;
+                const Vertex& vertex = vertices[index];
+
+                const glm::vec3 position = glm::clamp((vertex.position - offset) / scale, glm::vec3(0.f), glm::vec3(1.f));
+                positions[index] = glm::packUnorm4x16(glm::vec4(position, vertex.bitangentSign < 0.f ? 0.f : 1.f));
+                attributes[index] = {
+                    .normal = glm::packSnorm2x16(octahedralEncode(vertex.normal)),
+                    .uv = glm::packHalf2x16(vertex.uv),
+                    .tangent = glm::packSnorm2x16(octahedralEncode(vertex.tangent))
+                };
+            }
+        }
+    }
+
+    positionBuffer = uploadBuffer(positions.data(), positions.size() * sizeof(uint64_t), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    attributeBuffer = uploadBuffer(attributes.data(), attributes.size() * sizeof(PackedVertexAttributes), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
 }
 
 //void Model::updateModelBounds() {
@@ -362,32 +599,260 @@ std::unique_ptr<Mesh> Model::processMesh(aiMesh* mesh, const aiScene* scene, glm
 //    }
 //}
 
-void Model::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset) {
-    const VkDeviceSize offsets[1] = { 0 };
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer->getBuffer(), offsets);
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+void Model::bindBuffers(VkCommandBuffer commandBuffer, uint32_t renderFlags) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+
+    const VkBuffer vertexBuffers[2] = { rd->getBuffer(positionBuffer)->getBuffer(), rd->getBuffer(attributeBuffer)->getBuffer() };
+    const VkDeviceSize offsets[2] = { 0, 0 };
+    const uint32_t bindingCount = (renderFlags & RenderFlag::PositionOnly) ? 1 : 2;
+    vkCmdBindVertexBuffers(commandBuffer, Vertex::positionBinding, bindingCount, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, rd->getBuffer(indexBuffer)->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+}
+
+void Model::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset, const uint8_t* visibility) {
+    bindBuffers(commandBuffer, renderFlags);
+
+    for (auto& node : nodes) {
+        drawNode(node, commandBuffer, pipelineLayout, renderFlags, bindImageset, VK_NULL_HANDLE, visibility);
+    }
+}
+
+void Model::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset) {
+    bindBuffers(commandBuffer, renderFlags);
 
     for (auto& node : nodes) {
-        drawNode(node, commandBuffer, pipelineLayout, renderFlags, bindImageset);
+        drawNode(node, commandBuffer, pipelineLayout, renderFlags, bindImageset, indirectBuffer);
+    }
+}
+
+void Model::selectLods(const glm::vec3& cameraPosition, float pixelsPerUnit, float pixelThreshold) {
+    for (const auto node : linearNodes) {
+        if (!node->mesh) {
+            continue;
+        }
+
+        // errors are in mesh space, the largest axis scale bounds how much the node can grow them
+        const glm::mat4& model = node->mesh->pushConstants.model;
+        const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+
+        for (const auto& primitive : node->mesh->primitives) {
+            const AABB bounds = primitive->bounds.transform(model);
+            const float distance = glm::length(glm::clamp(cameraPosition, bounds.min, bounds.max) - cameraPosition);
+
+            // the nearest point of the bounds gives the largest projection any part of the primitive can have
+            primitive->lod = 0;
+            for (uint32_t i = static_cast<uint32_t>(primitive->lods.size()) - 1; i > 0; i--) {
+                if (primitive->lods[i].error * scale * pixelsPerUnit <= pixelThreshold * distance) {
+                    primitive->lod = i;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void Model::updateTextureStreaming(const glm::vec3& cameraPosition, float pixelsPerUnit, const glm::mat4& viewProjection, VkDeviceSize budget) {
+    if (!textureStreamer) {
+        return;
+    }
+
+    // planes point inwards, same extraction as the culling shader's
+    const glm::vec4 row0 = glm::row(viewProjection, 0);
+    const glm::vec4 row1 = glm::row(viewProjection, 1);
+    const glm::vec4 row2 = glm::row(viewProjection, 2);
+    const glm::vec4 row3 = glm::row(viewProjection, 3);
+    const std::array<glm::vec4, 6> frustumPlanes{ row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2 };
+
+    for (const auto node : linearNodes) {
+        if (!node->mesh) {
+            continue;
+        }
+
+        const glm::mat4& model = node->mesh->pushConstants.model;
+        const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+
+        for (const auto& primitive : node->mesh->primitives) {
+            if (!primitive->material || primitive->uvDensity <= 0.f) {
+                continue;
+            }
+
+            const AABB bounds = primitive->bounds.transform(model);
+            const bool outside = std::any_of(frustumPlanes.begin(), frustumPlanes.end(), [&bounds](const glm::vec4& plane) {
+                const glm::vec3 farthest = glm::mix(bounds.min, bounds.max, glm::greaterThan(glm::vec3(plane), glm::vec3(0.f)));
+                return glm::dot(glm::vec3(plane), farthest) + plane.w < 0.f;
+            });
+            if (outside) {
+                continue;
+            }
+
+            // one texel per pixel at the nearest point of the bounds, a camera inside them wants full detail
+            const float distance = glm::length(glm::clamp(cameraPosition, bounds.min, bounds.max) - cameraPosition);
+            const float texels = distance > 0.f ? pixelsPerUnit * scale / (distance * primitive->uvDensity) : FLT_MAX;
+            for (const Texture& texture : primitive->material->textures) {
+                if (texture.stream >= 0) {
+                    textureStreamer->request(texture.stream, texels);
+                }
+            }
+        }
+    }
+
+    std::vector<int32_t> replaced;
+    textureStreamer->update(budget, replaced);
+
+    // materials rewrite each frame slot's descriptor set once the frames still reading the old texture have retired
+    for (int32_t stream : replaced) {
+        const vkw::TextureHandle texture = textureStreamer->getTexture(stream);
+        for (Texture& modelTexture : textures) {
+            if (modelTexture.stream == stream) {
+                modelTexture.texture = texture;
+            }
+        }
+        for (auto& material : materials) {
+            for (Texture& materialTexture : material->textures) {
+                if (materialTexture.stream == stream) {
+                    materialTexture.texture = texture;
+                    material->markDirty();
+                }
+            }
+        }
+    }
+}
+
+void Model::recordTextureUploads(VkCommandBuffer commandBuffer, uint64_t frame) {
+    if (textureStreamer) {
+        textureStreamer->recordUploads(commandBuffer, frame);
+    }
+}
+
+void Model::getDrawData(std::vector<GpuDrawData>& drawData) const {
+    for (const auto node : linearNodes) {
+        if (!node->mesh) {
+            continue;
+        }
+
+        for (const auto& primitive : node->mesh->primitives) {
+            const AABB bounds = primitive->bounds.transform(node->mesh->pushConstants.model);
+            drawData[primitive->drawIndex] = {
+                .boundsMin = glm::vec4(bounds.min, 1.f),
+                .boundsMax = glm::vec4(bounds.max, 1.f),
+                .coneApex = glm::vec4(0.f),
+                .coneAxis = glm::vec4(0.f, 0.f, 1.f, 1.f),
+                .indexCount = primitive->lods[primitive->lod].indexCount,
+                .firstIndex = primitive->lods[primitive->lod].firstIndex,
+                .vertexOffset = primitive->vertexOffset
+            };
+        }
     }
 }
 
-void Model::drawNode(std::shared_ptr<Node> node, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset) {
+void Model::getClusterData(std::vector<GpuDrawData>& clusterData) const {
+    for (const auto node : linearNodes) {
+        if (!node->mesh) {
+            continue;
+        }
+
+        // cones stay valid under rotation, translation and uniform scale, anything else disables them
+        const glm::mat4& model = node->mesh->pushConstants.model;
+        const glm::vec3 axisScale(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])));
+        const float scale = std::max({ axisScale.x, axisScale.y, axisScale.z });
+        const bool uniformScale = std::min({ axisScale.x, axisScale.y, axisScale.z }) > 0.99f * scale && glm::determinant(glm::mat3(model)) > 0.f;
+
+        for (const auto& primitive : node->mesh->primitives) {
+            const PrimitiveLod& lod = primitive->lods[primitive->lod];
+            if (primitive->lod > 0 || primitive->meshlets.empty()) {
+                const AABB bounds = primitive->bounds.transform(model);
+                clusterData[primitive->firstCluster] = {
+                    .boundsMin = glm::vec4(bounds.min, 1.f),
+                    .boundsMax = glm::vec4(bounds.max, 1.f),
+                    .coneApex = glm::vec4(0.f),
+                    .coneAxis = glm::vec4(0.f, 0.f, 1.f, 1.f),
+                    .indexCount = lod.indexCount,
+                    .firstIndex = lod.firstIndex,
+                    .vertexOffset = primitive->vertexOffset
+                };
+                for (uint32_t i = 1; i < primitive->clusterCount; i++) {
+                    clusterData[primitive->firstCluster + i] = clusterData[primitive->firstCluster];
+                    clusterData[primitive->firstCluster + i].indexCount = 0;
+                }
+                continue;
+            }
+
+            for (uint32_t i = 0; i < primitive->clusterCount; i++) {
+                const mesh_optimizer::Meshlet& meshlet = primitive->meshlets[i];
+                const glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.center, 1.f));
+                const float radius = meshlet.radius * scale;
+                const bool cone = uniformScale && meshlet.coneCutoff < 1.f;
+                clusterData[primitive->firstCluster + i] = {
+                    .boundsMin = glm::vec4(center - radius, 1.f),
+                    .boundsMax = glm::vec4(center + radius, 1.f),
+                    .coneApex = model * glm::vec4(meshlet.coneApex, 1.f),
+                    .coneAxis = cone ? glm::vec4(glm::normalize(glm::mat3(model) * meshlet.coneAxis), meshlet.coneCutoff) : glm::vec4(0.f, 0.f, 1.f, 1.f),
+                    .indexCount = meshlet.indexCount,
+                    .firstIndex = meshlet.firstIndex,
+                    .vertexOffset = primitive->vertexOffset
+                };
+            }
+        }
+    }
+}
+
+void Model::getOccluders(std::vector<Occluder>& occluders) const {
+    for (const auto node : linearNodes) {
+        if (!node->mesh) {
+            continue;
+        }
+
+        for (const auto& primitive : node->mesh->primitives) {
+            if (primitive->occluderIndexCount == 0) {
+                continue;
+            }
+
+            occluders.push_back({
+                .vertices = occluderVertices.data(),
+                .indices = occluderIndices.data() + primitive->occluderFirstIndex,
+                .indexCount = primitive->occluderIndexCount,
+                .model = node->mesh->pushConstants.model,
+                .bounds = primitive->bounds.transform(node->mesh->pushConstants.model)
+            });
+        }
+    }
+}
+
+void Model::drawNode(std::shared_ptr<Node> node, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset,
+        VkBuffer indirectBuffer, const uint8_t* visibility) {
     if (node->mesh) {
-        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &node->mesh->pushConstants);
+        // layouts declare the push constant range for all stages, so the update has to match
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, 0, sizeof(MeshPushConstants), &node->mesh->pushConstants);
         for (auto primitive : node->mesh->primitives) {
+            if (visibility && !visibility[primitive->drawIndex]) {
+                continue;
+            }
+
             if (renderFlags & RenderFlag::BindImages) {
+                const VkDescriptorSet descriptorSet = primitive->material->getDescriptorSet(RenderSystem::getSingleton()->getFrameIndex());
                 vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageset,
-                    static_cast<uint32_t>(primitive->material->descriptorSet.getDescriptorSets().size()), 
-                    primitive->material->descriptorSet.getDescriptorSets().data(), 0, nullptr);
+                    1, &descriptorSet, 0, nullptr);
             }
 
-            vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+            if (indirectBuffer != VK_NULL_HANDLE) {
+                // one call for all of a primitive's clusters where multi draw indirect is supported
+                constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+                if (multiDrawIndirect) {
+                    vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, primitive->firstCluster * stride, primitive->clusterCount, stride);
+                } else {
+                    for (uint32_t i = 0; i < primitive->clusterCount; i++) {
+                        vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, (primitive->firstCluster + i) * stride, 1, stride);
+                    }
+                }
+            } else {
+                const PrimitiveLod& lod = primitive->lods[primitive->lod];
+                vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, lod.firstIndex, primitive->vertexOffset, 0);
+            }
         }
     }
 
     for (auto& child : node->children) {
-        drawNode(child, commandBuffer, pipelineLayout, renderFlags, bindImageset);
+        drawNode(child, commandBuffer, pipelineLayout, renderFlags, bindImageset, indirectBuffer, visibility);
     }
 }
 
@@ -395,6 +860,16 @@ Model::~Model() {
     for (auto& material : materials) {
         material.reset();
     }
+
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    for (auto& texture : textures) {
+        rd->destroyTexture(texture.texture);
+    }
+    textures.clear();
+
+    rd->destroyBuffer(positionBuffer);
+    rd->destroyBuffer(attributeBuffer);
+    rd->destroyBuffer(indexBuffer);
 }
 
 } //namespace sublimation
\ No newline at end of file
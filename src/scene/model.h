@@ -1,27 +1,91 @@
 #pragma once
 
 #include <graphics/vulkan/buffer.h>
+#include <graphics/vulkan/pipeline.h>
 
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <scene/material.h>
+#include <scene/mesh_optimizer.h>
+#include <scene/texture_baker.h>
+#include <scene/texture_streamer.h>
+
+#include <cfloat>
+#include <cstddef>
 
 namespace sublimation {
 
-struct Triangle {
+class MeshCache;
+
+struct AABB {
+    glm::vec3 min{ FLT_MAX };
+    glm::vec3 max{ -FLT_MAX };
+
+    void expand(const glm::vec3& point);
+    // axis aligned bounds of the transformed box
+    AABB transform(const glm::mat4& matrix) const;
+};
+
+// index range of one detail level, all levels of a primitive share its vertices
+struct PrimitiveLod {
     uint32_t firstIndex;
-    uint32_t indexCount; // should be 3
+    uint32_t indexCount;
+    float error; ///< largest mesh space distance to the full detail surface
+};
+
+struct Primitive {
+    uint32_t firstIndex; ///< full detail, same as lods[0]
+    uint32_t indexCount;
+    int32_t vertexOffset; ///< indices are relative to the first vertex of the mesh
+    uint32_t vertexCount;
+    uint32_t drawIndex; ///< slot in the model's indirect draw buffers
     Material* material;
 
-    ///< AABB bounds;
+    // triangles kept on the CPU for software occlusion, 0 if the mesh is too detailed to be an occluder
+    uint32_t occluderFirstIndex = 0;
+    uint32_t occluderIndexCount = 0;
+
+    AABB bounds; ///< mesh space
+    float uvDensity = 0.f; ///< texture coordinate units per mesh space unit over the surface, 0 without texture coordinates
+
+    std::vector<PrimitiveLod> lods; ///< finest first
+    uint32_t lod = 0; ///< level drawn this frame, see Model::selectLods
+
+    // full detail split into index sub-ranges that are culled on their own, coarser levels are drawn whole
+    std::vector<mesh_optimizer::Meshlet> meshlets; ///< firstIndex is absolute, bounds are mesh space
+    uint32_t firstCluster; ///< slots in the model's cluster draw buffers, one per meshlet and at least one
+    uint32_t clusterCount;
+};
+
+// world space bounds and draw arguments of a primitive or a cluster, read by the culling shader
+struct GpuDrawData {
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    glm::vec4 coneApex; ///< w unused
+    glm::vec4 coneAxis; ///< w is the cutoff, 1 turns the backface cone test off
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t pad0;
+};
+
+// CPU copy of a primitive's triangles, drawn by the software occlusion rasteriser
+struct Occluder {
+    const glm::vec3* vertices;
+    const uint32_t* indices;
+    uint32_t indexCount;
+    glm::mat4 model;
+    AABB bounds; ///< world space
 };
 
 struct MeshPushConstants {
     glm::mat4 model;
+    glm::vec4 positionOffset{ 0.f }; ///< dequantises packed positions, identity for float vertices
+    glm::vec4 positionScale{ 1.f };
 };
 
 struct Mesh {
-    std::vector<std::shared_ptr<Triangle>> primitives;
+    std::vector<std::shared_ptr<Primitive>> primitives;
     std::string name;
 
     MeshPushConstants pushConstants;
@@ -49,21 +113,51 @@ struct Node {
     ~Node();
 };
 
+// the attributes besides the position, uploaded as their own stream
+struct VertexAttributes {
+    glm::vec3 normal;
+    glm::vec2 uv;
+    glm::vec3 tangent;
+};
+
+// packed attribute stream, the matching position stream holds unorm16 positions relative to the mesh bounds
+// with the bitangent sign in w, dequantised in the vertex shader through MeshPushConstants
+struct PackedVertexAttributes {
+    uint32_t normal; ///< octahedral, snorm16x2
+    uint32_t uv; ///< half float x2
+    uint32_t tangent; ///< octahedral, snorm16x2
+};
+
+// the upload structs have to match the layouts pipelines are built with
+static_assert(sizeof(glm::vec3) == vkw::vertex_layouts::FloatPositions::stride);
+static_assert(sizeof(VertexAttributes) == vkw::vertex_layouts::FloatAttributes::stride);
+static_assert(offsetof(VertexAttributes, uv) == vkw::vertex_layouts::FloatAttributes::offsets[1]);
+static_assert(offsetof(VertexAttributes, tangent) == vkw::vertex_layouts::FloatAttributes::offsets[2]);
+static_assert(sizeof(uint64_t) == vkw::vertex_layouts::PackedPositions::stride);
+static_assert(sizeof(PackedVertexAttributes) == vkw::vertex_layouts::PackedAttributes::stride);
+static_assert(offsetof(PackedVertexAttributes, uv) == vkw::vertex_layouts::PackedAttributes::offsets[1]);
+static_assert(offsetof(PackedVertexAttributes, tangent) == vkw::vertex_layouts::PackedAttributes::offsets[2]);
+
+// loaded interleaved, but stored on the GPU as a tightly packed position stream (binding 0)
+// and a VertexAttributes stream (binding 1) so depth only passes fetch 12 bytes per vertex
 struct Vertex {
     glm::vec3 position;
     glm::vec3 normal;
     glm::vec2 uv;
     glm::vec3 tangent;
+    float bitangentSign = 1.f;
 
-    static VkVertexInputBindingDescription getBindingDescription(uint32_t binding);
-    static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions(uint32_t binding);
+    // the input layouts of the streams are described in graphics/vulkan/vertex_format.h
+    static constexpr uint32_t positionBinding = 0;
+    static constexpr uint32_t attributeBinding = 1;
 };
 
 enum RenderFlag {
     None = 0x00000000,
     BindImages = 0x00000001,
     Opaque = 0x00000002,
-    AlphaMask = 0x00000004
+    AlphaMask = 0x00000004,
+    PositionOnly = 0x00000008 ///< binds only the position stream
 };
 
 class Model {
@@ -77,26 +171,78 @@ public:
     std::vector<Texture> textures;
     std::vector<std::unique_ptr<Material>> materials;
 
-    vkw::Buffer* vertexBuffer;
-    vkw::Buffer* indexBuffer;
+    vkw::BufferHandle positionBuffer;
+    vkw::BufferHandle attributeBuffer;
+    vkw::BufferHandle indexBuffer;
 
     std::string path;
-
-    void loadFromFile(const std::string& filepath, uint32_t postProcessFlags = 0);
-    void loadFromAiScene(const aiScene* scene, const std::string& filepath);
-
-    void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1);
+    uint32_t primitiveCount = 0;
+    uint32_t clusterCount = 0;
+    vkw::VertexFormat vertexFormat = vkw::VertexFormat::Float;
+
+    // meshes above this many triangles get simplified levels of detail at import, each about half the last
+    static constexpr uint32_t minLodTriangles = 512;
+    static constexpr uint32_t maxLods = 5;
+
+    // meshes up to this many triangles keep their geometry on the CPU as occluder candidates
+    static constexpr uint32_t maxOccluderTriangles = 2048;
+    std::vector<glm::vec3> occluderVertices;
+    std::vector<uint32_t> occluderIndices;
+
+    void loadFromFile(const std::string& filepath, uint32_t postProcessFlags = 0, vkw::VertexFormat format = vkw::VertexFormat::Float);
+    // postProcessFlags are the ones the scene was imported with, they key the baked mesh data
+    void loadFromAiScene(const aiScene* scene, const std::string& filepath, vkw::VertexFormat format = vkw::VertexFormat::Float, uint32_t postProcessFlags = 0);
+
+    // primitives with a zero visibility entry at their drawIndex are skipped
+    void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1,
+            const uint8_t* visibility = nullptr);
+    // every primitive takes its draw arguments from indirectBuffer at its clusterCount slots from firstCluster,
+    // culled ones have no instances
+    void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1);
+
+    // picks the coarsest level whose error projects to at most pixelThreshold pixels, pixelsPerUnit is the
+    // projected size of one unit at distance one in pixels
+    void selectLods(const glm::vec3& cameraPosition, float pixelsPerUnit, float pixelThreshold);
+    // requests the mip levels the materials of primitives in the view frustum are drawn at, then lets the streamer
+    // move resident levels towards them within budget bytes, swapping replaced textures into the materials
+    void updateTextureStreaming(const glm::vec3& cameraPosition, float pixelsPerUnit, const glm::mat4& viewProjection, VkDeviceSize budget);
+    // records the streamer's pending copies into the frame's commandBuffer, frame is its frame timeline value
+    void recordTextureUploads(VkCommandBuffer commandBuffer, uint64_t frame);
+
+    // fills drawData[drawIndex] for every primitive, sized to primitiveCount by the caller
+    void getDrawData(std::vector<GpuDrawData>& drawData) const;
+    // fills clusterData[firstCluster...] for every primitive, sized to clusterCount by the caller
+    // slots past the first are empty while a primitive draws a coarser level
+    void getClusterData(std::vector<GpuDrawData>& clusterData) const;
+    void getOccluders(std::vector<Occluder>& occluders) const;
 
 private:
     void loadMaterials(const aiScene* scene);
-    Texture loadTexture(const aiMaterial* mat, aiTextureType type);
+    // channel is the one the shader reads from a scalar slot, only it is kept
+    Texture loadTexture(const aiMaterial* mat, aiTextureType type, texture_baker::TextureUsage usage, uint32_t channel = 0);
+    // filepath is relative to the model's directory, files already loaded in the same format are shared
+    Texture loadTextureFile(const std::string& filepath, texture_baker::TextureUsage usage, uint32_t channel = 0);
     void processNode(aiNode* node, const aiScene* scene, std::shared_ptr<Node> parent, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
     std::unique_ptr<Mesh> processMesh(aiMesh* mesh, const aiScene* scene, glm::mat4& transform, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    // optimised vertices, indices and detail levels of one mesh, from the mesh cache when it has them
+    void loadMeshData(aiMesh* mesh, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<PrimitiveLod>& lods,
+            std::vector<mesh_optimizer::Meshlet>& meshlets);
+    // copies data into a new GPU only buffer, written in place when the device maps it (unified memory), otherwise through a staging buffer
+    vkw::BufferHandle uploadBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage);
+    void uploadVertices(const std::vector<Vertex>& vertices);
+    void uploadPackedVertices(const std::vector<Vertex>& vertices);
+    void bindBuffers(VkCommandBuffer commandBuffer, uint32_t renderFlags);
 
     //void updateModelBounds();
     //void updateNodeBounds(Node* node, glm::vec3& pmin, glm::vec3& pmax);
 
-    void drawNode(std::shared_ptr<Node> node, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1);
+    MeshCache* meshCache = nullptr; ///< only set while loading
+    std::unique_ptr<TextureStreamer> textureStreamer; ///< created with the first container texture
+    uint32_t processedMeshCount = 0;
+    bool multiDrawIndirect = false; ///< a primitive's clusters take one indirect call instead of one each
+
+    void drawNode(std::shared_ptr<Node> node, VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1,
+            VkBuffer indirectBuffer = VK_NULL_HANDLE, const uint8_t* visibility = nullptr);
 };
 
 } //namespace sublimation
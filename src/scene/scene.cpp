@@ -3,11 +3,12 @@
 #include <scene/scene.h>
 
 #include <assimp/Importer.hpp>
+#include <cmath>
 #include <iostream>
 
 namespace sublimation {
 
-void Scene::loadModel(const std::string& filepath, uint32_t postProcessFlags) {
+void Scene::loadModel(const std::string& filepath, uint32_t postProcessFlags, vkw::VertexFormat format) {
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(filepath, postProcessFlags);
 
@@ -17,7 +18,7 @@ void Scene::loadModel(const std::string& filepath, uint32_t postProcessFlags) {
     }
 
     Model* newmodel = new Model();
-    newmodel->loadFromAiScene(scene, filepath);
+    newmodel->loadFromAiScene(scene, filepath, format, postProcessFlags);
     model = std::unique_ptr<Model>(newmodel);
 }
 
@@ -31,26 +32,20 @@ void Scene::addPointLight(glm::vec3 position, glm::vec3 color, float radius, flo
     pointLights.emplace_back(position, color, radius, intensity);
 }
 
-void Scene::updateSceneDescriptors(const VkDescriptorSetLayout& layout) {
+void Scene::updateSceneDescriptors(const VkDescriptorSetLayout& layout, uint32_t frameIndex) {
+    if (!model) {
+        return;
+    }
+
     for (auto& material : model->materials) {
-        if (material->textures[0].isActive()) {
-            material->updateDescriptorSets(layout);
-        }
+        material->updateDescriptorSet(layout, frameIndex);
     }
 }
 
 void Scene::updateSceneBufferData() {
     //directionalLight.preprocess(bounds.center(), bounds.radius());
 
-    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
-    if (sceneDataBuffer == nullptr) {
-        sceneDataBuffer = (vkw::UniformBuffer*)rd->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, sizeof(GpuSceneData));
-    }
-
-    if (pointLightsBuffer == nullptr) {
-        pointLightsBuffer = (vkw::StorageBuffer*)rd->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, sizeof(PointLight) * pointLights.size());
-    }
-
+    // the render system copies sceneData into the buffer of the frame slot being recorded
     sceneData.projection = camera.getProjectionTransform();
     sceneData.view = camera.getViewTransform();
     sceneData.cameraPosition.x = camera.position.x;
@@ -62,16 +57,61 @@ void Scene::updateSceneBufferData() {
     sceneData.lightDirection = glm::vec4(directionalLight.getDirection(), 0.0);
     sceneData.lightColor = glm::vec4(directionalLight.getColor(), 1.0);
     sceneData.lightIntensity = directionalLight.getIntensity();
+}
+
+void Scene::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset, const uint8_t* visibility) {
+    if (model) {
+        model->draw(commandBuffer, pipelineLayout, renderFlags, bindImageset, visibility);
+    }
+}
+
+void Scene::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset) {
+    if (model) {
+        model->drawIndirect(commandBuffer, indirectBuffer, pipelineLayout, renderFlags, bindImageset);
+    }
+}
 
-    sceneDataBuffer->update(&sceneData);
-    pointLightsBuffer->update(pointLights.data());
+void Scene::selectLods(float viewportHeight, float pixelThreshold) {
+    if (model) {
+        // projection[1][1] is the cotangent of half the vertical field of view
+        const float pixelsPerUnit = 0.5f * viewportHeight * std::abs(sceneData.projection[1][1]);
+        model->selectLods(glm::vec3(sceneData.cameraPosition), pixelsPerUnit, pixelThreshold);
+    }
+}
+
+void Scene::updateTextureStreaming(float viewportHeight, VkDeviceSize budget) {
+    if (model) {
+        const float pixelsPerUnit = 0.5f * viewportHeight * std::abs(sceneData.projection[1][1]);
+        model->updateTextureStreaming(glm::vec3(sceneData.cameraPosition), pixelsPerUnit, sceneData.projection * sceneData.view, budget);
+    }
+}
+
+void Scene::recordTextureUploads(VkCommandBuffer commandBuffer, uint64_t frame) {
+    if (model) {
+        model->recordTextureUploads(commandBuffer, frame);
+    }
 }
 
-void Scene::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t renderFlags, uint32_t bindImageset) {
-    model->draw(commandBuffer, pipelineLayout, renderFlags, bindImageset);
+void Scene::getDrawData(std::vector<GpuDrawData>& drawData) const {
+    if (model) {
+        model->getDrawData(drawData);
+    }
+}
+
+void Scene::getClusterData(std::vector<GpuDrawData>& clusterData) const {
+    if (model) {
+        model->getClusterData(clusterData);
+    }
+}
+
+void Scene::getOccluders(std::vector<Occluder>& occluders) const {
+    if (model) {
+        model->getOccluders(occluders);
+    }
 }
 
 void Scene::unload() {
+    // model releases its own buffers and textures
     model.reset();
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <graphics/vulkan/buffer.h>
+#include <graphics/vulkan/resource_pool.h>
 
 #include <scene/camera.h>
 #include <scene/light.h>
@@ -37,16 +38,31 @@ class Scene {
 public:
     Scene() = default;
 
-    void loadModel(const std::string& filepath, uint32_t postProcessFlags = 0);
+    void loadModel(const std::string& filepath, uint32_t postProcessFlags = 0, vkw::VertexFormat format = vkw::VertexFormat::Float);
 
     void createDirectionalLight(glm::vec3 direction, glm::vec3 color, float intensity);
     void addPointLight(glm::vec3 position, glm::vec3 color, float radius, float intensity);
-    void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1);
-
-    void updateSceneDescriptors(const VkDescriptorSetLayout& layout);
+    void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1,
+            const uint8_t* visibility = nullptr);
+    void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t renderFlags = 0, uint32_t bindImageset = 1);
+
+    uint32_t getPrimitiveCount() const { return model ? model->primitiveCount : 0; }
+    vkw::VertexFormat getVertexFormat() const { return model ? model->vertexFormat : vkw::VertexFormat::Float; }
+    void getDrawData(std::vector<GpuDrawData>& drawData) const;
+    uint32_t getClusterCount() const { return model ? model->clusterCount : 0; }
+    void getClusterData(std::vector<GpuDrawData>& clusterData) const;
+    // picks every primitive's level of detail for the camera in sceneData, call after updateSceneBufferData
+    void selectLods(float viewportHeight, float pixelThreshold);
+    // streams texture mips for the camera in sceneData within budget bytes, call after updateSceneBufferData
+    void updateTextureStreaming(float viewportHeight, VkDeviceSize budget);
+    // copies streamed levels within the frame's commands, the textures are swapped in once frame has retired
+    void recordTextureUploads(VkCommandBuffer commandBuffer, uint64_t frame);
+    void getOccluders(std::vector<Occluder>& occluders) const;
+
+    // writes the material sets of frameIndex that are out of date, call once the slot's previous frame has retired
+    void updateSceneDescriptors(const VkDescriptorSetLayout& layout, uint32_t frameIndex);
     void updateSceneBufferData();
-    vkw::Buffer* getSceneDataBuffer() const { return sceneDataBuffer; }
-    vkw::Buffer* getPointLightsBuffer() const { return pointLightsBuffer; }
+    const GpuSceneData& getSceneData() const { return sceneData; }
     uint32_t getNumLights() const { return pointLights.size(); }
 
     Camera* getCamera() { return &camera; }
@@ -60,9 +76,6 @@ private:
     GpuSceneData sceneData;
     DirectionalLight directionalLight{ glm::vec3{ 0, -1, 0 }, glm::vec3{ 1.f }, 0.f };
     std::vector<PointLight> pointLights;
-
-    vkw::UniformBuffer* sceneDataBuffer = nullptr;
-    vkw::StorageBuffer* pointLightsBuffer = nullptr;
 };
 
 } //namespace sublimation
@@ -0,0 +1,342 @@
+#include <scene/texture_baker.h>
+
+#include <graphics/block_compression.h>
+#include <graphics/vulkan/texture_file.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace sublimation {
+
+namespace texture_baker {
+
+namespace {
+
+// 2x2 box filter, odd edges repeat their last texel
+void downsample(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst, bool normalMap) {
+    const uint32_t dstWidth = std::max(width / 2, 1u);
+    const uint32_t dstHeight = std::max(height / 2, 1u);
+
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        const uint32_t y0 = std::min(y * 2, height - 1);
+        const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            const uint32_t x0 = std::min(x * 2, width - 1);
+            const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+            float sum[4];
+            for (uint32_t c = 0; c < 4; c++) {
+                sum[c] = (src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] +
+                        src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c]) / 4.f;
+            }
+
+            // averaged normals shorten, put them back on the unit sphere
+            if (normalMap) {
+                float normal[3];
+                for (uint32_t c = 0; c < 3; c++) {
+                    normal[c] = sum[c] / 127.5f - 1.f;
+                }
+                const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                for (uint32_t c = 0; c < 3 && length > 0.f; c++) {
+                    sum[c] = (normal[c] / length + 1.f) * 127.5f;
+                }
+            }
+
+            for (uint32_t c = 0; c < 4; c++) {
+                dst[(y * dstWidth + x) * 4 + c] = static_cast<uint8_t>(std::clamp(sum[c] + 0.5f, 0.f, 255.f));
+            }
+        }
+    }
+}
+
+// encodes level and the box filtered mips below it into a KTX2 file, without a block format the RGBA8 texels are stored as they are
+bool saveMipChain(std::vector<uint8_t> level, uint32_t width, uint32_t height, std::optional<block_compression::BlockFormat> blockFormat, VkFormat format,
+        bool normalMap, const std::string& path) {
+    vkw::TextureFile file;
+    file.format = format;
+    file.extent = { width, height, 1 };
+    const uint32_t levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+    for (uint32_t i = 0; i < levelCount; i++) {
+        const size_t size = blockFormat ? block_compression::getCompressedSize(*blockFormat, levelWidth, levelHeight) : level.size();
+        file.levels.push_back({ .offset = file.data.size(), .size = size });
+        file.data.resize(file.data.size() + size);
+        if (blockFormat) {
+            block_compression::encode(*blockFormat, level.data(), levelWidth, levelHeight, file.data.data() + file.levels.back().offset);
+        } else {
+            std::copy(level.begin(), level.end(), file.data.begin() + file.levels.back().offset);
+        }
+
+        if (i + 1 < levelCount) {
+            std::vector<uint8_t> next(static_cast<size_t>(std::max(levelWidth / 2, 1u)) * std::max(levelHeight / 2, 1u) * 4);
+            downsample(level.data(), levelWidth, levelHeight, next.data(), normalMap);
+            level = std::move(next);
+            levelWidth = std::max(levelWidth / 2, 1u);
+            levelHeight = std::max(levelHeight / 2, 1u);
+        }
+    }
+
+    return file.saveKtx2(path);
+}
+
+} //namespace
+
+std::string getBakedPath(const std::string& sourcePath, TextureUsage usage, uint32_t channel) {
+    if (usage == TextureUsage::Scalar) {
+        return std::filesystem::path(sourcePath).replace_extension(std::string(".") + "rgba"[std::min(channel, 3u)] + ".ktx2").string();
+    }
+
+    return std::filesystem::path(sourcePath).replace_extension(".ktx2").string();
+}
+
+std::string resolve(const std::string& sourcePath, TextureUsage usage, uint32_t channel) {
+    const std::string bakedPath = getBakedPath(sourcePath, usage, channel);
+    if (bakedPath == sourcePath) {
+        return sourcePath;
+    }
+
+    std::error_code error;
+    const auto bakedTime = std::filesystem::last_write_time(bakedPath, error);
+    if (error) {
+        return sourcePath;
+    }
+
+    // a missing source leaves only the baked file, a newer one means the bake is stale
+    const auto sourceTime = std::filesystem::last_write_time(sourcePath, error);
+    if (!error && sourceTime > bakedTime) {
+        std::cout << "INFO::texture_baker:resolve: " << bakedPath << " is older than its source, loading the source\n";
+        return sourcePath;
+    }
+
+    return bakedPath;
+}
+
+bool bakeTexture(const std::string& sourcePath, TextureUsage usage, uint32_t channel) {
+    int width, height, channels;
+    uint8_t* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        std::cerr << "ERROR::texture_baker:bakeTexture: could not load " << sourcePath << '\n';
+        return false;
+    }
+
+    std::vector<uint8_t> level(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+
+    std::optional<block_compression::BlockFormat> blockFormat;
+    VkFormat format;
+    switch (usage) {
+        case TextureUsage::Color: {
+            bool translucent = false;
+            for (size_t i = 3; i < level.size() && channels == 4 && !translucent; i += 4) {
+                translucent = level[i] < 255;
+            }
+            blockFormat = translucent ? block_compression::BlockFormat::BC3 : block_compression::BlockFormat::BC1;
+            format = translucent ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+            break;
+        }
+        case TextureUsage::Mask:
+            // BC1 shares one colour line per block, unrelated channels would bleed into each other
+            format = VK_FORMAT_R8G8B8A8_UNORM;
+            break;
+        case TextureUsage::Normal:
+            blockFormat = block_compression::BlockFormat::BC5;
+            format = VK_FORMAT_BC5_UNORM_BLOCK;
+            break;
+        case TextureUsage::Scalar:
+        default:
+            blockFormat = block_compression::BlockFormat::BC4;
+            format = VK_FORMAT_BC4_UNORM_BLOCK;
+            // BC4 encodes red, grey sources have the value in every colour channel already
+            for (size_t i = 0; i < level.size() && channel > 0; i += 4) {
+                level[i] = level[i + std::min(channel, 3u)];
+            }
+            break;
+    }
+
+    return saveMipChain(std::move(level), static_cast<uint32_t>(width), static_cast<uint32_t>(height), blockFormat, format,
+            usage == TextureUsage::Normal, getBakedPath(sourcePath, usage, channel));
+}
+
+glm::vec3 getOrmConstant(const aiMaterial* material) {
+    float roughness = 1.f;
+    float metallic = 0.f;
+    if (material->Get(AI_MATKEY_ROUGHNESS_FACTOR, roughness) != AI_SUCCESS) {
+        material->Get(AI_MATKEY_GLOSSINESS_FACTOR, roughness);
+    }
+    if (material->Get(AI_MATKEY_METALLIC_FACTOR, metallic) != AI_SUCCESS) {
+        material->Get(AI_MATKEY_SPECULAR_FACTOR, metallic);
+    }
+
+    return glm::vec3(1.f, roughness, metallic);
+}
+
+OrmSources getOrmSources(const aiMaterial* material, const std::string& directory, const glm::vec3& constant) {
+    const auto getPath = [material, &directory](aiTextureType type) {
+        aiString filepath;
+        return material->GetTexture(type, 0, &filepath) == AI_SUCCESS ? directory + '/' + filepath.C_Str() : std::string();
+    };
+
+    OrmSources sources{
+        .occlusion = getPath(aiTextureType_AMBIENT_OCCLUSION),
+        .roughness = getPath(aiTextureType_DIFFUSE_ROUGHNESS),
+        .metallic = getPath(aiTextureType_METALNESS),
+        .constant = constant
+    };
+    if (sources.metallic.empty()) {
+        sources.metallic = getPath(aiTextureType_SPECULAR);
+    }
+
+    return sources;
+}
+
+std::string packOcclusionRoughnessMetallic(const std::string& directory, const OrmSources& sources) {
+    const std::string* paths[3] = { &sources.occlusion, &sources.roughness, &sources.metallic };
+    if (paths[0]->empty() && paths[1]->empty() && paths[2]->empty()) {
+        return {};
+    }
+
+    // keyed by everything that goes into it, the constants only matter for channels without a map
+    // and the storage format is part of it so packs from an older layout aren't picked up
+    std::ostringstream key;
+    key << "rgba8\n";
+    for (uint32_t c = 0; c < 3; c++) {
+        key << *paths[c] << '\n';
+        if (paths[c]->empty()) {
+            key << sources.constant[c] << '\n';
+        }
+    }
+    std::ostringstream name;
+    name << "orm_" << std::hex << std::hash<std::string>{}(key.str()) << ".ktx2";
+    const std::string packedPath = directory + '/' + name.str();
+
+    std::error_code error;
+    const auto packedTime = std::filesystem::last_write_time(packedPath, error);
+    bool upToDate = !error;
+    for (uint32_t c = 0; c < 3 && upToDate; c++) {
+        upToDate = paths[c]->empty() || std::filesystem::last_write_time(*paths[c], error) <= packedTime || error;
+    }
+    if (upToDate) {
+        return name.str();
+    }
+
+    // red of occlusion, green of roughness and blue of metallic, the channels glTF packs them in
+    struct Source {
+        uint8_t* pixels = nullptr;
+        int width = 0;
+        int height = 0;
+    };
+    Source decoded[3];
+    uint32_t width = 1;
+    uint32_t height = 1;
+    for (uint32_t c = 0; c < 3; c++) {
+        if (paths[c]->empty()) {
+            continue;
+        }
+
+        int channels;
+        decoded[c].pixels = stbi_load(paths[c]->c_str(), &decoded[c].width, &decoded[c].height, &channels, STBI_rgb_alpha);
+        if (!decoded[c].pixels) {
+            std::cerr << "ERROR::texture_baker:packOcclusionRoughnessMetallic: could not load " << *paths[c] << ", using the constant\n";
+            continue;
+        }
+        width = std::max(width, static_cast<uint32_t>(decoded[c].width));
+        height = std::max(height, static_cast<uint32_t>(decoded[c].height));
+    }
+
+    // maps of different sizes are point sampled up to the largest one
+    std::vector<uint8_t> packed(static_cast<size_t>(width) * height * 4, 255);
+    for (uint32_t c = 0; c < 3; c++) {
+        const uint8_t value = static_cast<uint8_t>(std::clamp(sources.constant[c], 0.f, 1.f) * 255.f + 0.5f);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t& texel = packed[(static_cast<size_t>(y) * width + x) * 4 + c];
+                if (!decoded[c].pixels) {
+                    texel = value;
+                    continue;
+                }
+
+                const size_t sourceX = static_cast<size_t>(x) * decoded[c].width / width;
+                const size_t sourceY = static_cast<size_t>(y) * decoded[c].height / height;
+                texel = decoded[c].pixels[(sourceY * decoded[c].width + sourceX) * 4 + c];
+            }
+        }
+        stbi_image_free(decoded[c].pixels);
+    }
+
+    std::cout << "INFO::texture_baker:packOcclusionRoughnessMetallic: packing " << packedPath << '\n';
+    if (!saveMipChain(std::move(packed), width, height, std::nullopt, VK_FORMAT_R8G8B8A8_UNORM, false, packedPath)) {
+        return {};
+    }
+
+    return name.str();
+}
+
+uint32_t bakeModelTextures(const std::string& modelPath) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(modelPath, 0);
+    if (!scene || !scene->mRootNode) {
+        std::cerr << "ERROR::texture_baker:bakeModelTextures: " << importer.GetErrorString() << '\n';
+        return 0;
+    }
+
+    // the slots Model::loadMaterials loads on their own, a file shared between colour and normal slots is baked as colour
+    // occlusion, roughness and metallic are packed into one texture per material instead
+    const std::pair<aiTextureType, TextureUsage> slots[] = {
+        { aiTextureType_DIFFUSE, TextureUsage::Color },
+        { aiTextureType_NORMALS, TextureUsage::Normal },
+        { aiTextureType_HEIGHT, TextureUsage::Scalar }
+    };
+
+    const std::string directory = modelPath.substr(0, modelPath.find_last_of('/'));
+    std::map<std::string, TextureUsage> textures;
+    std::set<std::string> packedTextures;
+    for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
+        for (const auto& [type, usage] : slots) {
+            aiString filepath;
+            if (scene->mMaterials[i]->GetTexture(type, 0, &filepath) != AI_SUCCESS) {
+                continue;
+            }
+
+            const auto [texture, inserted] = textures.emplace(directory + '/' + filepath.C_Str(), usage);
+            if (!inserted && texture->second != usage) {
+                texture->second = TextureUsage::Color;
+            }
+        }
+
+        const aiMaterial* material = scene->mMaterials[i];
+        const std::string packedName = packOcclusionRoughnessMetallic(directory, getOrmSources(material, directory, getOrmConstant(material)));
+        if (!packedName.empty()) {
+            packedTextures.insert(packedName);
+        }
+    }
+
+    uint32_t bakedCount = static_cast<uint32_t>(packedTextures.size());
+    for (const auto& [path, usage] : textures) {
+        if (vkw::TextureFile::isContainer(path)) {
+            continue;
+        }
+
+        std::cout << "INFO::texture_baker:bakeModelTextures: baking " << path << '\n';
+        bakedCount += bakeTexture(path, usage) ? 1 : 0;
+    }
+
+    return bakedCount;
+}
+
+} //namespace texture_baker
+
+} //namespace sublimation
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <assimp/material.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace sublimation {
+
+// Offline conversion of a model's PNG/JPG material textures into KTX2 files, block compressed where the channels allow it, with a full mip chain,
+// written next to each source as <name>.ktx2. Model::loadTexture picks them up instead of decoding the source
+// occlusion, roughness and metallic maps are packed into one texture per material at import, see packOcclusionRoughnessMetallic
+namespace texture_baker {
+
+enum class TextureUsage {
+    Color, ///< sRGB BC1, BC3 when any texel is translucent
+    Normal, ///< BC5, the shader rebuilds z
+    Scalar, ///< BC4 of one source channel, read back as red
+    Mask ///< linear RGBA8, channels hold unrelated values such as packed occlusion, roughness and metallic
+};
+
+// <name>.ktx2, scalar bakes are per channel as <name>.<r|g|b|a>.ktx2 since one packed source can feed several slots
+std::string getBakedPath(const std::string& sourcePath, TextureUsage usage = TextureUsage::Color, uint32_t channel = 0);
+// the baked texture if there is one at least as new as the source, the source otherwise
+std::string resolve(const std::string& sourcePath, TextureUsage usage = TextureUsage::Color, uint32_t channel = 0);
+
+bool bakeTexture(const std::string& sourcePath, TextureUsage usage, uint32_t channel = 0);
+
+// source maps of a material's packed occlusion/roughness/metallic texture, absolute paths, empty when the material has none
+struct OrmSources {
+    std::string occlusion;
+    std::string roughness;
+    std::string metallic; ///< the specular map when there is no metallic one
+    glm::vec3 constant; ///< occlusion, roughness, metallic of channels without a map
+};
+
+// the material's factors, 1 for occlusion, roughness falls back to glossiness and metallic to specular
+glm::vec3 getOrmConstant(const aiMaterial* material);
+OrmSources getOrmSources(const aiMaterial* material, const std::string& directory, const glm::vec3& constant);
+// packs red of occlusion, green of roughness and blue of metallic into one RGBA8 texture with mips, the glTF layout,
+// cached in directory under a name keyed by the sources and rebuilt once one of them is newer
+// returns the file name within directory, empty if the material has none of the maps or the pack failed
+std::string packOcclusionRoughnessMetallic(const std::string& directory, const OrmSources& sources);
+// bakes every texture the model's materials reference, returns how many were written
+uint32_t bakeModelTextures(const std::string& modelPath);
+
+} //namespace texture_baker
+
+} //namespace sublimation
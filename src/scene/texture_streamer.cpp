@@ -0,0 +1,199 @@
+#include <scene/texture_streamer.h>
+
+#include <graphics/vulkan/rendering_device.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace sublimation {
+
+TextureStreamer::~TextureStreamer() {
+    // the textures themselves belong to the model, only the reads still write into the entries
+    // and uploads that weren't swapped in yet are still ours
+    JobSystem* jobSystem = JobSystem::getSingleton();
+    for (auto& entry : entries) {
+        jobSystem->wait(entry->job);
+        vkw::RenderingDevice::getSingleton()->destroyTexture(entry->uploadTexture);
+    }
+}
+
+int32_t TextureStreamer::add(const std::string& filename, uint32_t channel) {
+    vkw::TextureFile file;
+    if (!file.load(filename, tailExtent)) {
+        return -1;
+    }
+
+    std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+    entry->filename = filename;
+    entry->channel = channel;
+    entry->fullExtent = std::max(file.storedExtent.width, file.storedExtent.height);
+    entry->tailLevel = file.baseLevel;
+    entry->residentLevel = file.baseLevel;
+    entry->requestedLevel = file.baseLevel;
+    entry->texture = vkw::RenderingDevice::getSingleton()->createTextureFromContainer(file, filename, VK_FILTER_LINEAR,
+            VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, false, channel);
+    entry->residentSize = vkw::RenderingDevice::getSingleton()->getTexture(entry->texture)->getMemorySize();
+
+    entries.push_back(std::move(entry));
+
+    return static_cast<int32_t>(entries.size()) - 1;
+}
+
+void TextureStreamer::request(int32_t stream, float texels) {
+    Entry& entry = *entries[stream];
+
+    // the coarsest level that still has at least texels across
+    uint32_t level = 0;
+    while (level < entry.tailLevel && static_cast<float>(entry.fullExtent >> (level + 1)) >= texels) {
+        level++;
+    }
+
+    entry.requestedLevel = entry.lastUsed == frame ? std::min(entry.requestedLevel, level) : level;
+    entry.lastUsed = frame;
+}
+
+void TextureStreamer::update(VkDeviceSize budget, std::vector<int32_t>& replaced) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    JobSystem* jobSystem = JobSystem::getSingleton();
+
+    // host written textures are ready as soon as their read is, staged ones once the frame that copied them has retired
+    const uint64_t completedFrame = rd->getCompletedFrame();
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry& entry = *entries[i];
+        if (entry.pendingLevel == noLevel || jobSystem->isBusy(entry.job)) {
+            continue;
+        }
+
+        vkw::TextureHandle texture;
+        if (entry.uploadTexture.isValid()) {
+            if (entry.uploadFrame > completedFrame) {
+                continue;
+            }
+            texture = entry.uploadTexture;
+            entry.uploadTexture = {};
+        } else if (entry.pendingTexture) {
+            texture = rd->addTexture(std::move(entry.pendingTexture));
+        } else if (entry.pendingLoaded) {
+            // still to be recorded, see recordUploads
+            continue;
+        } else {
+            std::cerr << "ERROR::TextureStreamer:update: could not stream " << entry.filename << ", keeping its resident levels\n";
+        }
+
+        if (texture.isValid()) {
+            rd->destroyTexture(entry.texture);
+            entry.texture = texture;
+            entry.residentSize = rd->getTexture(entry.texture)->getMemorySize();
+            entry.residentLevel = entry.pendingLevel;
+            replaced.push_back(static_cast<int32_t>(i));
+        }
+
+        entry.pending.reset();
+        entry.pendingLevel = noLevel;
+        pendingLoads--;
+    }
+
+    // reads in flight count at the size they will have, evictions only pay off once their read is done
+    VkDeviceSize residentSize = 0;
+    for (const auto& entry : entries) {
+        residentSize += entry->pendingLevel != noLevel ? getLevelsSize(*entry, entry->pendingLevel) : entry->residentSize;
+    }
+
+    // least recently drawn first, textures drawn this frame only give back levels they didn't ask for
+    while (residentSize > budget && pendingLoads < maxPendingLoads) {
+        Entry* victim = nullptr;
+        for (auto& entry : entries) {
+            const bool unneeded = entry->lastUsed < frame || entry->requestedLevel > entry->residentLevel;
+            if (unneeded && entry->pendingLevel == noLevel && entry->residentLevel < entry->tailLevel &&
+                    (!victim || entry->lastUsed < victim->lastUsed)) {
+                victim = entry.get();
+            }
+        }
+        if (!victim) {
+            break;
+        }
+
+        residentSize -= victim->residentSize - getLevelsSize(*victim, victim->residentLevel + 1);
+        startLoad(*victim, victim->residentLevel + 1);
+    }
+
+    for (auto& entry : entries) {
+        if (pendingLoads >= maxPendingLoads) {
+            break;
+        }
+        if (entry->lastUsed != frame || entry->pendingLevel != noLevel || entry->requestedLevel >= entry->residentLevel) {
+            continue;
+        }
+
+        const VkDeviceSize requestedSize = getLevelsSize(*entry, entry->requestedLevel);
+        if (residentSize - entry->residentSize + requestedSize > budget) {
+            continue;
+        }
+
+        residentSize += requestedSize - entry->residentSize;
+        startLoad(*entry, entry->requestedLevel);
+    }
+
+    frame++;
+}
+
+void TextureStreamer::recordUploads(VkCommandBuffer commandBuffer, uint64_t frame) {
+    vkw::RenderingDevice* rd = vkw::RenderingDevice::getSingleton();
+    JobSystem* jobSystem = JobSystem::getSingleton();
+
+    // recorded ahead of the frame's passes instead of submitted on their own, so no upload waits for the queue to drain
+    VkDeviceSize uploadSize = 0;
+    for (auto& entry : entries) {
+        if (uploadSize >= maxUploadSize) {
+            break;
+        }
+        if (entry->pendingLevel == noLevel || jobSystem->isBusy(entry->job) || !entry->pendingLoaded || !entry->pending || entry->pendingTexture) {
+            continue;
+        }
+
+        uploadSize += entry->pending->data.size();
+        entry->uploadTexture = rd->addTexture(std::make_unique<vkw::Texture2D>(*entry->pending, entry->filename, VK_FILTER_LINEAR,
+                VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, false, entry->channel, commandBuffer));
+        entry->uploadFrame = frame;
+        entry->pending.reset();
+    }
+}
+
+VkDeviceSize TextureStreamer::getResidentSize() const {
+    VkDeviceSize size = 0;
+    for (const auto& entry : entries) {
+        size += entry->residentSize;
+    }
+
+    return size;
+}
+
+VkDeviceSize TextureStreamer::getLevelsSize(const Entry& entry, uint32_t level) {
+    // every level is a quarter of the one above, so is the chain below it
+    if (level < entry.residentLevel) {
+        return entry.residentSize << (2 * (entry.residentLevel - level));
+    }
+
+    return entry.residentSize >> (2 * (level - entry.residentLevel));
+}
+
+void TextureStreamer::startLoad(Entry& entry, uint32_t level) {
+    entry.pendingLevel = level;
+    entry.pendingLoaded = false;
+    entry.pending = std::make_unique<vkw::TextureFile>();
+    pendingLoads++;
+
+    Entry* target = &entry;
+    const uint32_t maxExtent = entry.fullExtent >> level;
+    JobSystem::getSingleton()->execute(entry.job, [target, maxExtent]() {
+        target->pendingLoaded = target->pending->load(target->filename, maxExtent);
+
+        // without queue work the texture can be built right here, anything else has to wait for the render thread
+        if (target->pendingLoaded && vkw::Texture2D::canUploadFromHost(*target->pending)) {
+            target->pendingTexture = std::make_unique<vkw::Texture2D>(*target->pending, target->filename, VK_FILTER_LINEAR,
+                    VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, false, target->channel);
+        }
+    });
+}
+
+} //namespace sublimation
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <core/job_system.h>
+#include <graphics/vulkan/resource_pool.h>
+#include <graphics/vulkan/texture.h>
+#include <graphics/vulkan/texture_file.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sublimation {
+
+// Keeps only the mip levels of container textures (.ktx2, .dds) that are drawn large enough to need them in device memory
+// textures start with their levels up to tailExtent, finer ones are read on the job system once requested, copied
+// within the frame's commands by recordUploads and swapped in by update once that frame has retired, over budget
+// the textures drawn least recently give their finest level back
+// with host image copy the reads also create and fill the textures, update then only swaps them in
+class TextureStreamer {
+public:
+    TextureStreamer() = default;
+    ~TextureStreamer();
+
+    // levels at most this large stay resident for as long as the texture is loaded
+    static constexpr uint32_t tailExtent = 64;
+    // reads in flight at once, and bytes recorded into one frame, finished reads past it wait for the next one
+    static constexpr uint32_t maxPendingLoads = 8;
+    static constexpr VkDeviceSize maxUploadSize = 32ull << 20;
+
+    // reads and uploads the tail right away, -1 if the file can't be read, channel is passed on to Texture2D
+    int32_t add(const std::string& filename, uint32_t channel = 0);
+    // the current texture, replaced whenever its resident levels change
+    vkw::TextureHandle getTexture(int32_t stream) const { return entries[stream]->texture; }
+
+    // screen space feedback, stream is sampled this frame with about texels texels across its largest side
+    void request(int32_t stream, float texels);
+    // uploads finished reads, then evicts and starts reads to move the resident levels towards this frame's requests
+    // the streams whose texture was replaced are returned, the old textures are released once the GPU is done with them
+    void update(VkDeviceSize budget, std::vector<int32_t>& replaced);
+    // records the copies of finished reads into commandBuffer, frame is the frame timeline value it completes with
+    void recordUploads(VkCommandBuffer commandBuffer, uint64_t frame);
+
+    VkDeviceSize getResidentSize() const;
+
+private:
+    static constexpr uint32_t noLevel = UINT32_MAX;
+
+    struct Entry {
+        std::string filename;
+        uint32_t channel = 0;
+        vkw::TextureHandle texture;
+        VkDeviceSize residentSize = 0;
+
+        uint32_t fullExtent = 0; ///< largest side of level 0
+        uint32_t tailLevel = 0; ///< first level of the tail
+        uint32_t residentLevel = 0; ///< finest level in device memory
+        uint32_t requestedLevel = 0; ///< finest level requested in lastUsed
+        uint64_t lastUsed = 0;
+
+        // read in flight, levels from pendingLevel on
+        JobContext job;
+        uint32_t pendingLevel = noLevel;
+        std::unique_ptr<vkw::TextureFile> pending;
+        std::unique_ptr<vkw::Texture> pendingTexture; ///< already written from the loader thread
+        bool pendingLoaded = false;
+        vkw::TextureHandle uploadTexture; ///< copied by the commands of uploadFrame, swapped in once it has retired
+        uint64_t uploadFrame = 0;
+    };
+
+    // estimated device memory of the levels from level on, scaled from the resident ones
+    static VkDeviceSize getLevelsSize(const Entry& entry, uint32_t level);
+    void startLoad(Entry& entry, uint32_t level);
+
+    std::vector<std::unique_ptr<Entry>> entries;
+    uint32_t pendingLoads = 0;
+    uint64_t frame = 1;
+};
+
+} //namespace sublimation